@@ -0,0 +1,673 @@
+// hex_bench: seeded microbenchmarks of the board, collision and effects hot paths.
+// The game translation unit is compiled in headless mode so the benchmarks can reach its internals.
+#include "../src/game.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+#ifndef HEX_VERSION
+#define HEX_VERSION "unknown"
+#endif
+
+#define BENCH_DT (1.0f / 60.0f)
+
+struct BenchConfig {
+    unsigned int seed = 1337;
+    int iterations = 1000;
+    const char* filter = nullptr;
+    int soakFrames = 0;
+    const char* record = nullptr;
+    bool startup = false;
+    const char* pack = nullptr;
+    int pipelineFrames = 0;
+    int persistSaves = 0;
+    bool check = false;
+};
+
+struct BenchResult {
+    const char* name;
+    int iterations;
+    double meanNs, medianNs, minNs, maxNs;
+    PerfTotals perf;
+};
+
+using Clock = std::chrono::steady_clock;
+
+// the effects draw from the thread's cosmetic generator, it is seeded with the board so a run repeats exactly
+std::unique_ptr<GameState> makeState(unsigned int seed) {
+    auto gs = std::make_unique<GameState>();
+    fxRand = randSeed(seed);
+    initHeadless(*gs, seed);
+    gs->time = GAME_START_TIME * 2.0f;
+    gs->tmp.frameTime = BENCH_DT;
+    return gs;
+}
+
+void thinBoard(GameState& gs, std::mt19937& rng, float keep) {
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    for (int i = 0; i < BOARD_HEIGHT; ++i)
+        for (int j = 0; j < BOARD_WIDTH; ++j)
+            if (u(rng) > keep)
+                gs.board.things[i][j].exists = false;
+}
+
+void seedBombs(GameState& gs, std::mt19937& rng, float prob) {
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    for (int i = 0; i < BOARD_HEIGHT; ++i)
+        for (int j = 0; j < BOARD_WIDTH; ++j)
+            if (u(rng) < prob)
+                gs.board.things[i][j].thing.bomb = BOMB_ARMED;
+}
+
+// the lowest empty cell touching an existing tile, the place a shot would land
+ThingPos findLanding(GameState& gs) {
+    for (int i = BOARD_HEIGHT - 1; i >= 0; --i) {
+        for (int j = 0; j < BOARD_WIDTH - ((i + gs.board.even) % 2); ++j) {
+            ThingPos pos = {i, j};
+            if (getTile(gs, pos).exists)
+                continue;
+            for (auto& n : getNeighs(gs, pos))
+                if (getTile(gs, n).exists && !getTile(gs, n).thing.bomb)
+                    return pos;
+        }
+    }
+    return {BOARD_HEIGHT - 1, 0};
+}
+
+Thing landingThing(GameState& gs, const ThingPos& pos) {
+    for (auto& n : getNeighs(gs, pos))
+        if (getTile(gs, n).exists && !getTile(gs, n).thing.bomb)
+            return getTile(gs, n).thing;
+    return Thing{};
+}
+
+void clearEffects(GameState& gs) {
+    gs.tmp.particles.clear();
+    gs.tmp.animations.clear();
+    gs.tmp.scorePoints.clear();
+    gs.tmp.shNDrops = 0;
+}
+
+template <typename Prep, typename Op>
+BenchResult runBench(const char* name, int iterations, Prep&& prep, Op&& op) {
+    std::vector<double> ns(iterations);
+    perfEndFrame();
+    for (int i = 0; i < iterations; ++i) {
+        prep(i);
+        auto t0 = Clock::now();
+        op(i);
+        ns[i] = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+    }
+    perfEndFrame();
+    BenchResult res = {name, iterations, 0, 0, 0, 0, perfState.lastFrame};
+    for (auto v : ns)
+        res.meanNs += v / iterations;
+    std::sort(ns.begin(), ns.end());
+    res.medianNs = ns[iterations / 2];
+    res.minNs = ns.front();
+    res.maxNs = ns.back();
+    return res;
+}
+
+void writeResult(const BenchResult& res, bool last) {
+    printf("    {\"name\":\"%s\",\"iterations\":%d,\"mean_ns\":%.1f,\"median_ns\":%.1f,\"min_ns\":%.1f,\"max_ns\":%.1f,\"perf\":",
+        res.name, res.iterations, res.meanNs, res.medianNs, res.minNs, res.maxNs);
+    perfWriteJson(stdout, res.perf, res.iterations);
+    printf("}%s\n", last ? "" : ",");
+}
+
+// names of the scaling results, kept alive until they are written
+const char* benchName(const char* op, const char* size) {
+    static std::deque<std::string> names;
+    return names.emplace_back(std::string("scale/") + op + "/" + size).c_str();
+}
+
+// the board hot paths on a B sized board filled the way a game fills it, run for several sizes so the results
+// show how each path grows with the board
+template <typename B>
+void runScaling(const BenchConfig& cfg, std::vector<BenchResult>& results, const char* size) {
+    auto selected = [&](const char* name) { return !cfg.filter || strstr(name, cfg.filter); };
+    int its = cfg.iterations;
+    RandState r = randSeed(cfg.seed);
+    auto make = [&](int, int) {
+        return randomThing([&](int min, int max) { return randValue(r, min, max); }, BOMB_PROB);
+    };
+    uint32_t version = 0;
+    int rows = B::height - BOARD_EMP_BOT_ROW_GAP;
+    auto dense = std::make_unique<B>();
+    fillRows(*dense, rows, make, version);
+    auto b = std::make_unique<B>();
+
+    // a shot landing under the middle of the lowest row, next to a group of its colour
+    ThingPos landing = {rows, rowCells(*dense, rows) / 2};
+    Thing thing = dense->things[rows - 1][landing.col].thing;
+    thing.bomb = BOMB_NONE;
+    for (auto& n : boardNeighs(*dense, landing))
+        if (dense->things[n.row][n.col].exists)
+            dense->things[n.row][n.col].thing = thing;
+    BoardGeom geom = {{0, 0, TILE_RADIUS * 2 * B::width, ROW_HEIGHT * B::height}, TILE_RADIUS, ROW_HEIGHT, dense->even};
+
+    if (selected(benchName("fillRows", size))) {
+        results.push_back(runBench(benchName("fillRows", size), its, [&](int) {}, [&](int) {
+            fillRows(*b, rows, make, version);
+        }));
+    }
+    if (selected(benchName("shiftRows", size))) {
+        results.push_back(runBench(benchName("shiftRows", size), its, [&](int) { *b = *dense; }, [&](int) {
+            shiftRows(*b, 1, version);
+        }));
+    }
+    if (selected(benchName("dropAt", size))) {
+        results.push_back(runBench(benchName("dropAt", size), its, [&](int) { *b = *dense; }, [&](int) {
+            dropAt(*b, landing, thing, 3, N_TO_DROP, version);
+        }));
+    }
+    // a bullet still below the lowest row, which every step of its flight up to the board scans in full
+    if (selected(benchName("findHit", size))) {
+        volatile int sink = 0;
+        results.push_back(runBench(benchName("findHit", size), its, [&](int) {}, [&](int i) {
+            Vector2 p = {geom.rect.width * float(i % 17) / 16.0f, geom.rect.height - TILE_RADIUS};
+            sink = sink + findHit(*dense, geom, 0, p, p + Vector2{0, -BULLET_RADIUS_H}, BULLET_HIT_DIST_SQR).row;
+        }));
+    }
+    // what drawBoard does per frame short of the draw calls
+    if (selected(benchName("forEachTile", size))) {
+        volatile float sink = 0;
+        results.push_back(runBench(benchName("forEachTile", size), its, [&](int) {}, [&](int) {
+            float sum = 0;
+            forEachTile(*dense, [&](ThingPos p, const Tile& tile) {
+                sum += geomPixByPos(geom, p).y + dense->shakes[p.row][p.col] + tile.thing.clr;
+            });
+            sink = sum;
+        }));
+    }
+}
+
+void runBenchmarks(const BenchConfig& cfg, std::vector<BenchResult>& results) {
+    auto selected = [&](const char* name) { return !cfg.filter || strstr(name, cfg.filter); };
+    int its = cfg.iterations;
+    std::mt19937 rng(cfg.seed);
+
+    auto dense = makeState(cfg.seed);
+    auto sparse = makeState(cfg.seed);
+    thinBoard(*sparse, rng, 0.4f);
+    auto bombs = makeState(cfg.seed);
+    seedBombs(*bombs, rng, 0.25f);
+    auto gs = makeState(cfg.seed);
+
+    if (selected("generateRows")) {
+        results.push_back(runBench("generateRows", its, [&](int) {}, [&](int) {
+            generateRows(*gs, BOARD_HEIGHT - BOARD_EMP_BOT_ROW_GAP);
+        }));
+    }
+    if (selected("shiftBoard")) {
+        results.push_back(runBench("shiftBoard", its, [&](int) { gs->board = dense->board; }, [&](int) {
+            shiftBoard(*gs, 1);
+        }));
+    }
+    if (selected("checkLines")) {
+        auto lifted = makeState(cfg.seed);
+        int last = BOARD_HEIGHT - BOARD_EMP_BOT_ROW_GAP - 1;
+        for (int i = last - 2; i <= last; ++i)
+            for (int j = 0; j < BOARD_WIDTH; ++j)
+                lifted->board.things[i][j].exists = false;
+        results.push_back(runBench("checkLines", its, [&](int) { gs->board = lifted->board; }, [&](int) {
+            checkLines(*gs);
+        }));
+    }
+    struct { const char* name; GameState* base; } drops[] = {
+        {"checkDrop/sparse", sparse.get()}, {"checkDrop/dense", dense.get()}, {"checkDrop/bombs", bombs.get()}
+    };
+    for (auto& d : drops) {
+        if (!selected(d.name))
+            continue;
+        auto pos = findLanding(*d.base);
+        auto thing = landingThing(*d.base, pos);
+        results.push_back(runBench(d.name, its, [&](int) { gs->board = d.base->board; }, [&](int) {
+            checkDrop(*gs, pos, thing, N_TO_DROP);
+        }));
+    }
+    if (selected("explodeBomb")) {
+        auto cascade = makeState(cfg.seed);
+        int mid = BOARD_HEIGHT - BOARD_EMP_BOT_ROW_GAP - 4;
+        for (int i = mid - 3; i <= mid + 3; ++i)
+            for (int j = 1; j < BOARD_WIDTH - 2; j += 2)
+                cascade->board.things[i][j].thing.bomb = BOMB_ARMED;
+        results.push_back(runBench("explodeBomb", its, [&](int) { gs->board = cascade->board; clearEffects(*gs); }, [&](int) {
+            explodeBomb(*gs, {mid, BOARD_WIDTH / 2});
+        }));
+    }
+    if (selected("flyBullet")) {
+        float delta = BENCH_DT / UPDATE_ITS;
+        results.push_back(runBench("flyBullet", its, [&](int i) {
+            gs->board = dense->board;
+            clearEffects(*gs);
+            gs->gun.dir = PI * 0.45f * (float((i * 7) % 17) / 8.0f - 1.0f);
+            shootAndRearm(*gs);
+        }, [&](int) {
+            for (int step = 0; gs->bullet.exists && step < 10000; ++step) {
+                gs->time += delta;
+                flyBullet(*gs, delta);
+            }
+        }));
+    }
+    if (selected("flyParticles")) {
+        std::uniform_real_distribution<float> u(0.0f, 1.0f);
+        results.push_back(runBench("flyParticles", its, [&](int) {
+            gs->tmp.particles.clear();
+            for (int i = 0; i < MAX_PARTICLES; ++i)
+                addParticle(*gs, Thing{}, {u(rng) * SCREEN_WIDTH, u(rng) * SCREEN_HEIGHT * 0.5f}, {u(rng) * 200.0f - 100.0f, -u(rng) * 400.0f});
+        }, [&](int) {
+            flyParticles(*gs);
+        }));
+    }
+    if (selected("boardCopy")) {
+        results.push_back(runBench("boardCopy", its, [&](int) {}, [&](int) {
+            gs->board = dense->board;
+        }));
+    }
+    if (selected("snapshot")) {
+        auto snap = std::make_unique<SimState>();
+        results.push_back(runBench("snapshot/take", its, [&](int) {}, [&](int) {
+            takeSnapshot(*dense, *snap);
+        }));
+        results.push_back(runBench("snapshot/restore", its, [&](int) {}, [&](int) {
+            restoreSnapshot(*gs, *snap);
+        }));
+    }
+    if (selected("rewind")) {
+        // a short played stretch gives the ring realistic per-record deltas
+        auto play = makeState(cfg.seed);
+        std::vector<std::unique_ptr<SimState>> frames;
+        for (int f = 0; f < 8 * 60; ++f) {
+            if (f % 60 == 0) {
+                queueInput(*play, INPUT_AIM, getTime(*play), float(f % 7) * 0.2f - 0.6f);
+                queueInput(*play, INPUT_FIRE, getTime(*play));
+                frames.push_back(std::make_unique<SimState>(*play));
+            }
+            stepHeadless(*play, BENCH_DT);
+        }
+        auto& ring = gs->tmp.rewind;
+        auto snap = std::make_unique<SimState>();
+        results.push_back(runBench("rewind/record", its, [&](int) {}, [&](int i) {
+            ring.push(*frames[i % frames.size()], i, true);
+        }));
+        results.push_back(runBench("rewind/restore", its, [&](int) {
+            ring.clear();
+            for (size_t k = 0; k < frames.size(); ++k)
+                ring.push(*frames[k], double(k), true);
+        }, [&](int) {
+            ring.restore(0, *snap);
+        }));
+        ring.clear();
+    }
+    if (selected("reload")) {
+        std::vector<char> blob(exportState(*dense, nullptr, 0));
+        exportState(*dense, blob.data(), blob.size());
+        // an older module whose Tile layout differs, everything but the board cells migrates
+        std::vector<char> stale = blob;
+        StateBlobHeader hdr;
+        memcpy(&hdr, stale.data(), sizeof(hdr));
+        hdr.layoutHash ^= 1;
+        memcpy(stale.data(), &hdr, sizeof(hdr));
+        for (uint32_t i = 0; i < hdr.nFields; ++i) {
+            auto rec = (FieldRecord*)(stale.data() + sizeof(hdr) + i * sizeof(FieldRecord));
+            if (!strcmp(rec->name, "board.things"))
+                rec->typeHash ^= 1;
+        }
+        SetTraceLogLevel(LOG_WARNING);
+        results.push_back(runBench("reload/adopt", its, [&](int) {}, [&](int) {
+            adoptState(*gs, gs->ga.p);
+        }));
+        results.push_back(runBench("reload/export", its, [&](int) {}, [&](int) {
+            exportState(*dense, blob.data(), blob.size());
+        }));
+        results.push_back(runBench("reload/import", its, [&](int) {}, [&](int) {
+            importState(*gs, blob.data(), blob.size());
+        }));
+        results.push_back(runBench("reload/migrate", its, [&](int) {}, [&](int) {
+            importState(*gs, stale.data(), stale.size());
+        }));
+        SetTraceLogLevel(LOG_INFO);
+    }
+    if (selected("updateOnce")) {
+        results.push_back(runBench("updateOnce", its, [&](int) { gs->board = dense->board; gs->gameOver = false; }, [&](int) {
+            updateOnce(*gs);
+        }));
+    }
+    // draw calls go nowhere without textures, which leaves the board walk and per-tile math
+    if (selected("drawBoard")) {
+        results.push_back(runBench("drawBoard", its, [&](int) { gs->board = dense->board; }, [&](int) {
+            drawBoard(*gs);
+        }));
+    }
+    // cold plans from scratch, warm finds the board unchanged, edit changes one cell near the bottom of the pile,
+    // scroll moves the board
+    if (selected("planShots")) {
+        auto pos = findLanding(*dense);
+        results.push_back(runBench("planShots/cold", its, [&](int) { gs->board = dense->board; gs->tmp.planner.primed = false; }, [&](int) {
+            planShots(*gs, 0, false);
+        }));
+        results.push_back(runBench("planShots/warm", its, [&](int) {}, [&](int) {
+            planShots(*gs, 0, false);
+        }));
+        results.push_back(runBench("planShots/edit", its, [&](int i) {
+            getTile(*gs, pos).exists = (i % 2 == 0);
+        }, [&](int) {
+            planShots(*gs, 0, false);
+        }));
+        // the board coming down half a pixel a call, as it does every few frames in play
+        results.push_back(runBench("planShots/scroll", its, [&](int) {
+            gs->board.scroll += pixelsScroll(0.5f);
+        }, [&](int) {
+            planShots(*gs, 0, false);
+        }));
+        results.push_back(runBench("planShots/parallel", its, [&](int) { gs->tmp.planner.primed = false; }, [&](int) {
+            planShots(*gs, 0, true);
+        }));
+    }
+    // cold traces a fresh path each time, cached sweeps a few directions the cache already holds
+    if (selected("aimPreview")) {
+        results.push_back(runBench("aimPreview/cold", its, [&](int i) {
+            gs->board = dense->board;
+            gs->tmp.boardVersion++;
+            gs->gun.dir = -PI * 0.4f + PI * 0.8f * (i % 97) / 96.0f;
+        }, [&](int) {
+            updateAimPreview(*gs);
+        }));
+        results.push_back(runBench("aimPreview/cached", its, [&](int i) {
+            gs->gun.dir = -PI * 0.4f + PI * 0.01f * (i % 8);
+        }, [&](int) {
+            updateAimPreview(*gs);
+        }));
+    }
+    if (selected("addShakeRecur")) {
+        auto pos = findLanding(*dense);
+        auto thing = landingThing(*dense, pos);
+        results.push_back(runBench("addShakeRecur", its, [&](int) { gs->board = dense->board; }, [&](int) {
+            Visited vis = {};
+            shakeRecur(gs->board, pos, vis, thing, 0, SHAKE_TIME, SHAKE_DEPTH);
+        }));
+    }
+    runScaling<Board>(cfg, results, "9x36");
+    runScaling<BoardT<16, 64>>(cfg, results, "16x64");
+    runScaling<BoardT<32, 256>>(cfg, results, "32x256");
+}
+
+// a played state exported by this module is imported as if an older one had written it: the fields are packed in
+// reverse order and streamSeed is missing, so the importer has to remap every offset and take streamSeed from the
+// reset it runs on the blob's seed. the receiving state starts from another seed so a reset on its own seed shows
+bool checkReload(const BenchConfig& cfg) {
+    auto src = makeState(cfg.seed);
+    for (int f = 0; f < 8 * 60; ++f) {
+        if (f % 60 == 0) {
+            queueInput(*src, INPUT_AIM, getTime(*src), float(f % 7) * 0.2f - 0.6f);
+            queueInput(*src, INPUT_FIRE, getTime(*src));
+        }
+        stepHeadless(*src, BENCH_DT);
+    }
+    std::vector<char> blob(exportState(*src, nullptr, 0));
+    exportState(*src, blob.data(), blob.size());
+
+    StateBlobHeader hdr;
+    memcpy(&hdr, blob.data(), sizeof(hdr));
+    const char* sim = blob.data() + sizeof(hdr) + hdr.nFields * sizeof(FieldRecord);
+    std::vector<FieldRecord> records;
+    std::vector<char> data;
+    for (size_t i = SIM_LAYOUT_FIELDS; i-- > 0;) {
+        auto rec = layoutRecord(SIM_LAYOUT[i]);
+        if (!strcmp(rec.name, "streamSeed"))
+            continue;
+        data.resize((data.size() + 7) & ~size_t(7));
+        rec.offset = (uint32_t)data.size();
+        data.insert(data.end(), sim + SIM_LAYOUT[i].offset, sim + SIM_LAYOUT[i].offset + rec.size);
+        records.push_back(rec);
+    }
+    StateBlobHeader old = {STATE_BLOB_MAGIC, STATE_LAYOUT_VERSION - 1, STATE_LAYOUT_HASH ^ 1, (uint32_t)records.size(), (uint32_t)data.size()};
+    std::vector<char> stale(sizeof(old));
+    memcpy(stale.data(), &old, sizeof(old));
+    stale.insert(stale.end(), (const char*)records.data(), (const char*)(records.data() + records.size()));
+    stale.insert(stale.end(), data.begin(), data.end());
+
+    auto reset = std::make_unique<SimState>(*src);
+    reset->streamSeed = src->seed;
+    bool ok = true;
+    auto check = [&](const char* what, const std::vector<char>& b, const SimState& expected) {
+        auto dst = makeState(cfg.seed + 1);
+        SetTraceLogLevel(LOG_WARNING);
+        bool imported = importState(*dst, b.data(), b.size());
+        SetTraceLogLevel(LOG_INFO);
+        if (!imported || stateHash(*dst) != stateHash(expected)) {
+            fprintf(stderr, "check reload/%s failed: hash %016llx, expected %016llx\n", what,
+                (unsigned long long)stateHash(*dst), (unsigned long long)stateHash(expected));
+            ok = false;
+        }
+    };
+    check("same", blob, *src);
+    check("migrate", stale, *reset);
+    return ok;
+}
+
+// plays whole games with a random aiming policy, restarting after every game over
+void runSoak(const BenchConfig& cfg) {
+    auto gs = makeState(cfg.seed);
+    std::mt19937 rng(cfg.seed);
+    std::uniform_real_distribution<float> aim(-PI * 0.45f, PI * 0.45f);
+    if (cfg.record)
+        startReplayRecord(*gs, cfg.record);
+    uint64_t shots = 0, games = 0;
+    double nextShot = 0;
+    perfEndFrame();
+    auto t0 = Clock::now();
+    for (int f = 0; f < cfg.soakFrames; ++f) {
+        if (getTime(*gs) > nextShot) {
+            queueInput(*gs, INPUT_AIM, getTime(*gs), aim(rng));
+            queueInput(*gs, INPUT_FIRE, getTime(*gs));
+            nextShot = getTime(*gs) + 0.5;
+            shots += !gs->gameOver;
+            games += gs->gameOver;
+        }
+        stepHeadless(*gs, BENCH_DT);
+    }
+    double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+    perfEndFrame();
+    stopReplayRecord(*gs);
+    printf("  \"soak\":{\"frames\":%d,\"shots\":%llu,\"games\":%llu,\"seconds\":%.3f,\"frames_per_sec\":%.1f,\"score\":%d,\"perf_per_frame\":",
+        cfg.soakFrames, (unsigned long long)shots, (unsigned long long)games, sec, cfg.soakFrames / sec, gs->score);
+    perfWriteJson(stdout, perfState.lastFrame, cfg.soakFrames);
+    auto& a = gs->tmp.audio.stats;
+    printf(",\"stream\":{\"rows\":%lld,\"chunks_made\":%llu,\"cache_chunks\":%d}",
+        (long long)gs->streamRow, (unsigned long long)gs->tmp.stream.generated, STREAM_CACHE_CHUNKS);
+    printf(",\"audio\":{\"requested\":%llu,\"coalesced\":%llu,\"limited\":%llu,\"dropped\":%llu,\"played\":%llu,\"stolen\":%llu,\"peak_voices\":%u,\"peak_mix\":%.2f}",
+        (unsigned long long)a.requested, (unsigned long long)a.coalesced, (unsigned long long)a.limited, (unsigned long long)a.dropped,
+        (unsigned long long)a.played, (unsigned long long)a.stolen, a.peakVoices, a.peakMix);
+    printf("},\n");
+}
+
+// the simulation thread at PIPELINE_SIM_HZ against a 60 Hz consumer standing in for the render thread, which
+// feeds it aim and fire inputs, takes the newest snapshot and flushes its sounds
+void runPipelined(const BenchConfig& cfg) {
+    auto gs = makeState(cfg.seed);
+    std::mt19937 rng(cfg.seed);
+    std::uniform_real_distribution<float> aim(-PI * 0.45f, PI * 0.45f);
+    auto& p = simPipeline();
+    p.focused = true;
+    startPipeline(*gs, PIPELINE_SIM_HZ);
+    auto& view = *p.view;
+    double nextShot = 0;
+    auto frame = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(BENCH_DT));
+    auto t0 = Clock::now();
+    for (int f = 0; f < cfg.pipelineFrames; ++f) {
+        view.time = pipelineTime(p);
+        if (view.time > nextShot) {
+            queueInput(view, INPUT_AIM, view.time, aim(rng));
+            queueInput(view, INPUT_FIRE, view.time);
+            nextShot = view.time + 0.5;
+        }
+        sendInputs(p, view);
+        takeRender(p, view);
+        flushSounds(view);
+        presentPipeline(p, pipelineTime(p));
+        std::this_thread::sleep_until(t0 + frame * (f + 1));
+    }
+    double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+    stopPipeline(p);
+    auto st = getPipelineStats();
+    printf("  \"pipeline\":{\"frames\":%d,\"seconds\":%.3f,\"sim_hz\":%.0f,\"steps\":%llu,\"steps_per_sec\":%.1f,\"rendered\":%llu,\"skipped\":%llu,"
+        "\"repeated\":%llu,\"dropped_inputs\":%llu,\"last_step_ms\":%.3f,\"age_ms\":{\"p50\":%.3f,\"p99\":%.3f},\"input_to_present_ms\":{\"p50\":%.3f,\"p99\":%.3f},\"score\":%d},\n",
+        cfg.pipelineFrames, sec, PIPELINE_SIM_HZ, (unsigned long long)st.steps, st.steps / sec, (unsigned long long)st.rendered, (unsigned long long)st.skipped,
+        (unsigned long long)st.repeated, (unsigned long long)st.droppedInputs, st.simMs, st.ageP50, st.ageP99, st.inputP50, st.inputP99, gs->score);
+}
+
+double percentileMs(std::vector<double>& v, double p) {
+    if (v.empty())
+        return 0;
+    size_t k = std::min(v.size() - 1, size_t(p * (v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+// what a settings click or a game over costs the frame: first each save written in place the way the game used to,
+// then the same saves queued for the worker one frame apart. The file is read back to check the last one landed
+void runPersist(const BenchConfig& cfg) {
+    std::string path = (std::filesystem::temp_directory_path() / "hex_bench_userdata").string();
+    GameState::UserData usr;
+    std::vector<double> syncMs, queuedMs;
+    for (int i = 0; i < cfg.persistSaves; ++i) {
+        usr.bestScore = i;
+        auto t0 = Clock::now();
+        SaveFileData(path.c_str(), &usr, sizeof(usr));
+        syncMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+    }
+    auto frame = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(BENCH_DT));
+    auto start = Clock::now();
+    for (int i = 0; i < cfg.persistSaves; ++i) {
+        usr.bestScore = cfg.persistSaves + i;
+        usr.musEnabled = i % 2;
+        auto t0 = Clock::now();
+        queueUserData(path.c_str(), usr);
+        queuedMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+        std::this_thread::sleep_until(start + frame * (i + 1));
+    }
+    flushUserData();
+    GameState::UserData back;
+    bool verified = readUserFile(path.c_str(), back) && back == usr;
+    remove(path.c_str());
+    auto st = getPersistStats();
+    printf("  \"persist\":{\"saves\":%d,\"sync_ms\":{\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f},\"queued_ms\":{\"p50\":%.4f,\"p99\":%.4f,\"max\":%.4f},"
+        "\"written\":%llu,\"coalesced\":%llu,\"failed\":%llu,\"worker_write_ms\":{\"last\":%.3f,\"max\":%.3f},\"verified\":%s},\n",
+        cfg.persistSaves, percentileMs(syncMs, 0.5), percentileMs(syncMs, 0.99), percentileMs(syncMs, 1.0), percentileMs(queuedMs, 0.5),
+        percentileMs(queuedMs, 0.99), percentileMs(queuedMs, 1.0), (unsigned long long)st.written, (unsigned long long)st.coalesced,
+        (unsigned long long)st.failed, st.writeMs, st.maxWriteMs, verified ? "true" : "false");
+}
+
+// VmRSS and VmHWM in KB, zero where /proc is not there
+void readRss(long& rssKb, long& peakKb) {
+    rssKb = peakKb = 0;
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, "VmRSS: %ld", &rssKb);
+        sscanf(line, "VmHWM: %ld", &peakKb);
+    }
+    fclose(f);
+}
+
+// loads every asset the way init does and plays one frame. Without a window nothing is uploaded, so the numbers are
+// the decode side of startup; the deferred sounds are decoded afterwards to time them too. Run once with --pack and
+// once without to compare the two paths, RSS is sampled around the load in each
+void runStartup(const BenchConfig& cfg) {
+    auto ga = std::make_unique<GameAssets>();
+    auto gs = std::make_unique<GameState>();
+    long rss0, peak0, rss1, peak1;
+    readRss(rss0, peak0);
+    loadAssets(*ga, *gs, cfg.pack);
+    initHeadless(*gs, cfg.seed);
+    stepHeadless(*gs, BENCH_DT);
+    drawBoard(*gs);
+    auto& l = assetLoader();
+    ga->load.firstFrameMs = assetClockMs(l);
+    waitAssets(l, ASSETS_EAGER, -1);
+    for (int i = 0; i < ASSET_COUNT; ++i)
+        queueAsset(l, i);
+    waitAssets(l, (1u << ASSET_COUNT) - 1, -1);
+    readRss(rss1, peak1);
+    auto& load = ga->load;
+    printf("  \"startup\":{\"packed\":%s,\"mapped\":%s,\"threads\":%zu,\"init_ms\":%.3f,\"first_frame_ms\":%.3f,\"all_eager_ms\":%.3f,"
+        "\"rss_kb\":{\"before\":%ld,\"after\":%ld,\"peak\":%ld},\"assets\":[\n",
+        load.packed ? "true" : "false", l.pack.mapped() ? "true" : "false", assetPool().size(), load.initMs, load.firstFrameMs, load.allEagerMs,
+        rss0, rss1, peak1);
+    for (int i = 0; i < ASSET_COUNT; ++i) {
+        auto& t = load.assets[i];
+        printf("    {\"name\":\"%s\",\"bytes\":%u,\"deferred\":%s,\"decode_start_ms\":%.3f,\"decode_ms\":%.3f,\"upload_ms\":%.3f,\"ready_ms\":%.3f}%s\n",
+            ASSET_SOURCES[i].name, ASSET_SOURCES[i].len, ASSET_SOURCES[i].deferred ? "true" : "false", t.decodeStart, t.decodeMs, t.uploadMs, t.ready,
+            (i + 1 < ASSET_COUNT) ? "," : "");
+    }
+    printf("  ]},\n");
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            cfg.seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+            cfg.iterations = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+            cfg.filter = argv[++i];
+        else if (!strcmp(argv[i], "--soak") && i + 1 < argc)
+            cfg.soakFrames = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+            cfg.record = argv[++i];
+        else if (!strcmp(argv[i], "--startup"))
+            cfg.startup = true;
+        else if (!strcmp(argv[i], "--pack") && i + 1 < argc)
+            cfg.pack = argv[++i];
+        else if (!strcmp(argv[i], "--pipeline") && i + 1 < argc)
+            cfg.pipelineFrames = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--persist") && i + 1 < argc)
+            cfg.persistSaves = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--check"))
+            cfg.check = true;
+        else {
+            fprintf(stderr, "usage: %s [--seed N] [--iterations N] [--filter NAME] [--soak FRAMES] [--record REPLAY] [--startup [--pack FILE]] [--pipeline FRAMES] [--persist SAVES] [--check]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // the self-checks replace the benchmarks and report through the exit code
+    if (cfg.check) {
+        bool ok = checkReload(cfg);
+        shutdownGame();
+        return ok ? 0 : 1;
+    }
+
+    std::vector<BenchResult> results;
+    runBenchmarks(cfg, results);
+
+    printf("{\n  \"version\":\"%s\",\"seed\":%u,\"perf_counters\":%s,\n", HEX_VERSION, cfg.seed, perfOpen() ? "true" : "false");
+    if (cfg.soakFrames > 0)
+        runSoak(cfg);
+    if (cfg.startup)
+        runStartup(cfg);
+    if (cfg.pipelineFrames > 0)
+        runPipelined(cfg);
+    if (cfg.persistSaves > 0)
+        runPersist(cfg);
+    shutdownGame();
+    printf("  \"benchmarks\":[\n");
+    for (size_t i = 0; i < results.size(); ++i)
+        writeResult(results[i], i + 1 == results.size());
+    printf("  ]\n}\n");
+    return 0;
+}
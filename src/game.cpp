@@ -1,41 +1,370 @@
 #include "game.h"
 #include "raylib.h"
 #include "rlgl.h"
+#ifdef PLATFORM_ANDROID
+#include <android_native_app_glue.h>
+extern "C" struct android_app* GetAndroidApp(void);
+#endif
 
+#ifdef HEX_ALLOC_TRACKER
+#define HEX_ALLOC_TRACKER_IMPL
+#include "util/alloc_tracker.h"
+#endif
+#include "util/asset_pack.h"
+#include "util/layout.h"
+#include "util/ogg_stream.h"
+#include "util/perf_counters.h"
+#include "util/profiler.h"
+#include "util/rand.h"
+#include "util/save_file.h"
+#include "util/shelf_atlas.h"
+#include "util/spsc_ring.h"
+#include "util/thread_pool.h"
+#include "util/triple_buffer.h"
 #include "util/vec_ops.h"
 #include "raymath.h"
 #include <cmath>
 #include <cstdint>
 #include <limits>
 #include <algorithm>
-#include <map>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <ctime>
 #include <string>
 #include <vector>
 
 #include "resources.h"
 
-#if (defined(_WIN32) || defined(_WIN64)) && defined(GAME_BASE_DLL)
+#if (defined(_WIN32) || defined(_WIN64)) && (defined(GAME_BASE_DLL) || defined(HEX_RELOAD_MODULE))
 #define DLL_EXPORT __declspec(dllexport)
 #else
 #define DLL_EXPORT
 #endif
 
+// the board algorithms are templates over the board so their loops run to compile-time bounds and the classic
+// Board and the large stress layouts share one implementation. Whatever changes tiles bumps `version`, the
+// GameState wrappers further down pass gs.tmp.boardVersion
+
+template <typename B>
+int rowCells(const B& b, int row) {
+    return B::width - ((row + b.even) % 2);
+}
+
+template <typename B>
+bool inBoard(const B& b, const ThingPos& pos) {
+    return pos.row >= 0 && pos.row < B::height && pos.col >= 0 && pos.col < rowCells(b, pos.row);
+}
+
 bool checkBounds(const GameState& gs, const ThingPos& pos) {
-    return (pos.row >= 0 && pos.row < BOARD_HEIGHT && pos.col >= 0 && pos.col < (((pos.row + gs.board.even) % 2) ? (BOARD_WIDTH - 1) : (BOARD_WIDTH)));
+    return inBoard(gs.board, pos);
 }
 
 Tile& getTile(GameState& gs, const ThingPos& pos) {
     return gs.board.things[pos.row][pos.col];
 }
 
-std::vector<ThingPos> getNeighs(GameState& gs, const ThingPos& pos) {
-    std::vector<ThingPos> res;
-    for (int i = 0; i < 6; ++i)
-        if (checkBounds(gs, TOGO[i]))
-            res.push_back(TOGO[i]);
+float& getShake(GameState& gs, const ThingPos& pos) {
+    return gs.board.shakes[pos.row][pos.col];
+}
+
+BombTimer* findBombTimer(GameState& gs, const ThingPos& pos) {
+    auto& timers = gs.board.bombTimers;
+    for (int i = 0; i < timers.count(); ++i)
+        if (timers.at(i).pos.row == pos.row && timers.at(i).pos.col == pos.col)
+            return &timers.at(i);
+    return nullptr;
+}
+
+template <typename B>
+void clearBombTimer(B& b, const ThingPos& pos) {
+    auto& timers = b.bombTimers;
+    for (int i = 0; i < timers.count(); ++i) {
+        if (timers.at(i).pos.row == pos.row && timers.at(i).pos.col == pos.col) {
+            timers.release(i);
+            return;
+        }
+    }
+}
+
+struct Neighs {
+    std::array<ThingPos, 6> pos;
+    int n = 0;
+    const ThingPos* begin() const { return pos.data(); }
+    const ThingPos* end() const { return pos.data() + n; }
+};
+
+template <typename B>
+using VisitedT = std::array<std::array<bool, B::width>, B::height>;
+using Visited = VisitedT<Board>;
+
+// right, left, up, down and the two diagonals on the side the row is shifted to
+template <typename B>
+Neighs boardNeighs(const B& b, const ThingPos& pos) {
+    int side = ((pos.row + b.even) % 2) ? (pos.col + 1) : (pos.col - 1);
+    std::array<ThingPos, 6> togo = {{{pos.row, pos.col + 1}, {pos.row, pos.col - 1}, {pos.row - 1, pos.col}, {pos.row + 1, pos.col}, {pos.row - 1, side}, {pos.row + 1, side}}};
+    Neighs res;
+    for (auto& n : togo)
+        if (inBoard(b, n))
+            res.pos[res.n++] = n;
     return res;
 }
 
+Neighs getNeighs(GameState& gs, const ThingPos& pos) {
+    return boardNeighs(gs.board, pos);
+}
+
+bool checkMatch(const Thing& th1, const Thing& th2, int param) {
+    if (th1.bomb || th2.bomb)
+        return false;
+    switch (param) {
+        case 0: return th1.clr == th2.clr;
+        case 1: return th1.shp == th2.shp;
+        case 2: return th1.sym == th2.sym;
+    }
+    return false;
+}
+
+// calls fn(pos, tile) for every tile that exists, row by row
+template <typename B, typename Fn>
+void forEachTile(const B& b, Fn&& fn) {
+    for (int i = 0; i < B::height; ++i)
+        for (int j = 0; j < rowCells(b, i); ++j)
+            if (b.things[i][j].exists)
+                fn(ThingPos{i, j}, b.things[i][j]);
+}
+
+template <typename B>
+int countEmptyBottomRows(const B& b) {
+    int n = 0;
+    for (int row = B::height - 1; row >= 0; --row, ++n)
+        for (int col = 0; col < rowCells(b, row); ++col)
+            if (b.things[row][col].exists)
+                return n;
+    return n;
+}
+
+template <typename B>
+bool isFullRow(const B& b, int row) {
+    for (int col = 0; col < rowCells(b, row); ++col)
+        if (!b.things[row][col].exists)
+            return false;
+    return true;
+}
+
+template <typename B>
+void placeTile(B& b, const ThingPos& pos, const Tile& tile, uint32_t& version, bool updateFullRows = true, bool makeExist = false) {
+    version++;
+    auto& th = b.things[pos.row][pos.col];
+    th = tile;
+    if (makeExist) th.exists = true;
+    else b.shakes[pos.row][pos.col] = 0.0f;
+
+    // the walk up the full rows stops where it reaches nFulRowsTop, going further cannot change the outcome and
+    // would make filling a tall board quadratic in its height
+    if (updateFullRows) {
+        for (int i = 1; pos.row - i + 1 > 0 && isFullRow(b, pos.row - i + 1); ++i) {
+            if (pos.row - i <= b.nFulRowsTop) {
+                b.nFulRowsTop = pos.row + 1;
+                break;
+            }
+        }
+    }
+}
+
+template <typename B>
+void clearTile(B& b, const ThingPos& pos, uint32_t& version) {
+    version++;
+    b.things[pos.row][pos.col].exists = false;
+    if (b.things[pos.row][pos.col].thing.bomb == BOMB_TRIGGERED)
+        clearBombTimer(b, pos);
+    if (pos.row < b.nFulRowsTop)
+        b.nFulRowsTop = pos.row + 1;
+}
+
+// rand(min, max) is drawn for colour, shape, symbol and the bomb roll in turn
+template <typename Rand>
+Thing randomThing(Rand&& rand, float bombProb) {
+    int last = int(COLORS.size()) - 1;
+    Thing thing = {(unsigned char)rand(0, last), (unsigned char)rand(0, last), (unsigned char)rand(0, last)};
+    thing.bomb = (rand(0, 100000) < 100000 * bombProb) ? BOMB_ARMED : BOMB_NONE;
+    return thing;
+}
+
+// the top n rows, row by row from the top, with make(row, col) for each tile
+template <typename B, typename Make>
+void fillRows(B& b, int n, Make&& make, uint32_t& version) {
+    for (int row = 0; row < n; ++row)
+        for (int col = 0; col < rowCells(b, row); ++col)
+            placeTile(b, {row, col}, Tile{(col != (B::width - 1)) || ((row + b.even) % 2 == 0), make(row, col)}, version);
+}
+
+// moves every row down by off (up when negative), clearing the rows that open up
+template <typename B>
+void shiftRows(B& b, int off, uint32_t& version) {
+    auto& timers = b.bombTimers;
+    for (int i = (int)timers.count() - 1; i >= 0; --i) {
+        timers.at(i).pos.row += off;
+        if (timers.at(i).pos.row < 0 || timers.at(i).pos.row >= B::height)
+            timers.release(i);
+    }
+    if (off % 2 != 0)
+        b.even = !b.even;
+    if (off < 0) {
+        for (int row = 0; row < B::height - 1; ++row) {
+            for (int col = 0; col < rowCells(b, row); ++col) {
+                if (row > B::height + off - 1) {
+                    clearTile(b, {row, col}, version);
+                } else {
+                    placeTile(b, {row, col}, b.things[row - off][col], version);
+                    b.shakes[row][col] = b.shakes[row - off][col];
+                }
+            }
+        }
+    } else {
+        for (int row = B::height - 1; row >= 0; --row) {
+            for (int col = 0; col < rowCells(b, row); ++col) {
+                if (row < off) {
+                    clearTile(b, {row, col}, version);
+                } else {
+                    placeTile(b, {row, col}, b.things[row - off][col], version);
+                    b.shakes[row][col] = b.shakes[row - off][col];
+                }
+            }
+        }
+    }
+}
+
+template <typename B>
+void matchRecur(const B& b, const ThingPos& pos, const Thing& thing, int param, Arena<B::cells, ThingPos>& todrop, VisitedT<B>& visited, bool first = true)
+{
+    if (!inBoard(b, pos) || visited[pos.row][pos.col])
+        return;
+    visited[pos.row][pos.col] = true;
+    const auto& tile = b.things[pos.row][pos.col];
+    bool match = checkMatch(tile.thing, thing, param);
+    if ((tile.exists && match) || first) {
+        if (tile.exists && match) todrop.acquire(pos);
+        for (auto& n : boardNeighs(b, pos))
+            if (b.things[n.row][n.col].exists) matchRecur(b, n, thing, param, todrop, visited, false);
+    }
+}
+
+template <typename B>
+bool connectedRecur(const B& b, const ThingPos& pos, VisitedT<B>& visited)
+{
+    if (!inBoard(b, pos) || visited[pos.row][pos.col])
+        return false;
+    visited[pos.row][pos.col] = true;
+    if (!b.things[pos.row][pos.col].exists)
+        return false;
+    bool connected = (pos.row == b.nFulRowsTop - 1);
+    for (auto& n : boardNeighs(b, pos))
+        if (b.things[n.row][n.col].exists && !connected) connected |= connectedRecur(b, n, visited);
+    return connected;
+}
+
+// the tiles hanging together with pos that have lost their way to the top row. visCon is scratch for the
+// connectivity walks, passed in so that it is not one more board-sized array in every recursion frame
+template <typename B>
+void unconnectedRecur(const B& b, const ThingPos& pos, VisitedT<B>& visited, VisitedT<B>& visCon, Arena<B::cells, ThingPos>& uncon, bool check = true)
+{
+    if (!inBoard(b, pos) || visited[pos.row][pos.col])
+        return;
+    visited[pos.row][pos.col] = true;
+    if (check)
+        visCon = {};
+    if (!check || !connectedRecur(b, pos, visCon)) {
+        if (b.things[pos.row][pos.col].exists) {
+            uncon.acquire(pos);
+            for (auto& n : boardNeighs(b, pos))
+                if (b.things[n.row][n.col].exists) unconnectedRecur(b, n, visited, visCon, uncon, false);
+        }
+    }
+}
+
+template <typename B>
+void shakeRecur(B& b, const ThingPos& pos, VisitedT<B>& visited, const Thing& thing, int param, float shake, int depth, int curdepth = 0, bool mtchstreak = true)
+{
+    if (visited[pos.row][pos.col] || curdepth >= depth)
+        return;
+    visited[pos.row][pos.col] = true;
+    auto& tile = b.things[pos.row][pos.col];
+    auto neighs = boardNeighs(b, pos);
+    if (tile.exists && curdepth == 0) b.shakes[pos.row][pos.col] = std::max(b.shakes[pos.row][pos.col], shake / (curdepth + 1));
+    if (tile.exists || curdepth == 0) {
+        for (auto& n : neighs) {
+            bool samecolor = (mtchstreak && checkMatch(b.things[n.row][n.col].thing, thing, param));
+            if (b.things[n.row][n.col].exists)
+                b.shakes[n.row][n.col] = std::max(b.shakes[n.row][n.col], samecolor ? shake : (shake / (curdepth + 2)));
+        }
+        if (mtchstreak) {
+            for (auto& n : neighs) {
+                auto& nt = b.things[n.row][n.col];
+                if (nt.exists && checkMatch(nt.thing, thing, param))
+                    shakeRecur(b, n, visited, thing, param, shake, depth, curdepth, true);
+            }
+        }
+        if (!mtchstreak || curdepth == 0) {
+            for (auto& n : neighs) {
+                auto& nt = b.things[n.row][n.col];
+                if (nt.exists && !checkMatch(nt.thing, thing, param))
+                    shakeRecur(b, n, visited, thing, param, shake, depth, curdepth + 1, false);
+            }
+        }
+    }
+}
+
+// for each of the first nParams match rules the group that a thing at pos would clear and the tiles that would
+// fall with it, the best rule's result goes to b.todrop and b.uncon and its neighbourhood starts shaking
+template <typename B>
+void dropAt(B& b, const ThingPos& pos, const Thing& thing, int nParams, int minToDrop, uint32_t& version) {
+    int bestK = 0, bestScore = 0;
+    Arena<B::cells, ThingPos> todrops[3];
+    Arena<B::cells, ThingPos> uncons[3];
+    VisitedT<B> visCon;
+    auto exists = b.things[pos.row][pos.col].exists;
+    int lim = (exists ? minToDrop : (minToDrop - 1));
+    for (int k = 0; k < nParams; ++k) {
+        VisitedT<B> vis = {};
+        {
+            PERF_PHASE(PERF_MATCH);
+            matchRecur(b, pos, thing, k, todrops[k], vis);
+        }
+        int count = todrops[k].count();
+        if (count >= lim) {
+            for (int i = 0; i < todrops[k].count(); ++i)
+                clearTile(b, todrops[k].at(i), version);
+            {
+                PERF_PHASE(PERF_FLOATING);
+                VisitedT<B> vis2 = {};
+                for (int i = 0; i < todrops[k].count(); ++i) {
+                    for (auto& n : boardNeighs(b, todrops[k].at(i))) {
+                        if (b.things[n.row][n.col].exists)
+                            unconnectedRecur(b, n, vis2, visCon, uncons[k]);
+                    }
+                }
+            }
+            for (int i = 0; i < todrops[k].count(); ++i) {
+                auto& td = todrops[k].at(i);
+                placeTile(b, td, b.things[td.row][td.col], version, true, true);
+            }
+            if (!exists) todrops[k].acquire(pos);
+        }
+        int score = todrops[k].count() + uncons[k].count();
+        if (bestScore < score) {
+            bestScore = score;
+            bestK = k;
+        }
+    }
+    VisitedT<B> vis2 = {};
+    shakeRecur(b, pos, vis2, thing, bestK, SHAKE_TIME, SHAKE_DEPTH);
+    b.todrop = todrops[bestK];
+    b.uncon = uncons[bestK];
+}
+
 std::string replace(std::string& str, const std::string& from, const std::string& to) {
     size_t start_pos = str.find(from);
     str.replace(start_pos, from.length(), to);
@@ -49,22 +378,45 @@ std::string prepShader(unsigned char* shaderBytes) {
 
 extern "C" {
 
+// every draw reseeds, the state only carries the seed forward
 int getRandVal(GameState& gs, int min, int max) {
-    SetRandomSeed(gs.seed++);
-    return GetRandomValue(min, max);
+    RandState r = randSeed(gs.seed++);
+    return randValue(r, min, max);
 }
 
+// the simulation clock is sampled once per frame, by updateAndDraw or by stepHeadless,
+// so a frame only depends on the state, its inputs and the sampled time
 double getTime(const GameState& gs) {
+    return gs.time;
+}
+
+// the latency probe measures stages inside a frame and reads the clock directly
+double getWallTime(const GameState& gs) {
+#ifdef HEX_HEADLESS
+    return gs.time;
+#else
     return (GetTime() + gs.tmp.timeOffset);// * 0.5f;
+#endif
 }
 
+// set once per frame from raylib, or per step on the simulation thread and in headless runs
 float getFrameTime(const GameState& gs) {
-    return GetFrameTime();// * 0.5f;
+    return gs.tmp.frameTime;
 }
 
-void playSound(const GameState& gs, const Sound& snd) {
-    if (gs.usr.sndEnabled)
-        PlaySound(snd);
+// queued for flushSounds at the end of the frame. variants picks one of that many samples starting at id, interval
+// keeps the sound from starting again sooner than that after its last start
+void playSound(const GameState& gs, int id, int variants = 1, float volume = 1.0f, float interval = 0.0f) {
+    if (!gs.usr.sndEnabled)
+        return;
+    auto& mix = gs.tmp.audio;
+    auto& req = mix.pending[id - ASSET_CLANG0];
+    mix.stats.requested++;
+    mix.stats.coalesced += (req.count > 0);
+    req.count++;
+    req.variants = (uint8_t)std::max<int>(req.variants, variants);
+    req.volume = std::max(req.volume, volume);
+    req.interval = std::max(req.interval, interval);
 }
 
 float easeOutBounce(float x)
@@ -91,67 +443,86 @@ float easeInQuad(float t) {
     return t * t;
 }
 
+// the board scroll is fixed point rows, these convert it to pixels and back
+float scrollPixels(int64_t scroll) {
+    return float(double(scroll) * ROW_HEIGHT / double(int64_t(1) << SCROLL_FRAC_BITS));
+}
+
+int64_t pixelsScroll(double px) {
+    return llround(px / ROW_HEIGHT * double(int64_t(1) << SCROLL_FRAC_BITS));
+}
+
+// top of the board before the scroll offset is added
+float getBoardBaseY(const GameState& gs) {
+    float bHeight = ROW_HEIGHT * BOARD_HEIGHT;
+    float startCoeff = easeOutQuad(std::clamp((getTime(gs) - gs.gameStartTime)/GAME_START_TIME, 0.0, 1.0));
+    return (float)SCREEN_HEIGHT - 2 * bHeight + bHeight * startCoeff;
+}
+
 Rectangle getBoardRect(const GameState& gs) {
     float bWidth = TILE_RADIUS * 2 * BOARD_WIDTH;
     float bHeight = ROW_HEIGHT * BOARD_HEIGHT;
-    float startCoeff = easeOutQuad(std::clamp((getTime(gs) - gs.gameStartTime)/GAME_START_TIME, 0.0, 1.0));
-    Vector2 bPos = {(GetScreenWidth() - bWidth) * 0.5f, (float)GetScreenHeight() - 2 * bHeight + bHeight * startCoeff + gs.board.pos};
+    Vector2 bPos = {(SCREEN_WIDTH - bWidth) * 0.5f, getBoardBaseY(gs) + scrollPixels(gs.board.scroll)};
     return {float(int(bPos.x)), float(int(bPos.y)), bWidth, bHeight};
 }
 
-ThingPos getPosByPix(const GameState& gs, const Vector2& pix) {
-    auto brec = getBoardRect(gs);
-    int row = std::clamp((int)floor((pix.y - brec.y) / ROW_HEIGHT), 0, BOARD_HEIGHT - 1);
-    bool shortRow = ((row + gs.board.even) % 2);
-    int col = std::clamp((int)floor((pix.x - brec.x - float(shortRow) * TILE_RADIUS) / (TILE_RADIUS * 2)), 0, shortRow ? (BOARD_WIDTH - 2) : (BOARD_WIDTH - 1));
+// eases the board back in after new rows were added, then scrolls it down at its accelerating speed
+void moveBoard(const GameState& gs, int64_t& scroll, float& speed, double& moveTime, double totalMoveTime, bool scrolling, float dt) {
+    if (moveTime > 0 && scroll < 0) {
+        scroll = llround(double(scroll) * (1.0f - easeOutQuad(1.0f - moveTime/totalMoveTime)));
+        moveTime -= dt;
+    }
+    if (scrolling) {
+        if (gs.usr.velEnabled)
+            scroll += pixelsScroll(TILE_PIXEL * (gs.usr.accEnabled ? speed : BOARD_CONST_SPEED) * dt);
+        if (gs.usr.accEnabled)
+            speed += gs.tuning.boardAcc * dt;
+    }
+}
+
+BoardGeom getBoardGeom(const GameState& gs) {
+    return {getBoardRect(gs), TILE_RADIUS, ROW_HEIGHT, gs.board.even};
+}
+
+ThingPos geomPosByPix(const BoardGeom& geom, const Vector2& pix) {
+    int row = std::clamp((int)floor((pix.y - geom.rect.y) / geom.rowHeight), 0, BOARD_HEIGHT - 1);
+    bool shortRow = ((row + geom.even) % 2);
+    int col = std::clamp((int)floor((pix.x - geom.rect.x - float(shortRow) * geom.radius) / (geom.radius * 2)), 0, shortRow ? (BOARD_WIDTH - 2) : (BOARD_WIDTH - 1));
     return {row, col};
 }
 
+bool sameGeom(const BoardGeom& a, const BoardGeom& b) {
+    return !memcmp(&a.rect, &b.rect, sizeof(Rectangle)) && a.radius == b.radius && a.rowHeight == b.rowHeight && a.even == b.even;
+}
+
+// the same board anywhere up or down the screen
+bool sameShape(const BoardGeom& a, const BoardGeom& b) {
+    return a.rect.x == b.rect.x && a.rect.width == b.rect.width && a.radius == b.radius && a.rowHeight == b.rowHeight && a.even == b.even;
+}
+
+Vector2 geomPixByPos(const BoardGeom& geom, const ThingPos& pos) {
+    float offset = float((pos.row + geom.even) % 2) * geom.radius;
+    return {float(int(offset + geom.rect.x + geom.radius + pos.col * geom.radius * 2)), (float)int(geom.rect.y + (pos.row + 0.5f) * geom.rowHeight)};
+}
+
+ThingPos getPosByPix(const GameState& gs, const Vector2& pix) {
+    return geomPosByPix(getBoardGeom(gs), pix);
+}
+
 Vector2 getPixByPos(const GameState& gs, const ThingPos& pos) {
-    auto brec = getBoardRect(gs);
-    float offset = float((pos.row + gs.board.even) % 2) * TILE_RADIUS;
-    return {float(int(offset + brec.x + TILE_RADIUS + pos.col * TILE_RADIUS * 2)), (float)int(brec.y + (pos.row + 0.5f) * ROW_HEIGHT)};
+    return geomPixByPos(getBoardGeom(gs), pos);
 }
 
 int countBotEmpRows(const GameState& gs) {
-    int n = 0;
-    bool keep = true;
-    for (int row = BOARD_HEIGHT - 1; row >= 0; --row) {
-        for (int col = 0; col < BOARD_WIDTH - ((row + gs.board.even) % 2); ++col) {
-            if (gs.board.things[row][col].exists) {
-                keep = false;
-                break;
-            }
-        }
-        if (!keep) break;
-        n++;
-    }
-    return n;
+    return countEmptyBottomRows(gs.board);
 }
 
 bool checkFullRow(const GameState& gs, int row) {
-    bool fullrow = true;
-    for (int i = 0; i < BOARD_WIDTH - ((row + gs.board.even) % 2); ++i) {
-        if (!gs.board.things[row][i].exists) {
-            fullrow = false;
-            break;
-        }
-    }
-    return fullrow;
+    return isFullRow(gs.board, row);
 }
 
 void addTile(GameState& gs, const ThingPos& pos, const Tile& tile, bool updateFullRows = true, bool makeExist = false) {
-    auto& th = gs.board.things[pos.row][pos.col];
-    th = tile;
-    if (makeExist) th.exists = true;
-    th.pos = pos;
-
-    if (updateFullRows) {
-        int i = 0;
-        while ((pos.row - i > 0) && checkFullRow(gs, pos.row - i)) i++;
-        if (i > 0 && pos.row - i <= gs.board.nFulRowsTop)
-            gs.board.nFulRowsTop = pos.row + 1;
-    }
+    placeTile(gs.board, pos, tile, gs.tmp.boardVersion, updateFullRows, makeExist);
 }
 
 void addShatteredParticles(GameState& gs, const Thing& thing, Vector2 pos) {
@@ -167,14 +538,19 @@ void addShatteredParticles(GameState& gs, const Thing& thing, Vector2 pos) {
     }
 }
 
+// tuned combos can go past the palette, the highest colour repeats
+Color comboColor(int combo) {
+    return COMBO_COLORS[std::clamp(combo, 1, (int)COMBO_COLORS.size()) - 1];
+}
+
 void addAnimation(GameState& gs, const Texture2D* tex, float interval, Vector2 pos, Color col = WHITE){
     gs.tmp.animations.acquire(Animation{tex, getTime(gs), interval, pos, col});
 }
 
 void addScorePoints(GameState& gs, Vector2 pos, Color col, int n) {
     for (int i = 0; i < n; ++i) {
-        Vector2 endPos = {TILE_RADIUS * 2.0f + (GetScreenWidth() - TILE_RADIUS * 6.0f) * 0.25f, GetScreenHeight() - TILE_RADIUS};
-        Vector2 cpPos = {GetScreenWidth() * 0.5f + RAND_FLOAT_SIGNED * GetScreenWidth() * 0.33f, 0.5f * (endPos.y + pos.y) };
+        Vector2 endPos = {TILE_RADIUS * 2.0f + (SCREEN_WIDTH - TILE_RADIUS * 6.0f) * 0.25f, SCREEN_HEIGHT - TILE_RADIUS};
+        Vector2 cpPos = {SCREEN_WIDTH * 0.5f + RAND_FLOAT_SIGNED * SCREEN_WIDTH * 0.33f, 0.5f * (endPos.y + pos.y) };
         gs.tmp.scorePoints.acquire(ScorePoint{pos + TILE_RADIUS * RAND_FLOAT_SIGNED_2D, cpPos, endPos, getTime(gs), SCORE_FLY_TIME + RAND_FLOAT * SCORE_FLY_SPREAD, col});
     }
     gs.score += n;
@@ -184,47 +560,53 @@ void addParticle(GameState& gs, const Thing& thing, Vector2 pos, Vector2 vel) {
     gs.tmp.particles.acquire(Particle{true, thing, pos, vel});
 }
 
-void generateRows(GameState& gs, int n) {
-    for (int row = 0; row < n; ++row) {
-        for (int col = 0; col < BOARD_WIDTH - ((row + gs.board.even) % 2); ++col) {
-            addTile(gs, {row, col}, Tile{(col != (BOARD_WIDTH - 1)) || ((row + gs.board.even) % 2 == 0), {row, col}, {(unsigned char)getRandVal(gs, 0, COLORS.size() - 1), (unsigned char)getRandVal(gs, 0, COLORS.size() - 1), (unsigned char)getRandVal(gs, 0, COLORS.size() - 1)}});
-            auto& thing = gs.board.things[row][col].thing;
-            thing.bomb = (getRandVal(gs, 0, 100000) < 100000 * BOMB_PROB);
-            thing.triggered = false;
+// the stream chunk with the given index, made in the least recently used slot when it is not cached
+const RowChunk& streamChunk(GameState& gs, int64_t index) {
+    auto& st = gs.tmp.stream;
+    RowChunk* slot = &st.chunks[0];
+    for (auto& c : st.chunks) {
+        if (c.index == index && c.seed == gs.streamSeed && c.bombProb == gs.tuning.bombProb) {
+            c.lastUsed = ++st.uses;
+            return c;
         }
+        if (slot->index >= 0 && (c.index < 0 || c.lastUsed < slot->lastUsed))
+            slot = &c;
     }
+    RandState r = randSeed((uint64_t(gs.streamSeed) << 32) ^ uint64_t(index));
+    slot->index = index;
+    slot->seed = gs.streamSeed;
+    slot->bombProb = gs.tuning.bombProb;
+    slot->lastUsed = ++st.uses;
+    for (auto& row : slot->rows)
+        for (auto& thing : row)
+            thing = randomThing([&](int min, int max) { return randValue(r, min, max); }, gs.tuning.bombProb);
+    st.generated++;
+    return *slot;
+}
+
+// the lowest new row is the next one in the stream and the top row the last, so the rows above the board keep
+// their order whichever way the board is refilled. Chunks that are all on the board are released and the one the
+// next rows come from is made ahead of time
+void generateRows(GameState& gs, int n) {
+    int64_t top = gs.streamRow + n - 1;
+    fillRows(gs.board, n, [&](int row, int col) {
+        int64_t s = top - row;
+        return streamChunk(gs, s / STREAM_CHUNK_ROWS).rows[s % STREAM_CHUNK_ROWS][col];
+    }, gs.tmp.boardVersion);
+    gs.streamRow += n;
+    int64_t next = gs.streamRow / STREAM_CHUNK_ROWS;
+    for (auto& c : gs.tmp.stream.chunks)
+        if (c.index < next)
+            c.index = -1;
+    streamChunk(gs, next);
 }
 
 void removeTile(GameState& gs, const ThingPos& pos) {
-    gs.board.things[pos.row][pos.col].exists = false;
-    gs.board.things[pos.row][pos.col].pos = pos;
-    if (pos.row < gs.board.nFulRowsTop)
-        gs.board.nFulRowsTop = pos.row + 1;
+    clearTile(gs.board, pos, gs.tmp.boardVersion);
 }
 
 void shiftBoard(GameState& gs, int off) {
-    if (off % 2 != 0)
-        gs.board.even = !gs.board.even;
-    if (off < 0) {
-        for (int row = 0; row < BOARD_HEIGHT - 1; ++row) {
-            for (int col = 0; col < BOARD_WIDTH - ((row + gs.board.even) % 2); ++col) {
-                if (row > BOARD_HEIGHT + off - 1)
-                    removeTile(gs, {row, col});
-                else
-                    addTile(gs, {row, col}, gs.board.things[row - off][col]);
-
-            }
-        }
-    } else {
-        for (int row = BOARD_HEIGHT - 1; row >= 0; --row) {
-            for (int col = 0; col < BOARD_WIDTH - ((row + gs.board.even) % 2); ++col) {
-                if (row < off)
-                    removeTile(gs, {row, col});
-                else
-                    addTile(gs, {row, col}, gs.board.things[row - off][col]);
-            }
-        }
-    }
+    shiftRows(gs.board, off, gs.tmp.boardVersion);
 }
 
 void setNext(GameState& gs) {
@@ -253,217 +635,1281 @@ void swapExtra(GameState& gs) {
         gs.gun.extraArmed = true;
         rearm(gs);
     }
-    playSound(gs, gs.ga.p->whoosh[1]);
+    playSound(gs, ASSET_WHOOSH1);
     gs.swapTime = getTime(gs);
 }
 
-void loadAssets(GameAssets& ga, GameState& gs) {
-    ga.tiles = LoadTextureFromImage(LoadImageFromMemory(".png", res_tiles_png, res_tiles_png_len));
-    ga.explosion = LoadTextureFromImage(LoadImageFromMemory(".png", res_explosion_png, res_explosion_png_len));
-    ga.splash = LoadTextureFromImage(LoadImageFromMemory(".png", res_splash_png, res_splash_png_len));
-
-    ga.music = LoadMusicStreamFromMemory(".ogg", res_music_ogg, res_music_ogg_len);
-
-    ga.clang[0] = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_clang0_ogg, res_clang0_ogg_len));
-    ga.clang[1] = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_clang1_ogg, res_clang1_ogg_len));
-    ga.clang[2] = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_clang2_ogg, res_clang2_ogg_len));
-    ga.pop[0] = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_pop0_ogg, res_pop0_ogg_len));
-    ga.pop[1] = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_pop1_ogg, res_pop1_ogg_len));
-    ga.pop[2] = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_pop2_ogg, res_pop2_ogg_len));
-    ga.sndexp = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_sndexp_ogg, res_sndexp_ogg_len));
-    ga.shatter[0] = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_shatter0_ogg, res_shatter0_ogg_len));
-    ga.shatter[1] = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_shatter1_ogg, res_shatter1_ogg_len));
-    ga.whoosh[0] = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_whoosh0_ogg, res_whoosh0_ogg_len));
-    ga.whoosh[1] = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_whoosh1_ogg, res_whoosh1_ogg_len));
-    ga.sizzle = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_sizzle_ogg, res_sizzle_ogg_len));
-    ga.fail = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_fail_ogg, res_fail_ogg_len));
-    ga.shake = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_shake_ogg, res_shake_ogg_len));
-    ga.beep = LoadSoundFromWave(LoadWaveFromMemory(".ogg", res_beep_ogg, res_beep_ogg_len));
-
-#ifdef PLATFORM_ANDROID
-    auto postProcFragShaderStr = prepShader((unsigned char*)res_post_proc_fs);
-        ga.postProcFragShader = LoadShaderFromMemory(NULL, (const char*)postProcFragShaderStr.c_str());
-        auto maskFragShaderStr = prepShader((unsigned char*)res_mask_fs);
-        ga.maskFragShader = LoadShaderFromMemory(NULL, (const char*)maskFragShaderStr.c_str());
-#else
-    ga.postProcFragShader = LoadShaderFromMemory(NULL, (const char*)res_post_proc_fs);
-    ga.maskFragShader = LoadShaderFromMemory(NULL, (const char*)res_mask_fs);
-#endif
-
-    char8_t _allChars[228] = u8" !\"#$%&\'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~абвгдеёжзийклмнопрстуфхцчшщъыьэюяАБВГДЕЁЖЗИЙКЛМНОПРСТУФХЦЧШЩЪЫЬЭЮЯ";
-    int c; auto cdpts = LoadCodepoints((const char*)_allChars, &c);
-    ga.font = LoadFontFromMemory(".ttf", res_font_otf, res_font_otf_len, 39, cdpts, c);
-
-    gs.ga.p = &ga;
+enum AssetStage : uint8_t { STAGE_IDLE, STAGE_DECODING, STAGE_DECODED, STAGE_READY };
+
+// in AssetId order, the deferred ones are only decoded when something asks for them
+struct AssetSource {
+    const char* name;
+    PackKind kind;
+    const unsigned char* data;
+    unsigned int len;
+    bool deferred;
+};
+
+const AssetSource ASSET_SOURCES[ASSET_COUNT] = {
+    {"font", PACK_FONT, res_font_otf, res_font_otf_len, false},
+    {"tiles", PACK_IMAGE, res_tiles_png, res_tiles_png_len, false},
+    {"explosion", PACK_IMAGE, res_explosion_png, res_explosion_png_len, false},
+    {"splash", PACK_IMAGE, res_splash_png, res_splash_png_len, false},
+    {"clang0", PACK_WAVE, res_clang0_ogg, res_clang0_ogg_len, false},
+    {"clang1", PACK_WAVE, res_clang1_ogg, res_clang1_ogg_len, false},
+    {"clang2", PACK_WAVE, res_clang2_ogg, res_clang2_ogg_len, false},
+    {"pop0", PACK_WAVE, res_pop0_ogg, res_pop0_ogg_len, false},
+    {"pop1", PACK_WAVE, res_pop1_ogg, res_pop1_ogg_len, false},
+    {"pop2", PACK_WAVE, res_pop2_ogg, res_pop2_ogg_len, false},
+    {"shatter0", PACK_WAVE, res_shatter0_ogg, res_shatter0_ogg_len, false},
+    {"shatter1", PACK_WAVE, res_shatter1_ogg, res_shatter1_ogg_len, false},
+    {"whoosh0", PACK_WAVE, res_whoosh0_ogg, res_whoosh0_ogg_len, false},
+    {"whoosh1", PACK_WAVE, res_whoosh1_ogg, res_whoosh1_ogg_len, false},
+    {"sizzle", PACK_WAVE, res_sizzle_ogg, res_sizzle_ogg_len, false},
+    {"beep", PACK_WAVE, res_beep_ogg, res_beep_ogg_len, false},
+    {"sndexp", PACK_WAVE, res_sndexp_ogg, res_sndexp_ogg_len, true},
+    {"fail", PACK_WAVE, res_fail_ogg, res_fail_ogg_len, true},
+    {"shake", PACK_WAVE, res_shake_ogg, res_shake_ogg_len, true},
+};
+
+// the first frame draws text and tiles, the splash and explosion sheets follow it within a few frames
+const uint32_t ASSETS_FIRST_FRAME = (1u << ASSET_FONT) | (1u << ASSET_TILES) | (1u << ASSET_EXPLOSION) | (1u << ASSET_SPLASH);
+const uint32_t ASSETS_EAGER = (1u << ASSET_SNDEXP) - 1;
+
+using AssetClock = std::chrono::steady_clock;
+
+// packed ones point into the mapped pack for their pixels and samples
+struct DecodedAsset {
+    Image image;
+    Wave wave;
+    GlyphInfo* glyphs;
+    Rectangle* recs;
+    int glyphCount;
+    bool packed;
+};
+
+// workers decode into `out` and queue the id in `decoded`, the main thread uploads from there.
+// With a pack there is nothing to decode and the main thread fills `out` itself
+struct AssetLoader {
+    GameAssets* ga = nullptr;
+    MappedFile pack;
+    const PackEntry* packed = nullptr;
+    AssetClock::time_point t0;
+    std::array<std::atomic<uint8_t>, ASSET_COUNT> stage = {};
+    std::array<DecodedAsset, ASSET_COUNT> out = {};
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<int> decoded;
+};
+
+// the module's pools start on first use and only shutdownGame() stops them, they are never destroyed with the statics
+ThreadPool& lazyPool(std::atomic<ThreadPool*>& slot, size_t threads) {
+    static std::mutex m;
+    if (auto pool = slot.load(std::memory_order_acquire))
+        return *pool;
+    std::lock_guard<std::mutex> lock(m);
+    if (!slot.load(std::memory_order_relaxed))
+        slot.store(new ThreadPool(threads), std::memory_order_release);
+    return *slot.load(std::memory_order_relaxed);
 }
 
-void saveUserData(const GameState& gs) {
-    SaveFileData("userdata", (void*)&gs.usr, sizeof(GameState::UserData));
+// finishes what was submitted and joins the workers, the next use starts a new pool
+void stopPool(std::atomic<ThreadPool*>& slot) {
+    delete slot.exchange(nullptr);
 }
 
-void loadUserData(GameState& gs) {
-    int sz = sizeof(GameState::UserData);
-    std::vector<unsigned char> buffer(sz);
-    int datasz;
-    unsigned char* ptr = LoadFileData("userdata", &datasz);
-    if (ptr && datasz == sz)
-        gs.usr = *((GameState::UserData*)ptr);
+std::atomic<ThreadPool*>& assetPoolSlot() {
+    static std::atomic<ThreadPool*> pool = nullptr;
+    return pool;
 }
 
-void setStuff(const GameAssets* ga, RenderTexture& rt, GameState& gs) {
-    gs.ga.p = ga;
-    loadUserData(gs);
-    gs.tmp.renderTex = IsRenderTextureValid(rt) ? rt : LoadRenderTexture(GetScreenWidth(), GetScreenHeight());;
-    SetTextureWrap(gs.tmp.renderTex.texture, TEXTURE_WRAP_CLAMP);
+ThreadPool& assetPool() {
+    return lazyPool(assetPoolSlot(), ASSET_THREADS);
 }
 
-DLL_EXPORT void setState(GameState& gs, const GameState& ngs)
-{
-    const GameAssets* ga = gs.ga.p;
-    auto rt = gs.tmp.renderTex;
-    gs = ngs;
-    setStuff(ga, rt, gs);
+AssetLoader& assetLoader() {
+    static AssetLoader loader;
+    return loader;
 }
 
-void reset(GameState& gs) {
-    setState(gs, {0});
-    gs.seed = rand() % std::numeric_limits<int>::max();
-    for (int i = 0; i < gs.board.things.size(); ++i)
-        std::fill(gs.board.things[i].begin(), gs.board.things[i].end(), Tile());
-    generateRows(gs, BOARD_HEIGHT - gs.board.nRowsGap);
-    rearm(gs);
-    gs.gameStartTime = getTime(gs);
+float assetClockMs(const AssetLoader& l) {
+    return std::chrono::duration<float, std::milli>(AssetClock::now() - l.t0).count();
 }
 
-DLL_EXPORT void init(GameAssets& ga, GameState& gs)
-{
-    if (!IsAudioDeviceReady()) {
-        InitAudioDevice();
-    } else if (IsMusicStreamPlaying(ga.music)) {
-        StopMusicStream(ga.music);
+// a reloaded module finds the assets already loaded and only has to learn which ones
+AssetLoader& assetsFor(const GameState& gs) {
+    auto& l = assetLoader();
+    if (!l.ga && gs.ga.p) {
+        l.ga = const_cast<GameAssets*>(gs.ga.p);
+        l.t0 = AssetClock::now();
+        for (int i = 0; i < ASSET_COUNT; ++i)
+            l.stage[i] = ((l.ga->load.ready >> i) & 1) ? STAGE_READY : STAGE_IDLE;
     }
+    return l;
+}
 
-    loadAssets(ga, gs);
-    PlayMusicStream(ga.music);
+Texture2D* assetTexture(GameAssets& ga, int id) {
+    Texture2D* slots[] = {&ga.tiles, &ga.explosion, &ga.splash};
+    return slots[id - ASSET_TILES];
+}
 
-    reset(gs);
+Sound* assetSound(GameAssets& ga, int id) {
+    Sound* slots[] = {&ga.clang[0], &ga.clang[1], &ga.clang[2], &ga.pop[0], &ga.pop[1], &ga.pop[2], &ga.shatter[0], &ga.shatter[1],
+        &ga.whoosh[0], &ga.whoosh[1], &ga.sizzle, &ga.beep, &ga.sndexp, &ga.fail, &ga.shake};
+    return slots[id - ASSET_CLANG0];
 }
 
-void shootAndRearm(GameState& gs) {
-    gs.firstShotFired = true;
-    gs.bullet.exists = true;
-    gs.bullet.rebouncing = false;
-    float dir = gs.gun.dir + PI * 0.5f;
-    gs.bullet.thing = gs.gun.armed;
-    gs.bullet.vel = BULLET_SPEED * Vector2{cos(dir), -sin(dir)};
-    gs.bullet.pos = {(float)GetScreenWidth() * 0.5f, (float)GetScreenHeight() - TILE_RADIUS};
-    playSound(gs, gs.ga.p->whoosh[0]);
-    rearm(gs);
+// a glyph's coverage as white with alpha, the way raylib's own font atlases hold it
+void blitGlyph(uint8_t* dst, int stride, int x, int y, const Image& img) {
+    auto cov = (const uint8_t*)img.data;
+    bool gray = cov && img.format == PIXELFORMAT_UNCOMPRESSED_GRAYSCALE;
+    for (int r = 0; r < img.height; ++r) {
+        auto row = dst + 2 * (size_t(y + r) * stride + x);
+        for (int c = 0; c < img.width; ++c) {
+            row[2 * c] = 255;
+            row[2 * c + 1] = gray ? cov[r * img.width + c] : 0;
+        }
+    }
 }
 
-bool checkMatch(const Thing& th1, const Thing& th2, int param) {
-    if (th1.bomb || th2.bomb)
-        return false;
-    switch (param) {
-        case 0: return th1.clr == th2.clr;
-        case 1: return th1.shp == th2.shp;
-        case 2: return th1.sym == th2.sym;
+// the top rows of a FONT_ATLAS_SIZE wide atlas, each glyph on its own padded cell in the order the shelves take them
+Image packGlyphs(const GlyphInfo* glyphs, Rectangle** recs, int count) {
+    ShelfAtlas atlas(FONT_ATLAS_SIZE, FONT_ATLAS_SIZE);
+    *recs = (Rectangle*)MemAlloc(count * sizeof(Rectangle));
+    for (int i = 0; i < count; ++i) {
+        auto& img = glyphs[i].image;
+        int x = 0, y = 0;
+        if (atlas.alloc(img.width + 2 * FONT_PADDING, img.height + 2 * FONT_PADDING, 0, &x, &y) < 0)
+            TraceLog(LOG_WARNING, "HEX: glyph %d does not fit the font atlas", glyphs[i].value);
+        (*recs)[i] = {float(x + FONT_PADDING), float(y + FONT_PADDING), (float)img.width, (float)img.height};
     }
-    return false;
+    int height = std::max(atlas.usedHeight(), 1);
+    Image out = {MemAlloc(FONT_ATLAS_SIZE * height * 2), FONT_ATLAS_SIZE, height, 1, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA};
+    for (int i = 0; i < count; ++i)
+        blitGlyph((uint8_t*)out.data, FONT_ATLAS_SIZE, int((*recs)[i].x), int((*recs)[i].y), glyphs[i].image);
+    return out;
 }
 
-void checkDropRecur(GameState& gs, const ThingPos& pos, const Thing& thing, int param, Arena<MAX_TODROP, ThingPos>& todrop, std::map<int, std::map<int, bool>>& visited, bool first = true)
-{
-    if (visited.count(pos.row) && visited[pos.row].count(pos.col))
-        return;
-    visited[pos.row][pos.col] = true;
-    if (checkBounds(gs, pos)) {
-        const auto& tile = getTile(gs, pos);
-        bool match = checkMatch(tile.thing, thing, param);
-        if ((tile.exists && match) || first) {
-            if (tile.exists && match) todrop.acquire(pos);
-            for (auto& n : getNeighs(gs, pos))
-                if (getTile(gs, n).exists) checkDropRecur(gs, n, thing, param, todrop, visited, false);
-        }
+// only CPU-side raylib calls, so this runs on the asset workers and in hex_pack. The font only brings printable
+// ASCII, everything else is rasterized when it is first drawn
+void decodeSource(int id, DecodedAsset& out) {
+    auto& src = ASSET_SOURCES[id];
+    if (src.kind == PACK_IMAGE) {
+        out.image = LoadImageFromMemory(".png", src.data, src.len);
+    } else if (src.kind == PACK_WAVE) {
+        out.wave = LoadWaveFromMemory(".ogg", src.data, src.len);
+    } else {
+        int cdpts[95];
+        for (int i = 0; i < 95; ++i)
+            cdpts[i] = 32 + i;
+        out.glyphCount = 95;
+        out.glyphs = LoadFontData(src.data, src.len, FONT_SIZE, cdpts, out.glyphCount, FONT_DEFAULT);
+        out.image = packGlyphs(out.glyphs, &out.recs, out.glyphCount);
     }
 }
 
-bool isConnectedToTopRecur(GameState& gs, const ThingPos& pos, std::map<int, std::map<int, bool>>& visited)
-{
-    if (visited.count(pos.row) && visited[pos.row].count(pos.col))
-        return false;
-    if (pos.row == 21 && pos.col == 5)
-        std::cout << "\n";
-    visited[pos.row][pos.col] = true;
-    if (checkBounds(gs, pos)) {
-        auto& tile = getTile(gs, pos);
-        if (tile.exists) {
-            bool connected = (pos.row == gs.board.nFulRowsTop - 1);
-            for (auto& n : getNeighs(gs, pos))
-                if (getTile(gs, n).exists && !connected) connected |= isConnectedToTopRecur(gs, n, visited);
-            visited[pos.row][pos.col] = connected;
-            return connected;
-        }
+// pixels and samples are used in place. The font's rects and metrics (a few KB) are copied out, so the
+// font does not point into a mapping that a reloaded module no longer owns
+void viewPacked(const AssetLoader& l, int id, DecodedAsset& out) {
+    auto& e = l.packed[id];
+    auto base = l.pack.data();
+    if (e.kind == PACK_WAVE) {
+        out.wave = {e.frameCount, e.sampleRate, e.sampleSize, e.channels, (void*)(base + e.data)};
+    } else {
+        out.image = {(void*)(base + e.data), e.width, e.height, 1, e.format};
     }
-    return false;
+    if (e.kind == PACK_FONT) {
+        out.glyphCount = e.glyphCount;
+        out.recs = (Rectangle*)MemAlloc(e.glyphCount * sizeof(Rectangle));
+        memcpy(out.recs, base + e.recs, e.glyphCount * sizeof(Rectangle));
+        out.glyphs = (GlyphInfo*)MemAlloc(e.glyphCount * sizeof(GlyphInfo));
+        auto glyphs = (const PackGlyph*)(base + e.glyphs);
+        for (int i = 0; i < e.glyphCount; ++i)
+            out.glyphs[i] = {glyphs[i].value, glyphs[i].offsetX, glyphs[i].offsetY, glyphs[i].advanceX, Image{}};
+    }
+    out.packed = true;
 }
 
-void checkUnconnectedRecur(GameState& gs, const ThingPos& pos, std::map<int, std::map<int, bool>>& visited, Arena<MAX_TODROP, ThingPos>& uncon, bool check = true)
-{
-    if (visited.count(pos.row) && visited[pos.row].count(pos.col))
-        return;
-    if (pos.row == 20 && pos.col == 6)
-        std::cout << "\n";
-    visited[pos.row][pos.col] = true;
-    std::map<int, std::map<int, bool>> visCon;
-    if (checkBounds(gs, pos) && (!check || !isConnectedToTopRecur(gs, pos, visCon))) {
-        auto& tile = getTile(gs, pos);
-        if (tile.exists) {
-            uncon.acquire(pos);
-            for (auto& n : getNeighs(gs, pos))
-                if (getTile(gs, n).exists) checkUnconnectedRecur(gs, n, visited, uncon, false);
-        }
+void decodeAsset(AssetLoader& l, int id) {
+    auto& out = l.out[id];
+    float start = assetClockMs(l);
+    if (l.packed)
+        viewPacked(l, id, out);
+    else
+        decodeSource(id, out);
+    auto& t = l.ga->load.assets[id];
+    t.decodeStart = start;
+    t.decodeMs = assetClockMs(l) - start;
+    l.stage[id] = STAGE_DECODED;
+    {
+        std::lock_guard<std::mutex> lock(l.m);
+        l.decoded.push_back(id);
     }
+    l.cv.notify_all();
 }
 
-void addShakeRecur(GameState& gs, const ThingPos& pos, std::map<int, std::map<int, bool>>& visited, const Thing& thing, int param, float shake, int depth, int curdepth = 0, bool mtchstreak = true)
-{
-    if (visited.count(pos.row) && visited[pos.row].count(pos.col) || curdepth >= depth)
+void queueAsset(AssetLoader& l, int id) {
+    uint8_t idle = STAGE_IDLE;
+    if (!l.stage[id].compare_exchange_strong(idle, STAGE_DECODING))
         return;
-    visited[pos.row][pos.col] = true;
-    auto& tile = getTile(gs, pos);
-    if (tile.exists && curdepth == 0) tile.shake = std::max(tile.shake, shake / (curdepth + 1));
-    if (tile.exists || curdepth == 0) {
-        for (int i = 0; i < 6; ++i) {
-            if (checkBounds(gs, TOGO[i])) {
-                auto& n = getTile(gs, TOGO[i]);
-                bool match = checkMatch(n.thing, thing, param);
-                bool samecolor = (mtchstreak && match);
-                if (n.exists)
-                    n.shake = std::max(n.shake, samecolor ? shake : (shake / (curdepth + 2)));
-            }
+    if (l.packed)
+        decodeAsset(l, id);
+    else
+        assetPool().submit([&l, id] { decodeAsset(l, id); });
+}
+
+// covers the embedded bytes and the font settings, a pack built from anything else is ignored
+uint64_t assetSourceHash() {
+    uint64_t h = 0xcbf29ce484222325ull;
+    int32_t font[] = {FONT_SIZE, FONT_PADDING, FONT_ATLAS_SIZE};
+    packHashSource(h, (const unsigned char*)font, sizeof(font));
+    for (auto& src : ASSET_SOURCES)
+        packHashSource(h, src.data, src.len);
+    return h;
+}
+
+bool openAssetPack(AssetLoader& l, const char* path) {
+    l.packed = nullptr;
+    if (!path || !l.pack.open(path))
+        return false;
+    auto entries = packEntries(l.pack, ASSET_COUNT, assetSourceHash());
+    for (int i = 0; entries && i < ASSET_COUNT; ++i) {
+        auto& e = entries[i];
+        uint64_t n = e.kind == PACK_FONT ? uint64_t(std::max(e.glyphCount, 0)) : 0;
+        if (strncmp(e.name, ASSET_SOURCES[i].name, ASSET_PACK_NAME) || e.kind != ASSET_SOURCES[i].kind ||
+            e.recs + n * sizeof(Rectangle) > l.pack.size() || e.glyphs + n * sizeof(PackGlyph) > l.pack.size())
+            entries = nullptr;
+    }
+    if (!entries) {
+        TraceLog(LOG_WARNING, "HEX: asset pack %s does not match this build, decoding the embedded assets", path);
+        l.pack.close();
+        return false;
+    }
+    l.packed = entries;
+    return true;
+}
+
+// the texture starts at the power of two rows that holds the startup glyphs, which stay pinned at its top, and
+// doubles up to FONT_ATLAS_SIZE as codepoints come in. A full 1024x1024 GRAY_ALPHA atlas is 2 MB. The glyph arrays
+// start with FONT_GLYPH_SLOTS so rasterized codepoints can be added in place
+void uploadFont(GameAssets& ga, DecodedAsset& out) {
+    auto& gc = ga.glyphs;
+    int n = out.glyphCount;
+    int slots = std::max(n, FONT_GLYPH_SLOTS);
+    int height = std::min((int)std::bit_ceil(unsigned(std::max(out.image.height, 1))), FONT_ATLAS_SIZE);
+    Texture2D tex = {rlLoadTexture(nullptr, FONT_ATLAS_SIZE, height, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA, 1),
+        FONT_ATLAS_SIZE, height, 1, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA};
+    UpdateTextureRec(tex, {0, 0, (float)out.image.width, (float)out.image.height}, out.image.data);
+    auto recs = (Rectangle*)MemAlloc(slots * sizeof(Rectangle));
+    auto glyphs = (GlyphInfo*)MemAlloc(slots * sizeof(GlyphInfo));
+    memcpy(recs, out.recs, n * sizeof(Rectangle));
+    gc.slotOf.clear();
+    for (int i = 0; i < n; ++i) {
+        glyphs[i] = {out.glyphs[i].value, out.glyphs[i].offsetX, out.glyphs[i].offsetY, out.glyphs[i].advanceX, Image{}};
+        gc.slotOf[glyphs[i].value] = i;
+    }
+    gc.atlas.reset(FONT_ATLAS_SIZE, height);
+    gc.atlas.reserve(out.image.height);
+    gc.shelfOf.assign(slots, 0);
+    gc.freeSlots.clear();
+    ga.font = {FONT_SIZE, n, FONT_PADDING, tex, recs, glyphs};
+}
+
+// GPU textures and audio buffers are created on the main thread. Without a window there is nothing to upload to,
+// so headless runs free the decoded data and only keep the timings
+void uploadAsset(AssetLoader& l, int id) {
+    auto& ga = *l.ga;
+    auto& out = l.out[id];
+    float start = assetClockMs(l);
+#ifndef HEX_HEADLESS
+    if (ASSET_SOURCES[id].kind == PACK_IMAGE)
+        *assetTexture(ga, id) = LoadTextureFromImage(out.image);
+    else if (ASSET_SOURCES[id].kind == PACK_WAVE)
+        *assetSound(ga, id) = LoadSoundFromWave(out.wave);
+    else
+        uploadFont(ga, out);
+    if (ASSET_SOURCES[id].kind == PACK_WAVE) {
+        auto& voices = ga.voices[id - ASSET_CLANG0];
+        voices[0] = *assetSound(ga, id);
+        for (int i = 1; i < AUDIO_VOICES; ++i)
+            voices[i] = LoadSoundAlias(voices[0]);
+    }
+#endif
+    if (out.glyphs)
+        UnloadFontData(out.glyphs, out.glyphCount);
+    MemFree(out.recs);
+    if (!out.packed) {
+        UnloadImage(out.image);
+        UnloadWave(out.wave);
+    }
+    out = {};
+    l.stage[id] = STAGE_READY;
+    auto& t = ga.load.assets[id];
+    t.ready = assetClockMs(l);
+    t.uploadMs = t.ready - start;
+    ga.load.ready |= 1u << id;
+    if ((ga.load.ready & ASSETS_EAGER) == ASSETS_EAGER && ga.load.allEagerMs < 0)
+        ga.load.allEagerMs = t.ready;
+}
+
+// uploads finished decodes in the order they finished, at least one, until budgetMs is spent
+void pumpAssets(AssetLoader& l, float budgetMs) {
+    float start = assetClockMs(l);
+    for (;;) {
+        int id;
+        {
+            std::lock_guard<std::mutex> lock(l.m);
+            if (l.decoded.empty())
+                return;
+            id = l.decoded.front();
+            l.decoded.erase(l.decoded.begin());
         }
-        if (mtchstreak) {
-            for (int i = 0; i < 6; ++i) {
-                if (checkBounds(gs, TOGO[i])) {
-                    auto& n = getTile(gs, TOGO[i]);
-                    bool match = checkMatch(n.thing, thing, param);
-                    if (n.exists && match)
-                        addShakeRecur(gs, n.pos, visited, thing, param, shake, depth, curdepth, true);
-                }
-            }
+        uploadAsset(l, id);
+        if (assetClockMs(l) - start >= budgetMs)
+            return;
+    }
+}
+
+// uploads until everything in mask is ready, or until budgetMs runs out when it is not negative
+bool waitAssets(AssetLoader& l, uint32_t mask, float budgetMs) {
+    float until = assetClockMs(l) + budgetMs;
+    for (;;) {
+        pumpAssets(l, std::numeric_limits<float>::max());
+        if ((l.ga->load.ready & mask) == mask)
+            return true;
+        std::unique_lock<std::mutex> lock(l.m);
+        if (budgetMs < 0) {
+            l.cv.wait(lock, [&] { return !l.decoded.empty(); });
+            continue;
         }
-        if (!mtchstreak || curdepth == 0) {
-            for (int i = 0; i < 6; ++i) {
-                if (checkBounds(gs, TOGO[i])) {
-                    auto& n = getTile(gs, TOGO[i]);
-                    bool match = checkMatch(n.thing, thing, param);
-                    if (n.exists && !match)
-                        addShakeRecur(gs, n.pos, visited, thing, param, shake, depth, curdepth + 1, false);
-                }
+        float left = until - assetClockMs(l);
+        if (left <= 0)
+            return false;
+        l.cv.wait_for(lock, std::chrono::duration<float, std::milli>(left), [&] { return !l.decoded.empty(); });
+    }
+}
+
+// music decodes on its own thread into a ring that the audio callback drains, so neither a long frame nor an
+// unfocused window starves it. The first half of the track is an intro, after it the stream loops the second half
+struct MusicStreamer {
+    OggStream ogg;
+    int channels = 0;
+    // sized once the track says how many channels it has
+    SpscRing<int16_t> ring{0};
+    std::thread thread;
+    GameAssets* ga = nullptr;
+    std::atomic<bool> stop = false, primed = false, loopDone = false;
+    std::atomic<uint64_t> decodedFrames = 0, playedFrames = 0, underruns = 0, silentFrames = 0;
+    std::atomic<uint32_t> loops = 0, lowWater = UINT32_MAX;
+    uint64_t reportedUnderruns = 0;
+    double lastReport = 0;
+
+    ~MusicStreamer();
+};
+
+MusicStreamer& musicStreamer() {
+    static MusicStreamer ms;
+    return ms;
+}
+
+// runs on the audio thread: whatever the ring holds, silence for the rest
+void musicCallback(void* buffer, unsigned int frames) {
+    auto& ms = musicStreamer();
+    auto out = (int16_t*)buffer;
+    size_t want = size_t(frames) * ms.channels;
+    size_t waiting = ms.ring.size() / ms.channels;
+    size_t got = ms.ring.pop(out, want);
+    std::fill(out + got, out + want, 0);
+    ms.playedFrames += got / ms.channels;
+    if (!ms.primed)
+        return;
+    if (waiting < ms.lowWater.load(std::memory_order_relaxed))
+        ms.lowWater.store(uint32_t(waiting), std::memory_order_relaxed);
+    if (got < want) {
+        ms.underruns++;
+        ms.silentFrames += (want - got) / ms.channels;
+    }
+}
+
+void produceMusic(MusicStreamer& ms) {
+    std::vector<int16_t> chunk(size_t(MUSIC_CHUNK_FRAMES) * ms.channels);
+    uint32_t loopStart = uint32_t(ms.ogg.length() * MUSIC_LOOP_START);
+    uint32_t pos = (ms.loopDone && ms.ogg.seek(loopStart)) ? loopStart : 0;
+    while (!ms.stop) {
+        if (ms.ring.space() < chunk.size()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(MUSIC_REFILL_MS));
+            continue;
+        }
+        int n = ms.ogg.read(chunk.data(), MUSIC_CHUNK_FRAMES);
+        if (n <= 0) {
+            // nothing past the loop start decodes, better silence than spinning
+            if (pos <= loopStart || !ms.ogg.seek(loopStart))
+                break;
+            pos = loopStart;
+            ms.loops++;
+            continue;
+        }
+        ms.ring.push(chunk.data(), size_t(n) * ms.channels);
+        pos += n;
+        ms.decodedFrames += n;
+        ms.primed = true;
+        if (pos >= loopStart)
+            ms.loopDone = true;
+    }
+}
+
+// the callback is detached first, raylib holds its audio lock while calling it, so nothing reads the ring after
+void stopMusic(MusicStreamer& ms) {
+    if (ms.ga && IsAudioDeviceReady())
+        SetAudioStreamCallback(ms.ga->music, nullptr);
+    ms.stop = true;
+    if (ms.thread.joinable())
+        ms.thread.join();
+    ms.ogg.close();
+    ms.ga = nullptr;
+}
+
+// shutdownGame() stops the stream before the code goes away, a decoder thread still here is only let go
+MusicStreamer::~MusicStreamer() {
+    if (thread.joinable())
+        thread.detach();
+}
+
+// the stream outlives a hot reload and is reused when its format still fits
+void startMusic(GameAssets& ga, bool loopDone) {
+    auto& ms = musicStreamer();
+    stopMusic(ms);
+    if (!ms.ogg.open(res_music_ogg, res_music_ogg_len)) {
+        TraceLog(LOG_WARNING, "HEX: could not decode the music");
+        return;
+    }
+    ms.channels = ms.ogg.channels();
+    ms.ring.resize(size_t(MUSIC_RING_FRAMES) * ms.channels);
+    ms.stop = false;
+    ms.primed = false;
+    ms.loopDone = loopDone;
+    ms.decodedFrames = ms.playedFrames = ms.underruns = ms.silentFrames = 0;
+    ms.loops = 0;
+    ms.lowWater = UINT32_MAX;
+    ms.reportedUnderruns = 0;
+    if (IsAudioStreamValid(ga.music) && (ga.music.sampleRate != ms.ogg.sampleRate() || ga.music.channels != (unsigned)ms.channels)) {
+        UnloadAudioStream(ga.music);
+        ga.music = {};
+    }
+    if (!IsAudioStreamValid(ga.music))
+        ga.music = LoadAudioStream(ms.ogg.sampleRate(), 16, ms.channels);
+    ms.ga = &ga;
+    ms.thread = std::thread(produceMusic, std::ref(ms));
+    SetAudioStreamCallback(ga.music, musicCallback);
+}
+
+// the eager assets come straight from the pack when one matches this build, otherwise they decode on assetPool() while
+// the main thread sets up the music stream and the shaders. init returns once the first frame can be drawn, or a little
+// later if the sounds are close behind, the rest is uploaded between frames
+void loadAssets(GameAssets& ga, GameState& gs, const char* packPath) {
+    PROFILE_ZONE("loadAssets");
+    auto& l = assetLoader();
+    assetPool().wait();
+    l.ga = &ga;
+    l.t0 = AssetClock::now();
+    l.decoded.clear();
+    ga.load = {};
+    for (int i = 0; i < ASSET_COUNT; ++i)
+        l.stage[i] = STAGE_IDLE;
+    ga.load.packed = openAssetPack(l, packPath);
+    for (int i = 0; i < ASSET_COUNT; ++i)
+        if (!ASSET_SOURCES[i].deferred)
+            queueAsset(l, i);
+
+#ifndef HEX_HEADLESS
+    startMusic(ga, gs.musicLoopDone);
+
+#ifdef PLATFORM_ANDROID
+    auto postProcFragShaderStr = prepShader((unsigned char*)res_post_proc_fs);
+        ga.postProcFragShader = LoadShaderFromMemory(NULL, (const char*)postProcFragShaderStr.c_str());
+        auto maskFragShaderStr = prepShader((unsigned char*)res_mask_fs);
+        ga.maskFragShader = LoadShaderFromMemory(NULL, (const char*)maskFragShaderStr.c_str());
+#else
+    ga.postProcFragShader = LoadShaderFromMemory(NULL, (const char*)res_post_proc_fs);
+    ga.maskFragShader = LoadShaderFromMemory(NULL, (const char*)res_mask_fs);
+#endif
+#endif
+
+    waitAssets(l, ASSETS_FIRST_FRAME, -1);
+    waitAssets(l, ASSETS_EAGER, ASSET_STARTUP_BUDGET_MS);
+    ga.load.initMs = assetClockMs(l);
+    gs.ga.p = &ga;
+}
+
+// called once per frame: leftover uploads within their budget, and the startup breakdown after the first frame
+void updateAssets(const GameState& gs) {
+    auto& l = assetsFor(gs);
+    if (!l.ga)
+        return;
+    pumpAssets(l, ASSET_UPLOAD_BUDGET_MS);
+    auto& load = l.ga->load;
+    if (load.firstFrameMs >= 0)
+        return;
+    load.firstFrameMs = assetClockMs(l);
+    TraceLog(LOG_INFO, "HEX: first frame at %.1f ms, init took %.1f ms, %d of %d assets ready, %s", load.firstFrameMs, load.initMs,
+        std::popcount(load.ready), ASSET_COUNT, load.packed ? "from " ASSET_PACK_FILE : "decoded");
+    for (int i = 0; i < ASSET_COUNT; ++i) {
+        auto& t = load.assets[i];
+        TraceLog(LOG_DEBUG, "HEX: asset %-9s decode %6.2f ms from %6.2f, upload %5.2f ms, ready at %6.2f", ASSET_SOURCES[i].name,
+            t.decodeMs, t.decodeStart, t.uploadMs, t.ready);
+    }
+}
+
+// for sounds that are known to come up shortly, like the explosion of a triggered bomb
+void prefetchAsset([[maybe_unused]] const GameState& gs, [[maybe_unused]] AssetId id) {
+#ifndef HEX_HEADLESS
+    queueAsset(assetsFor(gs), id);
+#endif
+}
+
+float voiceLength(const GameState& gs, int sample, float pitch) {
+    auto& snd = gs.ga.p->voices[sample][0];
+    if (!snd.frameCount || !snd.stream.sampleRate)
+        return AUDIO_FALLBACK_LENGTH;
+    return snd.frameCount / (float(snd.stream.sampleRate) * pitch);
+}
+
+// a free voice of the sample, or the one closest to finishing when all of them are busy
+int pickVoice(const AudioMixer& mix, int sample, double now) {
+    auto& voices = mix.voices[sample];
+    int best = 0;
+    for (int i = 0; i < AUDIO_VOICES; ++i) {
+        if (voices[i].end <= now)
+            return i;
+        if (voices[i].end < voices[best].end)
+            best = i;
+    }
+    return best;
+}
+
+// one voice per sound per frame: the triggers of a frame are merged into a louder, slightly detuned voice, and the
+// voices start loudest first while the volume of everything sounding stays within AUDIO_MIX_BUDGET. A sound that is
+// not loaded yet keeps its request until it is, the deferred ones start decoding here
+void flushSounds(const GameState& gs) {
+    PROFILE_ZONE("flushSounds");
+    auto& mix = gs.tmp.audio;
+    auto& stats = mix.stats;
+    double now = getTime(gs);
+    float sounding = 0;
+    uint32_t nSounding = 0;
+    for (auto& voices : mix.voices) {
+        for (auto& v : voices) {
+            if (v.end > now) {
+                sounding += v.volume;
+                nSounding++;
             }
         }
     }
+    std::array<int, SOUND_COUNT> order;
+    int n = 0;
+    for (int i = 0; i < SOUND_COUNT; ++i)
+        if (mix.pending[i].count)
+            order[n++] = i;
+    std::stable_sort(order.begin(), order.begin() + n, [&](int a, int b) { return mix.pending[a].volume > mix.pending[b].volume; });
+    int starts = 0;
+    for (int k = 0; k < n; ++k) {
+        int i = order[k];
+        auto& req = mix.pending[i];
+#ifndef HEX_HEADLESS
+        if (!((gs.ga.p->load.ready >> (i + ASSET_CLANG0)) & 1)) {
+            queueAsset(assetsFor(gs), i + ASSET_CLANG0);
+            continue;
+        }
+#endif
+        if (now - mix.lastStart[i] < req.interval) {
+            stats.limited += req.count;
+            req = {};
+            continue;
+        }
+        float volume = std::min({req.volume * (1.0f + AUDIO_COALESCE_GAIN * log2f(req.count)), 1.0f, AUDIO_MIX_BUDGET - sounding});
+        if (starts == AUDIO_MAX_STARTS || volume < AUDIO_MIN_VOLUME) {
+            stats.dropped += req.count;
+            req = {};
+            continue;
+        }
+        int sample = i + randValue(fxRand, 0, std::max(req.variants - 1, 0));
+        int slot = pickVoice(mix, sample, now);
+        auto& voice = mix.voices[sample][slot];
+        if (voice.end > now) {
+            stats.stolen++;
+            sounding -= voice.volume;
+            nSounding--;
+        }
+        float pitch = 1.0f + ((req.count > 1) ? AUDIO_PITCH_JITTER * RAND_FLOAT_SIGNED : 0.0f);
+#ifndef HEX_HEADLESS
+        auto& snd = gs.ga.p->voices[sample][slot];
+        SetSoundVolume(snd, volume);
+        SetSoundPitch(snd, pitch);
+        PlaySound(snd);
+#endif
+        voice = {now + voiceLength(gs, sample, pitch), volume};
+        mix.lastStart[i] = now;
+        sounding += volume;
+        nSounding++;
+        starts++;
+        stats.played++;
+        req = {};
+    }
+    stats.peakVoices = std::max(stats.peakVoices, nSounding);
+    stats.peakMix = std::max(stats.peakMix, sounding);
+}
+
+constexpr FieldDesc USER_LAYOUT[] = {
+    LAYOUT_FIELD(GameState::UserData, bestScore),
+    LAYOUT_FIELD(GameState::UserData, n_params),
+    LAYOUT_FIELD(GameState::UserData, musEnabled),
+    LAYOUT_FIELD(GameState::UserData, sndEnabled),
+    LAYOUT_FIELD(GameState::UserData, accEnabled),
+    LAYOUT_FIELD(GameState::UserData, velEnabled)
+};
+constexpr uint64_t USER_LAYOUT_HASH = layoutHash(USER_LAYOUT, sizeof(GameState::UserData));
+
+using PersistClock = std::chrono::steady_clock;
+
+// settings and the best score are written by a worker, so a slow disk never holds up a frame. A save asked for
+// while another is pending replaces it, and the worker waits USERDATA_COALESCE_MS after the last request, so a
+// burst of settings clicks is one write
+struct UserDataWriter {
+    std::thread thread;
+    std::mutex m;
+    std::condition_variable cv;
+    std::string path;
+    GameState::UserData pending;
+    PersistClock::time_point requestTime;
+    bool dirty = false, writing = false, urgent = false, stop = false;
+    uint32_t sequence = 0;
+    PersistStats stats = {};
+
+    ~UserDataWriter();
+};
+
+UserDataWriter& userDataWriter() {
+    static UserDataWriter w;
+    return w;
+}
+
+bool writeUserFile(const char* path, const GameState::UserData& usr, uint32_t sequence) {
+    auto rec = saveRecord(USER_LAYOUT, USER_LAYOUT_HASH, &usr, sizeof(usr), sequence);
+    return writeFileAtomic(path, rec.data(), rec.size());
+}
+
+// files from before the record format hold the raw struct and are still read once
+bool readUserFile(const char* path, GameState::UserData& usr) {
+    auto buf = readFile(path);
+    auto res = loadRecord(USER_LAYOUT, USER_LAYOUT_HASH, &usr, sizeof(usr), buf.data(), buf.size());
+    if (res == SAVE_NOT_A_RECORD && buf.size() == sizeof(usr)) {
+        memcpy(&usr, buf.data(), sizeof(usr));
+        return true;
+    }
+    if (res == SAVE_CORRUPT)
+        TraceLog(LOG_WARNING, "HEX: %s is damaged, keeping the default settings", path);
+    if (res == SAVE_MIGRATED)
+        TraceLog(LOG_INFO, "HEX: %s was saved by another version, kept the settings it shares with this one", path);
+    return res == SAVE_OK || res == SAVE_MIGRATED;
+}
+
+void userDataThread(UserDataWriter& w) {
+    std::unique_lock<std::mutex> lock(w.m);
+    for (;;) {
+        w.cv.wait(lock, [&] { return w.stop || w.dirty; });
+        if (!w.dirty)
+            return;
+        auto due = w.requestTime + std::chrono::milliseconds(USERDATA_COALESCE_MS);
+        while (!w.stop && !w.urgent && PersistClock::now() < due) {
+            w.cv.wait_until(lock, due);
+            due = w.requestTime + std::chrono::milliseconds(USERDATA_COALESCE_MS);
+        }
+        auto usr = w.pending;
+        auto path = w.path;
+        uint32_t seq = ++w.sequence;
+        w.dirty = false;
+        w.writing = true;
+        lock.unlock();
+        auto t0 = PersistClock::now();
+        bool ok = writeUserFile(path.c_str(), usr, seq);
+        float ms = std::chrono::duration<float, std::milli>(PersistClock::now() - t0).count();
+        lock.lock();
+        w.writing = false;
+        w.urgent = w.urgent && w.dirty;
+        ok ? w.stats.written++ : w.stats.failed++;
+        w.stats.writeMs = ms;
+        w.stats.maxWriteMs = std::max(w.stats.maxWriteMs, ms);
+        if (!ok)
+            TraceLog(LOG_WARNING, "HEX: could not save %s", path.c_str());
+        w.cv.notify_all();
+    }
+}
+
+// thread-safe, the sim thread asks for one on game over
+void queueUserData(const char* path, const GameState::UserData& usr) {
+    auto& w = userDataWriter();
+    {
+        std::lock_guard<std::mutex> lock(w.m);
+        w.stats.requested++;
+        w.stats.coalesced += w.dirty;
+        w.pending = usr;
+        w.path = path;
+        w.requestTime = PersistClock::now();
+        w.dirty = true;
+        if (!w.thread.joinable())
+            w.thread = std::thread(userDataThread, std::ref(w));
+    }
+    w.cv.notify_all();
+}
+
+// writes what is pending now and waits for it
+void flushUserData() {
+    auto& w = userDataWriter();
+    std::unique_lock<std::mutex> lock(w.m);
+    w.urgent = w.dirty;
+    w.cv.notify_all();
+    w.cv.wait(lock, [&] { return !w.dirty && !w.writing; });
+}
+
+// whatever is pending is written before the worker goes, a later save starts it again
+void stopUserData() {
+    auto& w = userDataWriter();
+    {
+        std::lock_guard<std::mutex> lock(w.m);
+        w.stop = true;
+    }
+    w.cv.notify_all();
+    if (w.thread.joinable())
+        w.thread.join();
+    w.stop = false;
+}
+
+// left running only when the host skipped shutdownGame(), joining here could wait on the loader lock
+UserDataWriter::~UserDataWriter() {
+    if (thread.joinable())
+        thread.detach();
+}
+
+DLL_EXPORT PersistStats getPersistStats()
+{
+    auto& w = userDataWriter();
+    std::lock_guard<std::mutex> lock(w.m);
+    return w.stats;
+}
+
+// raylib writes relative names under the app's internal storage on Android, the rename has to happen there too
+std::string userDataPath() {
+#ifdef PLATFORM_ANDROID
+    return std::string(GetAndroidApp()->activity->internalDataPath) + "/" + USERDATA_FILE;
+#else
+    return USERDATA_FILE;
+#endif
+}
+
+void saveUserData(const GameState& gs) {
+#ifndef HEX_HEADLESS
+    queueUserData(userDataPath().c_str(), gs.usr);
+#endif
+}
+
+// a save still in flight is newer than the file, so it lands first
+void loadUserData(GameState& gs) {
+#ifndef HEX_HEADLESS
+    flushUserData();
+    readUserFile(userDataPath().c_str(), gs.usr);
+#endif
+}
+
+constexpr FieldDesc THING_LAYOUT[] = {
+    LAYOUT_FIELD(Thing, clr), LAYOUT_FIELD(Thing, shp), LAYOUT_FIELD(Thing, sym), LAYOUT_FIELD(Thing, bomb)
+};
+constexpr uint64_t THING_LAYOUT_HASH = layoutHash(THING_LAYOUT, sizeof(Thing));
+
+constexpr FieldDesc THING_POS_LAYOUT[] = {LAYOUT_FIELD(ThingPos, row), LAYOUT_FIELD(ThingPos, col)};
+constexpr uint64_t THING_POS_LAYOUT_HASH = layoutHash(THING_POS_LAYOUT, sizeof(ThingPos));
+
+constexpr FieldDesc TILE_LAYOUT[] = {LAYOUT_FIELD(Tile, exists), LAYOUT_FIELD_T(Tile, thing, THING_LAYOUT_HASH)};
+constexpr uint64_t TILE_LAYOUT_HASH = layoutHash(TILE_LAYOUT, sizeof(Tile));
+
+constexpr FieldDesc BOMB_TIMER_LAYOUT[] = {LAYOUT_FIELD_T(BombTimer, pos, THING_POS_LAYOUT_HASH), LAYOUT_FIELD(BombTimer, triggerTime)};
+constexpr uint64_t BOMB_TIMER_LAYOUT_HASH = layoutHash(BOMB_TIMER_LAYOUT, sizeof(BombTimer));
+
+// the unit of hot-reload migration, fields missing from an older module keep their fresh-game values
+constexpr FieldDesc SIM_LAYOUT[] = {
+#ifdef HEX_LAYOUT_VARIANT
+    LAYOUT_FIELD(SimState, variantTag),
+#endif
+    LAYOUT_FIELD(SimState, seed),
+    LAYOUT_FIELD(SimState, board.scroll),
+    LAYOUT_FIELD(SimState, board.speed),
+    LAYOUT_FIELD(SimState, board.nFulRowsTop),
+    LAYOUT_FIELD(SimState, board.nRowsGap),
+    LAYOUT_FIELD_T(SimState, board.things, TILE_LAYOUT_HASH),
+    LAYOUT_FIELD(SimState, board.shakes),
+    LAYOUT_FIELD_T(SimState, board.bombTimers, BOMB_TIMER_LAYOUT_HASH),
+    LAYOUT_FIELD(SimState, board.even),
+    LAYOUT_FIELD(SimState, board.moveTime),
+    LAYOUT_FIELD(SimState, board.totalMoveTime),
+    LAYOUT_FIELD_T(SimState, board.todrop, THING_POS_LAYOUT_HASH),
+    LAYOUT_FIELD_T(SimState, board.uncon, THING_POS_LAYOUT_HASH),
+    LAYOUT_FIELD(SimState, board.lastDropCombo),
+    LAYOUT_FIELD(SimState, gun.speed),
+    LAYOUT_FIELD(SimState, gun.dir),
+    LAYOUT_FIELD(SimState, gun.turn),
+    LAYOUT_FIELD_T(SimState, gun.armed, THING_LAYOUT_HASH),
+    LAYOUT_FIELD(SimState, gun.extraArmed),
+    LAYOUT_FIELD(SimState, gun.firstSwap),
+    LAYOUT_FIELD_T(SimState, gun.extra, THING_LAYOUT_HASH),
+    LAYOUT_FIELD(SimState, gun.nextArmed),
+    LAYOUT_FIELD_T(SimState, gun.next, THING_LAYOUT_HASH),
+    LAYOUT_FIELD(SimState, bullet.exists),
+    LAYOUT_FIELD_T(SimState, bullet.thing, THING_LAYOUT_HASH),
+    LAYOUT_FIELD(SimState, bullet.pos),
+    LAYOUT_FIELD(SimState, bullet.vel),
+    LAYOUT_FIELD_T(SimState, bullet.lstEmp, THING_POS_LAYOUT_HASH),
+    LAYOUT_FIELD(SimState, bullet.rebouncing),
+    LAYOUT_FIELD(SimState, bullet.rebounce),
+    LAYOUT_FIELD(SimState, bullet.rebCp),
+    LAYOUT_FIELD(SimState, bullet.rebEnd),
+    LAYOUT_FIELD(SimState, bullet.rebTime),
+    LAYOUT_FIELD(SimState, score),
+    LAYOUT_FIELD(SimState, combo),
+    LAYOUT_FIELD(SimState, firstShotFired),
+    LAYOUT_FIELD(SimState, gameOver),
+    LAYOUT_FIELD(SimState, time),
+    LAYOUT_FIELD(SimState, gameStartTime),
+    LAYOUT_FIELD(SimState, gameOverTime),
+    LAYOUT_FIELD(SimState, inputTimeoutTime),
+    LAYOUT_FIELD(SimState, rearmTime),
+    LAYOUT_FIELD(SimState, swapTime),
+    LAYOUT_FIELD(SimState, alteredDifficulty),
+    LAYOUT_FIELD(SimState, tuning.boardAcc),
+    LAYOUT_FIELD(SimState, tuning.bombProb),
+    LAYOUT_FIELD(SimState, tuning.nToDrop),
+    LAYOUT_FIELD(SimState, tuning.botRowGap),
+    LAYOUT_FIELD(SimState, tuning.maxCombo),
+    LAYOUT_FIELD(SimState, streamSeed),
+    LAYOUT_FIELD(SimState, streamRow)
+};
+constexpr size_t SIM_LAYOUT_FIELDS = sizeof(SIM_LAYOUT) / sizeof(SIM_LAYOUT[0]);
+
+// Temp, UserData and the rest of GameState are only compared by size, STATE_LAYOUT_VERSION covers the rest
+constexpr uint64_t STATE_LAYOUT_HASH = layoutHashBytes(layoutHashBytes(layoutHashBytes(
+    layoutHash(SIM_LAYOUT, sizeof(SimState)), sizeof(GameState), 8), sizeof(GameState::Temp), 8), STATE_LAYOUT_VERSION, 4);
+
+#define STATE_BLOB_MAGIC 0x53584548 // "HEXS"
+
+// exportState writes the header, then one FieldRecord per SIM_LAYOUT entry, then the raw SimState
+struct StateBlobHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t layoutHash;
+    uint32_t nFields;
+    uint32_t simSize;
+};
+
+constexpr size_t STATE_BLOB_SIZE = sizeof(StateBlobHeader) + SIM_LAYOUT_FIELDS * sizeof(FieldRecord) + sizeof(SimState);
+
+void stampHeader(GameState& gs) {
+    gs.header = {STATE_LAYOUT_HASH, STATE_LAYOUT_VERSION, (uint32_t)sizeof(GameState)};
+}
+
+void setStuff(const GameAssets* ga, RenderTexture& rt, GameState& gs) {
+    gs.ga.p = ga;
+    stampHeader(gs);
+    loadUserData(gs);
+#ifndef HEX_HEADLESS
+    gs.tmp.renderTex = IsRenderTextureValid(rt) ? rt : LoadRenderTexture(SCREEN_WIDTH, SCREEN_HEIGHT);;
+    SetTextureWrap(gs.tmp.renderTex.texture, TEXTURE_WRAP_CLAMP);
+#endif
+}
+
+void quiescePipeline(const GameState& gs);
+
+DLL_EXPORT void takeSnapshot(const GameState& gs, SimState& snap)
+{
+    snap = gs;
+}
+
+// the presentation state (particles, effects, input queue) is left as it is
+DLL_EXPORT void restoreSnapshot(GameState& gs, const SimState& snap)
+{
+    static_cast<SimState&>(gs) = snap;
+    gs.tmp.boardVersion++;
+}
+
+DLL_EXPORT void setState(GameState& gs, const GameState& ngs)
+{
+    quiescePipeline(gs);
+    restoreSnapshot(gs, ngs);
+    gs.musicLoopDone = ngs.musicLoopDone;
+    gs.settingsOpened = ngs.settingsOpened;
+    setStuff(gs.ga.p, gs.tmp.renderTex, gs);
+}
+
+DLL_EXPORT uint64_t getStateLayoutHash()
+{
+    return STATE_LAYOUT_HASH;
+}
+
+// zero-copy path of a hot reload: the buffer the previous module ran on is used as is
+DLL_EXPORT bool adoptState(GameState& gs, const GameAssets* ga)
+{
+    if (gs.header.layoutHash != STATE_LAYOUT_HASH || gs.header.version != STATE_LAYOUT_VERSION || gs.header.size != sizeof(GameState))
+        return false;
+    gs.ga.p = ga;
+    return true;
+}
+
+extern "C++" template <typename Put>
+void writeStateBlob(const GameState& gs, Put put) {
+    StateBlobHeader hdr = {STATE_BLOB_MAGIC, STATE_LAYOUT_VERSION, STATE_LAYOUT_HASH, (uint32_t)SIM_LAYOUT_FIELDS, (uint32_t)sizeof(SimState)};
+    put(&hdr, sizeof(hdr));
+    for (auto& f : SIM_LAYOUT) {
+        auto rec = layoutRecord(f);
+        put(&rec, sizeof(rec));
+    }
+    put(static_cast<const SimState*>(&gs), sizeof(SimState));
+}
+
+// returns the blob size, nothing is written when buf is too small
+DLL_EXPORT size_t exportState(const GameState& gs, void* buf, size_t cap)
+{
+    if (!buf || cap < STATE_BLOB_SIZE)
+        return STATE_BLOB_SIZE;
+    quiescePipeline(gs);
+    char* p = (char*)buf;
+    writeStateBlob(gs, [&](const void* src, size_t n) {
+        memcpy(p, src, n);
+        p += n;
+    });
+    return STATE_BLOB_SIZE;
+}
+
+void resetSeeded(GameState& gs, unsigned int seed);
+
+DLL_EXPORT bool importState(GameState& gs, const void* buf, size_t size)
+{
+    quiescePipeline(gs);
+    StateBlobHeader hdr;
+    if (size < sizeof(hdr))
+        return false;
+    memcpy(&hdr, buf, sizeof(hdr));
+    size_t simOff = sizeof(hdr) + (size_t)hdr.nFields * sizeof(FieldRecord);
+    if (hdr.magic != STATE_BLOB_MAGIC || simOff + hdr.simSize > size)
+        return false;
+    const char* p = (const char*)buf;
+    if (hdr.layoutHash == STATE_LAYOUT_HASH && hdr.simSize == sizeof(SimState)) {
+        memcpy(static_cast<SimState*>(&gs), p + simOff, sizeof(SimState));
+        stampHeader(gs);
+        gs.tmp.boardVersion++;
+        return true;
+    }
+
+    std::vector<FieldRecord> records(hdr.nFields);
+    memcpy(records.data(), p + sizeof(hdr), hdr.nFields * sizeof(FieldRecord));
+    // whatever does not migrate comes from the reset, which has to start from the seed the blob was played with
+    unsigned int seed = gs.seed;
+    if (auto rec = layoutFind(records.data(), records.size(), "seed", sizeof(seed), hdr.simSize))
+        memcpy(&seed, p + simOff + rec->offset, sizeof(seed));
+    resetSeeded(gs, seed);
+    bool migrated[SIM_LAYOUT_FIELDS];
+    auto n = layoutMigrate(SIM_LAYOUT, static_cast<SimState*>(&gs), records.data(), records.size(), p + simOff, hdr.simSize, migrated);
+    TraceLog(LOG_INFO, "HEX: state layout %016llx -> %016llx, migrated %d/%d fields", (unsigned long long)hdr.layoutHash, (unsigned long long)STATE_LAYOUT_HASH, (int)n, (int)SIM_LAYOUT_FIELDS);
+    for (size_t i = 0; i < SIM_LAYOUT_FIELDS; ++i) {
+        if (migrated[i])
+            continue;
+        TraceLog(LOG_INFO, "HEX: state field %s reset", SIM_LAYOUT[i].name);
+        // a fresh board has to match the parity and gap it is placed into
+        if (!strcmp(SIM_LAYOUT[i].name, "board.things")) {
+            for (auto& row : gs.board.things)
+                std::fill(row.begin(), row.end(), Tile());
+            generateRows(gs, BOARD_HEIGHT - gs.board.nRowsGap);
+        }
+    }
+    gs.tmp.boardVersion++;
+    return true;
+}
+
+uint64_t hashData(uint64_t h, const void* data, size_t size) {
+    auto p = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i)
+        h = layoutHashBytes(h, p[i], 1);
+    return h;
+}
+
+extern "C++" template <size_t CAP, typename T>
+uint64_t hashArena(uint64_t h, const Arena<CAP, T>& arena) {
+    size_t n = arena.count();
+    h = hashData(h, &n, sizeof(n));
+    for (size_t i = 0; i < n; ++i)
+        h = hashData(h, &arena.get(i), sizeof(T));
+    return h;
+}
+
+// the clock fields follow whoever drives the frames and are left out,
+// arenas only count up to their size since the slots past it keep whatever was there before
+DLL_EXPORT uint64_t stateHash(const SimState& sim)
+{
+    constexpr size_t skip[] = {offsetof(SimState, time), offsetof(SimState, inputTimeoutTime),
+        offsetof(SimState, board.bombTimers), offsetof(SimState, board.todrop), offsetof(SimState, board.uncon)};
+    uint64_t h = LAYOUT_FNV_BASIS;
+    for (auto& f : SIM_LAYOUT)
+        if (std::find(std::begin(skip), std::end(skip), f.offset) == std::end(skip))
+            h = hashData(h, (const char*)&sim + f.offset, f.size);
+    h = hashArena(h, sim.board.bombTimers);
+    h = hashArena(h, sim.board.todrop);
+    return hashArena(h, sim.board.uncon);
+}
+
+// the user settings the simulation reads
+uint32_t packSettings(const GameState& gs) {
+    return uint32_t(gs.usr.n_params) | (gs.usr.accEnabled << 2) | (gs.usr.velEnabled << 3);
+}
+
+void unpackSettings(GameState& gs, uint32_t settings) {
+    gs.usr.n_params = settings & 3;
+    gs.usr.accEnabled = settings & 4;
+    gs.usr.velEnabled = settings & 8;
+}
+
+void stopReplayRecord(GameState& gs);
+
+// the replay starts from the current state, the rewind history is not part of it so both sides drop it
+DLL_EXPORT bool startReplayRecord(GameState& gs, const char* path)
+{
+    stopReplayRecord(gs);
+    auto& out = gs.tmp.replayOut;
+    if (!out.open(path)) {
+        TraceLog(LOG_WARNING, "HEX: could not open replay %s", path);
+        return false;
+    }
+    gs.tmp.rewind.clear();
+    auto& codec = gs.tmp.replayCodec;
+    codec = {};
+    codec.settings = packSettings(gs);
+    ReplayHeader hdr = {REPLAY_MAGIC, REPLAY_VERSION, STATE_LAYOUT_HASH, (uint32_t)STATE_BLOB_SIZE, codec.settings};
+    out.putBytes(&hdr, sizeof(hdr));
+    writeStateBlob(gs, [&](const void* src, size_t n) { out.putBytes(src, n); });
+    TraceLog(LOG_INFO, "HEX: recording replay to %s", path);
+    return true;
+}
+
+DLL_EXPORT void stopReplayRecord(GameState& gs)
+{
+    auto& out = gs.tmp.replayOut;
+    if (!out.isOpen())
+        return;
+    auto frames = gs.tmp.replayCodec.frames;
+    uint64_t hash = stateHash(gs);
+    out.putByte(REPLAY_END);
+    out.putVarint(frames);
+    out.putSigned(gs.score);
+    out.putBytes(&hash, sizeof(hash));
+    TraceLog(LOG_INFO, "HEX: replay stopped, %llu frames in %llu bytes", (unsigned long long)frames, (unsigned long long)out.written());
+    out.close();
+}
+
+void toggleReplayRecord(GameState& gs) {
+    if (gs.tmp.replayOut.isOpen())
+        stopReplayRecord(gs);
+    else
+        startReplayRecord(gs, TextFormat(REPLAY_FILE_FORMAT, (long long)::time(nullptr)));
+}
+
+// the frame clock is stored as raw bits so the player gets the exact same doubles,
+// predicted from the previous step which leaves a few bits per frame at a steady frame rate
+void recordReplayFrame(GameState& gs) {
+    auto& out = gs.tmp.replayOut;
+    if (!out.isOpen())
+        return;
+    auto& codec = gs.tmp.replayCodec;
+    auto timeBits = std::bit_cast<uint64_t>(getTime(gs));
+    auto dtBits = std::bit_cast<uint32_t>(getFrameTime(gs));
+    out.putByte(REPLAY_FRAME);
+    out.putSigned(int64_t(timeBits - codec.timeBits - codec.timeStep));
+    out.putSigned(int64_t(dtBits) - int64_t(codec.dtBits));
+    codec.timeStep = timeBits - codec.timeBits;
+    codec.timeBits = timeBits;
+    codec.dtBits = dtBits;
+    codec.frames++;
+    uint32_t settings = packSettings(gs);
+    if (settings != codec.settings) {
+        out.putByte(REPLAY_SETTINGS);
+        out.putVarint(settings);
+        codec.settings = settings;
+    }
+}
+
+static_assert(UPDATE_ITS <= 16, "replay events keep the tick in four bits");
+
+// written before the event is applied so a reset it causes follows it in the stream
+void recordReplayEvent(GameState& gs, const InputEvent& ev, int tick) {
+    auto& out = gs.tmp.replayOut;
+    if (!out.isOpen())
+        return;
+    auto& codec = gs.tmp.replayCodec;
+    out.putByte(REPLAY_EVENT);
+    out.putByte(uint8_t(ev.type) | uint8_t(tick << 4));
+    switch (ev.type) {
+        case INPUT_AIM: {
+            auto bits = std::bit_cast<uint32_t>(ev.value);
+            out.putSigned(int64_t(bits) - int64_t(codec.aimBits));
+            codec.aimBits = bits;
+            break;
+        }
+        case INPUT_TURN:
+            out.putSigned((int64_t)ev.value);
+            break;
+        case INPUT_ADD_TILE:
+        case INPUT_REMOVE_TILE:
+            out.putSigned(ev.pos.row);
+            out.putSigned(ev.pos.col);
+            break;
+        case INPUT_REWIND:
+            out.putVarint(std::bit_cast<uint32_t>(ev.value));
+            break;
+        default:
+            break;
+    }
+}
+
+void recordReplaySeed(GameState& gs, unsigned int seed) {
+    auto& out = gs.tmp.replayOut;
+    if (!out.isOpen())
+        return;
+    out.putByte(REPLAY_SEED);
+    out.putVarint(seed);
+}
+
+// the render target, the latency probe, the clock offset and the debug toggles survive resets. A reset can run on the
+// simulation thread, so it leaves alone what the main thread reads while the pipeline runs
+void resetTemp(GameState& gs) {
+    auto& tmp = gs.tmp;
+    tmp.particles.clear();
+    tmp.animations.clear();
+    tmp.scorePoints.clear();
+    tmp.visScore = 0;
+    tmp.shNDrops = 0;
+    tmp.inputs.clear();
+    tmp.nInputsApplied = 0;
+    tmp.lastPollTime = 0;
+    tmp.mouseTracked = false;
+    tmp.lastTurn = 0;
+    tmp.lastTouchCount = 0;
+    tmp.nInputLatencies = 0;
+    tmp.lastLatencyReport = 0;
+    tmp.nGameplayFrames = 0;
+    tmp.rewind.clear();
+    tmp.stats = {};
+    // voice end times are on the game clock, which starts over here
+    tmp.audio.pending = {};
+    tmp.audio.voices = {};
+    tmp.audio.lastStart = {};
+}
+
+void resetSeeded(GameState& gs, unsigned int seed) {
+    double now = getTime(gs);
+    Tuning tuning = gs.tuning;
+    restoreSnapshot(gs, SimState{});
+    gs.time = now;
+    gs.tuning = tuning;
+    gs.board.nRowsGap = tuning.botRowGap;
+    resetTemp(gs);
+    stampHeader(gs);
+    gs.seed = seed;
+    gs.streamSeed = seed;
+    for (int i = 0; i < gs.board.things.size(); ++i)
+        std::fill(gs.board.things[i].begin(), gs.board.things[i].end(), Tile());
+    generateRows(gs, BOARD_HEIGHT - gs.board.nRowsGap);
+    rearm(gs);
+    gs.gameStartTime = getTime(gs);
+}
+
+// a replay being played hands over the seed the recorded game was reset with
+void reset(GameState& gs) {
+    unsigned int seed = gs.tmp.replaySeedPending ? gs.tmp.replaySeed : rand() % std::numeric_limits<int>::max();
+    gs.tmp.replaySeedPending = false;
+    recordReplaySeed(gs, seed);
+    resetSeeded(gs, seed);
+}
+
+DLL_EXPORT void init(GameAssets& ga, GameState& gs)
+{
+    if (!IsAudioDeviceReady())
+        InitAudioDevice();
+
+    loadAssets(ga, gs, ASSET_PACK_FILE);
+    PlayAudioStream(ga.music);
+
+    setStuff(&ga, gs.tmp.renderTex, gs);
+    gs.time = GetTime();
+    gs.settingsOpened = false;
+    gs.tmp.timeOffsetSet = false;
+    reset(gs);
+}
+
+void recordRewind(GameState& gs, bool shot) {
+    gs.tmp.rewind.push(gs, getTime(gs), shot);
+}
+
+// moves every absolute timestamp of a restored state so that it resumes at the current time
+void shiftTimes(SimState& sim, double dt) {
+    sim.time += dt;
+    sim.gameStartTime += dt;
+    sim.gameOverTime += dt;
+    sim.inputTimeoutTime += dt;
+    sim.rearmTime += dt;
+    sim.swapTime += dt;
+    sim.bullet.rebTime += dt;
+    for (int i = 0; i < sim.board.bombTimers.count(); ++i)
+        sim.board.bombTimers.at(i).triggerTime += dt;
+}
+
+// amount > 0 goes back that many shots, amount < 0 that many seconds, short history stops at the oldest record
+bool rewindState(GameState& gs, float amount) {
+    auto& ring = gs.tmp.rewind;
+    if (ring.count() == 0)
+        return false;
+    int idx = (amount > 0) ? ring.findMarked((int)amount) : ring.findTime(getTime(gs) + amount);
+    idx = std::max(idx, 0);
+    double back = getTime(gs) - ring.get(idx).time;
+    double shift = getTime(gs) - ring.get(idx).recorded;
+    SimState snap;
+    if (!ring.restore(idx, snap))
+        return false;
+    shiftTimes(snap, shift);
+    ring.offsetTimes(back);
+    restoreSnapshot(gs, snap);
+    auto stats = ring.stats();
+    TraceLog(LOG_INFO, "HEX: rewound %.2f s, %d records left, %.0f bytes per snapshot", back, (int)stats.count, stats.avgBytes);
+    return true;
+}
+
+void reportPerfCounters(bool shot) {
+#ifdef HEX_PERF_COUNTERS
+    if (!perfOpen())
+        return;
+    char buf[512];
+    perfFormat(buf, sizeof(buf), shot ? perfState.lastShot : perfState.lastFrame);
+    TraceLog(shot ? LOG_INFO : LOG_DEBUG, "HEX: %s %u counters: %s", shot ? "shot" : "frame", shot ? perfState.nShots : 0u, buf);
+#endif
+}
+
+void shootAndRearm(GameState& gs) {
+    recordRewind(gs, true);
+    gs.tmp.stats.shots++;
+    perfEndShot();
+    reportPerfCounters(true);
+    gs.firstShotFired = true;
+    gs.bullet.exists = true;
+    gs.bullet.rebouncing = false;
+    float dir = gs.gun.dir + PI * 0.5f;
+    gs.bullet.thing = gs.gun.armed;
+    gs.bullet.vel = BULLET_SPEED * Vector2{cos(dir), -sin(dir)};
+    gs.bullet.pos = {(float)SCREEN_WIDTH * 0.5f, (float)SCREEN_HEIGHT - TILE_RADIUS};
+    playSound(gs, ASSET_WHOOSH0);
+    rearm(gs);
 }
 
 void checkLines(GameState& gs) {
@@ -471,87 +1917,64 @@ void checkLines(GameState& gs) {
     if (extraRows > 0) {
         shiftBoard(gs, extraRows);
         generateRows(gs, extraRows);
-        gs.board.pos -= ROW_HEIGHT * extraRows;
+        gs.board.scroll -= int64_t(extraRows) << SCROLL_FRAC_BITS;
         gs.board.moveTime = gs.board.totalMoveTime = BOARD_MOVE_TIME_PER_LINE * extraRows;
     }
 }
 
 void addDrop(GameState& gs, Vector2 pos) {
+    if (gs.tmp.shNDrops >= gs.tmp.shDropTimes.size())
+        return;
     gs.tmp.shDropCenters[gs.tmp.shNDrops] = pos;
     gs.tmp.shDropTimes[gs.tmp.shNDrops] = getTime(gs);
     gs.tmp.shNDrops++;
 }
 
 void triggerBomb(GameState& gs, const ThingPos& pos) {
-    auto& thing = getTile(gs, pos).thing;
-    thing.triggered = true;
-    thing.triggerTime = getTime(gs);
+    gs.tmp.boardVersion++;
+    getTile(gs, pos).thing.bomb = BOMB_TRIGGERED;
+    if (auto timer = findBombTimer(gs, pos))
+        timer->triggerTime = getTime(gs);
+    else
+        gs.board.bombTimers.acquire(BombTimer{pos, getTime(gs)});
     gs.bullet.exists = false;
-    playSound(gs, gs.ga.p->sizzle);
+    playSound(gs, ASSET_SIZZLE);
+    prefetchAsset(gs, ASSET_SNDEXP);
     addParticle(gs, gs.bullet.thing, gs.bullet.pos, {-gs.bullet.vel.x, -400.0f - 100.0f * RAND_FLOAT});
 }
 
 void checkDrop(GameState& gs, const ThingPos& pos, const Thing& thing, int minToDrop = 0) {
-    int bestK = 0, bestScore = 0;
-    Arena<MAX_TODROP, ThingPos> todrops[3];
-    Arena<MAX_TODROP, ThingPos> uncons[3];
-    auto exists = getTile(gs, pos).exists;
-    int lim = (exists ? minToDrop : (minToDrop - 1));
-    for (int k = 0; k < gs.usr.n_params; ++k) {
-        std::map<int, std::map<int, bool>> vis;
-        checkDropRecur(gs, pos, thing, k, todrops[k], vis);
-        int count = todrops[k].count();
-        if (count >= lim) {
-            for (int i = 0; i < todrops[k].count(); ++i)
-                removeTile(gs, todrops[k].at(i));
-            std::map<int, std::map<int, bool>> vis2;
-            for (int i = 0; i < todrops[k].count(); ++i) {
-                auto& td = todrops[k].at(i);
-                auto& tile = getTile(gs, td);
-                for (auto& n : getNeighs(gs, td)) {
-                    if (getTile(gs, n).exists)
-                        checkUnconnectedRecur(gs, n, vis2, uncons[k]);
-                }
-            }
-            for (int i = 0; i < todrops[k].count(); ++i)
-                addTile(gs, todrops[k].at(i), getTile(gs, todrops[k].at(i)), true, true);
-            if (!exists) todrops[k].acquire(pos);
-        }
-        int score = todrops[k].count() + uncons[k].count();
-        if (bestScore < score) {
-            bestScore = score;
-            bestK = k;
-        }
-    }
-    std::map<int, std::map<int, bool>> vis2;
-    addShakeRecur(gs, pos, vis2, thing, bestK, SHAKE_TIME, SHAKE_DEPTH);
-    gs.board.todrop = todrops[bestK];
-    gs.board.uncon = uncons[bestK];
+    PROFILE_ZONE("checkDrop");
+    dropAt(gs.board, pos, thing, gs.usr.n_params, minToDrop, gs.tmp.boardVersion);
 }
 
 void explodeBomb(GameState& gs, const ThingPos& pos_);
 
 void doDrop(GameState& gs, int minToDrop = 0, bool shatter = true, Vector2 vel = Vector2Zero()) {
     if (gs.board.todrop.count() >= minToDrop) {
+        auto& stats = gs.tmp.stats;
+        stats.drops += (gs.board.todrop.count() > 0);
+        stats.cascades += (gs.board.uncon.count() > 0);
+        stats.cascadeTiles += gs.board.uncon.count();
         for (int i = 0; i < gs.board.todrop.count(); ++i) {
             auto& td = gs.board.todrop.at(i);
             removeTile(gs, td);
             auto pixpos = getPixByPos(gs, td);
             if (shatter) {
-                addAnimation(gs, &gs.ga.p->splash, SPLASH_TIME, pixpos, COMBO_COLORS[gs.board.lastDropCombo - 1]);
-                playSound(gs, gs.ga.p->shatter[GetRandomValue(0, 1)]);
+                addAnimation(gs, &gs.ga.p->splash, SPLASH_TIME, pixpos, comboColor(gs.board.lastDropCombo));
+                playSound(gs, ASSET_SHATTER0, 2);
                 addShatteredParticles(gs, getTile(gs, td).thing, pixpos);
             } else {
                 addParticle(gs, getTile(gs, td).thing, getPixByPos(gs, td), vel);
             }
-            addScorePoints(gs, pixpos, COMBO_COLORS[gs.board.lastDropCombo - 1], gs.board.lastDropCombo);
+            addScorePoints(gs, pixpos, comboColor(gs.board.lastDropCombo), gs.board.lastDropCombo);
         }
         for (int i = 0; i < gs.board.uncon.count(); ++i) {
             auto& un = gs.board.uncon.at(i);
             removeTile(gs, un);
             auto pixpos = getPixByPos(gs, un);
             addParticle(gs, getTile(gs, un).thing, pixpos, Vector2Zero());
-            addScorePoints(gs, pixpos, COMBO_COLORS[gs.board.lastDropCombo - 1], gs.board.lastDropCombo);
+            addScorePoints(gs, pixpos, comboColor(gs.board.lastDropCombo), gs.board.lastDropCombo);
         }
     }
     gs.board.todrop.clear();
@@ -559,10 +1982,12 @@ void doDrop(GameState& gs, int minToDrop = 0, bool shatter = true, Vector2 vel =
 }
 
 void explodeBomb(GameState& gs, const ThingPos& pos) {
+    PROFILE_ZONE("explodeBomb");
+    gs.tmp.stats.bombs++;
     auto& thing = getTile(gs, pos).thing;
     auto pixpos = getPixByPos(gs, pos);
     addDrop(gs, pixpos);
-    playSound(gs, gs.ga.p->sndexp);
+    playSound(gs, ASSET_SNDEXP);
     addAnimation(gs, &gs.ga.p->explosion, EXPLOSION_TIME, pixpos);
     auto& tile = getTile(gs, pos);
     removeTile(gs, pos);
@@ -581,29 +2006,52 @@ void explodeBomb(GameState& gs, const ThingPos& pos) {
             auto nntile = getTile(gs, nn);
             if (nntile.exists) {
                 if (nntile.thing.bomb) {
-                    //triggerBomb(gs, nntile.pos);
-                    explodeBomb(gs, nntile.pos);
+                    //triggerBomb(gs, nn);
+                    explodeBomb(gs, nn);
                 } else {
-                    checkDrop(gs, nntile.pos, nntile.thing);
-                    doDrop(gs, 0, false, 300.0f * Vector2Normalize(getPixByPos(gs, nntile.pos) - pixpos));
+                    checkDrop(gs, nn, nntile.thing);
+                    doDrop(gs, 0, false, 300.0f * Vector2Normalize(getPixByPos(gs, nn) - pixpos));
                 }
             }
         }
     }
-    addScorePoints(gs, pixpos, COMBO_COLORS[gs.board.lastDropCombo - 1], gs.board.lastDropCombo);
+    addScorePoints(gs, pixpos, comboColor(gs.board.lastDropCombo), gs.board.lastDropCombo);
 }
 
 void checkBomb(GameState& gs, const ThingPos& pos) {
-    auto& tile = getTile(gs, pos);
-    if (tile.thing.triggered) {
-        tile.shake = std::clamp((getTime(gs) - tile.thing.triggerTime)/BOMB_TRIGGER_TIME, 0.0, 1.0);
-        if (getTime(gs) - tile.thing.triggerTime > BOMB_TRIGGER_TIME)
+    if (getTile(gs, pos).thing.bomb == BOMB_TRIGGERED) {
+        // a bomb that could not get a timer slot goes off right away
+        auto timer = findBombTimer(gs, pos);
+        double elapsed = timer ? (getTime(gs) - timer->triggerTime) : BOMB_TRIGGER_TIME * 2.0;
+        getShake(gs, pos) = std::clamp(elapsed / BOMB_TRIGGER_TIME, 0.0, 1.0);
+        if (elapsed > BOMB_TRIGGER_TIME)
             explodeBomb(gs, pos);
     }
 }
 
+void addCombo(GameState& gs, int d) {
+    gs.combo = std::clamp(gs.combo + d, 1, gs.tuning.maxCombo);
+    gs.tmp.stats.maxCombo = std::max(gs.tmp.stats.maxCombo, gs.combo);
+}
+
+// the first tile from row fromRow down whose centre is closer than sqrt(reachSqr) to p0 or p1, {-1, -1} if none is
+extern "C++" template <typename B>
+ThingPos findHit(const B& b, const BoardGeom& geom, int fromRow, Vector2 p0, Vector2 p1, float reachSqr) {
+    for (int i = fromRow; i < B::height; ++i) {
+        for (int j = 0; j < rowCells(b, i); ++j) {
+            if (b.things[i][j].exists) {
+                Vector2 tpos = geomPixByPos(geom, {i, j});
+                if (Vector2DistanceSqr(tpos, p0) < reachSqr || Vector2DistanceSqr(tpos, p1) < reachSqr)
+                    return {i, j};
+            }
+        }
+    }
+    return {-1, -1};
+}
+
 void flyBullet(GameState& gs, float delta)
 {
+    PROFILE_ZONE("flyBullet");
     if (gs.bullet.exists)
         gs.bullet.pos += gs.bullet.vel * delta;
     if (gs.bullet.pos.y + TILE_RADIUS < 0)
@@ -613,19 +2061,21 @@ void flyBullet(GameState& gs, float delta)
     auto bulpos = getPosByPix(gs, gs.bullet.pos);
 
     if (gs.bullet.rebouncing) {
-        gs.bullet.pos = GetSplinePointBezierQuad(gs.bullet.pos - Vector2{0, gs.board.pos}, gs.bullet.rebCp, gs.bullet.rebEnd, gs.bullet.rebounce) + Vector2{0, gs.board.pos};
+        float boardY = scrollPixels(gs.board.scroll);
+        gs.bullet.pos = GetSplinePointBezierQuad(gs.bullet.pos - Vector2{0, boardY}, gs.bullet.rebCp, gs.bullet.rebEnd, gs.bullet.rebounce) + Vector2{0, boardY};
         float prog = (float)(getTime(gs) - gs.bullet.rebTime)/BULLET_REBOUNCE_TIME;
         if (prog > 1.0f) {
             gs.bullet.exists = false;
-            addTile(gs, gs.bullet.lstEmp, Tile{true, gs.bullet.lstEmp, gs.bullet.thing});
-            doDrop(gs, N_TO_DROP);
+            addTile(gs, gs.bullet.lstEmp, Tile{true, gs.bullet.thing});
+            doDrop(gs, gs.tuning.nToDrop);
             gs.bullet.rebouncing = false;
         } else {
             gs.bullet.rebounce = easeOutBounce(prog);
         }
     } else if (gs.bullet.exists) {
+        PERF_PHASE(PERF_COLLISION);
         if (gs.bullet.pos.x - BULLET_RADIUS_H < brect.x || gs.bullet.pos.x + BULLET_RADIUS_H > brect.x + brect.width) {
-            playSound(gs, gs.ga.p->clang[GetRandomValue(0, 2)]);
+            playSound(gs, ASSET_CLANG0, 3);
             addAnimation(gs, &gs.ga.p->splash, SPLASH_TIME, gs.bullet.pos + Vector2{gs.bullet.vel.x/abs(gs.bullet.vel.x), 0});
             gs.bullet.vel.x *= -1.0f;
         }
@@ -633,43 +2083,508 @@ void flyBullet(GameState& gs, float delta)
         if (!getTile(gs, bulpos).exists)
             gs.bullet.lstEmp = {bulpos.row, bulpos.col};
 
+        // the scan resumes on the row after a hit, a bomb leaves the bullet to the rows below it
+        auto geom = getBoardGeom(gs);
+        for (ThingPos hit = {-1, 0}; !gs.bullet.rebouncing;) {
+            hit = findHit(gs.board, geom, hit.row + 1, gs.bullet.pos, gs.bullet.pos + Vector2Normalize(gs.bullet.vel) * BULLET_RADIUS_H, BULLET_HIT_DIST_SQR);
+            if (hit.row < 0)
+                break;
+            Vector2 tpos = geomPixByPos(geom, hit);
+            playSound(gs, ASSET_CLANG0, 3);
+            addAnimation(gs, &gs.ga.p->splash, SPLASH_TIME, 0.5f * (tpos + getPixByPos(gs, gs.bullet.lstEmp)));
+            gs.board.lastDropCombo = gs.combo;
+            if (getTile(gs, hit).thing.bomb) {
+                triggerBomb(gs, hit);
+                addCombo(gs, 1);
+                addScorePoints(gs, gs.bullet.pos, comboColor(gs.board.lastDropCombo), gs.board.lastDropCombo);
+            } else {
+                checkDrop(gs, gs.bullet.lstEmp, gs.bullet.thing, gs.tuning.nToDrop);
+                gs.bullet.rebouncing = true;
+                gs.bullet.rebounce = 0.0f;
+                gs.bullet.rebCp = (gs.bullet.pos - Vector2Normalize(gs.bullet.vel) * BULLET_REBOUNCE)- Vector2{0, scrollPixels(gs.board.scroll)};
+                gs.bullet.rebEnd = (getPixByPos(gs, gs.bullet.lstEmp)) - Vector2{0, scrollPixels(gs.board.scroll)};
+                gs.bullet.rebTime = getTime(gs);
+                addCombo(gs, (gs.board.todrop.count() >= gs.tuning.nToDrop) ? 1 : -1);
+            }
+        }
+    }
+}
+
+std::atomic<ThreadPool*>& plannerPoolSlot() {
+    static std::atomic<ThreadPool*> pool = nullptr;
+    return pool;
+}
+
+ThreadPool& plannerPool() {
+    return lazyPool(plannerPoolSlot(), PLAN_THREADS);
+}
+
+// the board and bullet values of the current frame, taken on the calling thread
+struct PlanFrame {
+    BoardGeom geom;
+    Vector2 gun;
+    float speed, halfWidth, hitSqr, dangerY;
+    float baseY;
+    std::array<uint16_t, BOARD_HEIGHT> rows;
+    TraceKey key;
+};
+
+PlanFrame getPlanFrame(const GameState& gs) {
+    auto geom = getBoardGeom(gs);
+    PlanFrame f = {geom, {(float)SCREEN_WIDTH * 0.5f, (float)SCREEN_HEIGHT - TILE_RADIUS}, BULLET_SPEED, BULLET_RADIUS_H, BULLET_HIT_DIST_SQR,
+        (SCREEN_HEIGHT - 2 * TILE_RADIUS) - TILE_RADIUS - geom.rowHeight, getBoardBaseY(gs)};
+    f.key = {f.gun.y - geom.rect.y, gs.usr.velEnabled ? TILE_PIXEL * (gs.usr.accEnabled ? gs.board.speed : BOARD_CONST_SPEED) : 0.0f,
+        (gs.board.moveTime > 0 && gs.board.scroll < 0) ? gs.board.moveTime : 0.0};
+    for (int i = 0; i < BOARD_HEIGHT; ++i) {
+        f.rows[i] = 0;
+        for (int j = 0; j < BOARD_WIDTH - ((i + geom.even) % 2); ++j)
+            f.rows[i] |= uint16_t(gs.board.things[i][j].exists) << j;
+    }
+    return f;
+}
+
+int cellIndex(const ThingPos& pos) {
+    return pos.row * BOARD_WIDTH + pos.col;
+}
+
+void setCellBit(std::array<uint64_t, PLAN_MASK_WORDS>& mask, const ThingPos& pos) {
+    int i = cellIndex(pos);
+    mask[i >> 6] |= 1ull << (i & 63);
+}
+
+float planAngle(int i) {
+    return -PI * 0.45f + PI * 0.9f * i / (PLAN_ANGLES - 1);
+}
+
+// coarse angles first, so a trace cut short by the budget still covers the whole range
+int planOrder(int i) {
+    int r = 0;
+    for (int b = 1; b < PLAN_ANGLES; b <<= 1, i >>= 1)
+        r = (r << 1) | (i & 1);
+    return r;
+}
+
+// the same substeps, wall bounces and hit test as flyBullet at 60 fps, and the board moves between frames as in updateOnce
+ShotTrace traceShot(const GameState& gs, const PlanFrame& f, float dir) {
+    ShotTrace t = {};
+    t.valid = true;
+    t.key = f.key;
+    auto geom = f.geom;
+    auto& rect = geom.rect;
+    int64_t boardScroll = gs.board.scroll;
+    float boardSpeed = gs.board.speed;
+    double moveTime = gs.board.moveTime;
+    float a = dir + PI * 0.5f;
+    float delta = PLAN_FRAME_DT / UPDATE_ITS;
+    Vector2 pos = f.gun;
+    Vector2 vel = f.speed * Vector2{cos(a), -sin(a)};
+    t.cell = geomPosByPix(geom, pos);
+    ThingPos marked = {-1, -1};
+    for (int step = 0; step < PLAN_MAX_STEPS; ++step) {
+        if (step > 0 && step % UPDATE_ITS == 0) {
+            moveBoard(gs, boardScroll, boardSpeed, moveTime, gs.board.totalMoveTime, true, PLAN_FRAME_DT);
+            rect.y = float(int(f.baseY + scrollPixels(boardScroll)));
+        }
+        pos += vel * delta;
+        if (pos.y + geom.radius < 0)
+            return t;
+        if (pos.x - f.halfWidth < rect.x || pos.x + f.halfWidth > rect.x + rect.width) {
+            vel.x *= -1.0f;
+            t.bounces++;
+        }
+        auto cell = geomPosByPix(geom, pos);
+        if (!((f.rows[cell.row] >> cell.col) & 1))
+            t.cell = cell;
+        Vector2 ahead = pos + Vector2Normalize(vel) * f.halfWidth;
+        // only tiles within two cells can be in reach, the existing ones are visited in flyBullet's order
+        bool mark = (cell.row != marked.row || cell.col != marked.col);
+        marked = cell;
+        for (int i = std::max(cell.row - 2, 0); i <= std::min(cell.row + 2, BOARD_HEIGHT - 1); ++i) {
+            int j0 = std::max(cell.col - 2, 0), j1 = std::min(cell.col + 2, BOARD_WIDTH - 1 - ((i + geom.even) % 2));
+            for (int j = j0; mark && j <= j1; ++j)
+                setCellBit(t.touched, {i, j});
+            for (uint32_t live = f.rows[i] & (((1u << (j1 - j0 + 1)) - 1) << j0); live; live &= live - 1) {
+                int j = std::countr_zero(live);
+                Vector2 tpos = geomPixByPos(geom, {i, j});
+                if (Vector2DistanceSqr(tpos, pos) < f.hitSqr || Vector2DistanceSqr(tpos, ahead) < f.hitSqr) {
+                    t.hit = {i, j};
+                    t.lands = true;
+                    t.bomb = gs.board.things[i][j].thing.bomb;
+                    return t;
+                }
+            }
+        }
+    }
+    return t;
+}
+
+// checkDrop without touching the board: the matching group around the cell, then what loses its way to the top row
+ShotOutcome evalLanding(GameState& gs, const ThingPos& cell, const Thing& thing, int nToDrop) {
+    ShotOutcome out = {};
+    out.valid = true;
+    setCellBit(out.read, cell);
+    std::array<ThingPos, Board::cells> stack;
+    for (int k = 0; k < gs.usr.n_params; ++k) {
+        Visited group = {};
+        group[cell.row][cell.col] = true;
+        int n = 0, top = 0, touching = 0, minRow = BOARD_HEIGHT;
+        stack[top++] = cell;
+        while (top > 0) {
+            auto pos = stack[--top];
+            for (auto& nb : getNeighs(gs, pos)) {
+                auto& tile = getTile(gs, nb);
+                setCellBit(out.read, nb);
+                if (group[nb.row][nb.col] || !tile.exists || !checkMatch(tile.thing, thing, k))
+                    continue;
+                touching += (pos.row == cell.row && pos.col == cell.col);
+                group[nb.row][nb.col] = true;
+                stack[top++] = nb;
+                minRow = std::min(minRow, nb.row);
+                n++;
+            }
+        }
+        out.touching = std::max<int>(out.touching, touching);
+        if (n + 1 < nToDrop)
+            continue;
+        // what falls depends on how the whole board hangs together
+        out.read.fill(~0ull);
+        Visited held = group;
+        top = 0;
+        // removing the group moves the top row down to the highest removed tile, as removeTile does
+        int anchor = std::min(gs.board.nFulRowsTop, minRow + 1) - 1;
+        for (int j = 0; anchor >= 0 && j < BOARD_WIDTH - ((anchor + gs.board.even) % 2); ++j) {
+            if (getTile(gs, {anchor, j}).exists && !held[anchor][j]) {
+                held[anchor][j] = true;
+                stack[top++] = {anchor, j};
+            }
+        }
+        while (top > 0) {
+            auto pos = stack[--top];
+            for (auto& nb : getNeighs(gs, pos)) {
+                if (!held[nb.row][nb.col] && getTile(gs, nb).exists) {
+                    held[nb.row][nb.col] = true;
+                    stack[top++] = nb;
+                }
+            }
+        }
+        int fallen = 0;
         for (int i = 0; i < BOARD_HEIGHT; ++i) {
             for (int j = 0; j < BOARD_WIDTH - ((i + gs.board.even) % 2); ++j) {
-                const auto& tile = gs.board.things[i][j];
-                if (tile.exists) {
-                    Vector2 tpos = getPixByPos(gs, {i, j});
-                    if (Vector2DistanceSqr(tpos, gs.bullet.pos) < BULLET_HIT_DIST_SQR ||
-                        Vector2DistanceSqr(tpos, gs.bullet.pos + Vector2Normalize(gs.bullet.vel) * BULLET_RADIUS_H) < BULLET_HIT_DIST_SQR) {
-                        playSound(gs, gs.ga.p->clang[GetRandomValue(0, 2)]);
-                        addAnimation(gs, &gs.ga.p->splash, SPLASH_TIME, 0.5f * (tpos + getPixByPos(gs, gs.bullet.lstEmp)));
-                        gs.board.lastDropCombo = gs.combo;
-                        if (tile.thing.bomb) {
-                            triggerBomb(gs, {i, j});
-                            gs.combo = std::clamp(gs.combo + 1, 1, MAX_COMBO);
-                            addScorePoints(gs, gs.bullet.pos, COMBO_COLORS[gs.board.lastDropCombo - 1], gs.board.lastDropCombo);
-                        } else {
-                            checkDrop(gs, gs.bullet.lstEmp, gs.bullet.thing, N_TO_DROP);
-                            gs.bullet.rebouncing = true;
-                            gs.bullet.rebounce = 0.0f;
-                            gs.bullet.rebCp = (gs.bullet.pos - Vector2Normalize(gs.bullet.vel) * BULLET_REBOUNCE)- Vector2{0, gs.board.pos};
-                            gs.bullet.rebEnd = (getPixByPos(gs, gs.bullet.lstEmp)) - Vector2{0, gs.board.pos};
-                            gs.bullet.rebTime = getTime(gs);
-                            if (gs.board.todrop.count() >= N_TO_DROP)
-                                gs.combo = std::clamp(gs.combo + 1, 1, MAX_COMBO);
-                            else
-                                gs.combo = std::clamp(gs.combo - 1, 1, MAX_COMBO);
+                if (!group[i][j] || (i == cell.row && j == cell.col))
+                    continue;
+                for (auto& nb : getNeighs(gs, {i, j})) {
+                    if (held[nb.row][nb.col] || !getTile(gs, nb).exists)
+                        continue;
+                    held[nb.row][nb.col] = true;
+                    stack[top++] = nb;
+                    while (top > 0) {
+                        auto pos = stack[--top];
+                        fallen++;
+                        for (auto& nn : getNeighs(gs, pos)) {
+                            if (!held[nn.row][nn.col] && getTile(gs, nn).exists) {
+                                held[nn.row][nn.col] = true;
+                                stack[top++] = nn;
+                            }
                         }
-                        break;
                     }
                 }
             }
-            if (gs.bullet.rebouncing)
-                break;
         }
+        if (n + 1 + fallen > out.popped + out.fallen) {
+            out.popped = n + 1;
+            out.fallen = fallen;
+        }
+    }
+    return out;
+}
+
+int countBlast(GameState& gs, const ThingPos& pos) {
+    Visited seen = {};
+    int n = 0;
+    seen[pos.row][pos.col] = true;
+    for (auto& nb : getNeighs(gs, pos)) {
+        for (auto& nn : getNeighs(gs, nb)) {
+            n += !seen[nn.row][nn.col] && getTile(gs, nn).exists;
+            seen[nn.row][nn.col] = true;
+        }
+        n += !seen[nb.row][nb.col] && getTile(gs, nb).exists;
+        seen[nb.row][nb.col] = true;
+    }
+    return n;
+}
+
+// a pop is worth its tiles, anything else loses the combo and is only worth the neighbours it builds on.
+// A shot out over the top does nothing while the board keeps coming, it ranks below every landing,
+// and hitting a bomb that is already ticking only restarts its timer
+int rateLanding(const PlanFrame& f, const ShotTrace& t, const ShotOutcome& o, int blast) {
+    if (!t.lands)
+        return -10;
+    if (t.bomb)
+        return (t.bomb == BOMB_ARMED) ? 10 * blast : 0;
+    if (o.popped)
+        return 10 * (o.popped + o.fallen);
+    bool danger = geomPixByPos(f.geom, t.cell).y > f.dangerY;
+    return 2 * o.touching - 5 - (danger ? 1000 : 0);
+}
+
+// traces are kept while the gun has moved at most PLAN_TRACE_SLACK pixels against the board and the board drifts
+// within that over a flight, the cells they report are board cells and rarely change that close. An ease in progress
+// changes every frame and has to match exactly
+bool closeKey(const TraceKey& a, const TraceKey& b) {
+    return fabs(a.gunY - b.gunY) <= PLAN_TRACE_SLACK && fabs(a.drift - b.drift) * PLAN_TRACE_FLIGHT <= PLAN_TRACE_SLACK && a.ease == b.ease;
+}
+
+// drops what the board, the things in hand or the rules changed since the last call
+void syncPlanner(GameState& gs, const PlanFrame& f, const Thing* things) {
+    auto& p = gs.tmp.planner;
+    std::array<uint64_t, PLAN_MASK_WORDS> changed = {};
+    bool boardChanged = !p.primed;
+    for (int i = 0; i < BOARD_HEIGHT; ++i) {
+        for (int j = 0; j < BOARD_WIDTH; ++j) {
+            if (memcmp(&p.board[i][j], &gs.board.things[i][j], sizeof(Tile))) {
+                setCellBit(changed, {i, j});
+                boardChanged = true;
+            }
+        }
+    }
+    bool reshaped = !p.primed || !sameShape(p.geom, f.geom);
+    for (auto& t : p.traces) {
+        bool hit = reshaped || !closeKey(t.key, f.key);
+        for (int w = 0; w < PLAN_MASK_WORDS && !hit; ++w)
+            hit = (t.touched[w] & changed[w]) != 0;
+        if (hit)
+            t.valid = false;
+    }
+    bool rules = !p.primed || p.nParams != gs.usr.n_params || p.nToDrop != gs.tuning.nToDrop || p.nFulRowsTop != gs.board.nFulRowsTop || p.geom.even != f.geom.even;
+    for (int s = 0; s < 2; ++s) {
+        bool all = rules || memcmp(&p.things[s], &things[s], sizeof(Thing));
+        for (auto& o : p.outcomes[s]) {
+            bool hit = all;
+            for (int w = 0; w < PLAN_MASK_WORDS && !hit; ++w)
+                hit = (o.read[w] & changed[w]) != 0;
+            if (hit)
+                o.valid = false;
+        }
+        p.things[s] = things[s];
+    }
+    p.rev += boardChanged;
+    p.board = gs.board.things;
+    p.geom = f.geom;
+    p.nParams = gs.usr.n_params;
+    p.nToDrop = gs.tuning.nToDrop;
+    p.nFulRowsTop = gs.board.nFulRowsTop;
+    p.primed = true;
+}
+
+// runs the jobs in chunks on the planner pool, or inline, each job checks the deadline first
+extern "C++" template <typename Job>
+void runPlanJobs(int n, bool parallel, Job&& job) {
+    if (!parallel || n <= PLAN_CHUNK) {
+        for (int i = 0; i < n; ++i)
+            job(i);
+        return;
+    }
+    auto& pool = plannerPool();
+    for (int b = 0; b < n; b += PLAN_CHUNK) {
+        pool.submit([&job, b, n] {
+            for (int i = b; i < std::min(b + PLAN_CHUNK, n); ++i)
+                job(i);
+        });
+    }
+    pool.wait();
+}
+
+// rates every gun angle for the armed thing and the one a swap would bring, best first into planner.best.
+// budgetMs <= 0 plans to the end, otherwise what is left over is finished by the next calls
+DLL_EXPORT int planShots(GameState& gs, float budgetMs, bool parallel)
+{
+    PROFILE_ZONE("planShots");
+    using PlanClock = std::chrono::steady_clock;
+    auto t0 = PlanClock::now();
+    auto deadline = t0 + std::chrono::microseconds(budgetMs > 0 ? int64_t(budgetMs * 1000.0f) : int64_t(1) << 40);
+    auto& p = gs.tmp.planner;
+    auto f = getPlanFrame(gs);
+    Thing things[2] = {gs.gun.armed, gs.gun.extraArmed ? gs.gun.extra : gs.gun.next};
+    syncPlanner(gs, f, things);
+
+    std::array<uint16_t, PLAN_ANGLES> todo;
+    int nTodo = 0;
+    for (int i = 0; i < PLAN_ANGLES; ++i)
+        if (!p.traces[planOrder(i)].valid)
+            todo[nTodo++] = (uint16_t)planOrder(i);
+    std::atomic<uint32_t> traced = 0;
+    runPlanJobs(nTodo, parallel, [&](int i) {
+        if (PlanClock::now() > deadline)
+            return;
+        p.traces[todo[i]] = traceShot(gs, f, planAngle(todo[i]));
+        traced.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    std::array<uint16_t, 2 * BOARD_WIDTH * BOARD_HEIGHT> cells;
+    int nCells = 0;
+    Visited queued[2] = {};
+    for (auto& t : p.traces) {
+        if (!t.valid || !t.lands || t.bomb)
+            continue;
+        for (int s = 0; s < 2; ++s) {
+            if (!p.outcomes[s][cellIndex(t.cell)].valid && !queued[s][t.cell.row][t.cell.col]) {
+                queued[s][t.cell.row][t.cell.col] = true;
+                cells[nCells++] = uint16_t(s * BOARD_WIDTH * BOARD_HEIGHT + cellIndex(t.cell));
+            }
+        }
+    }
+    std::atomic<uint32_t> evaluated = 0;
+    runPlanJobs(nCells, parallel, [&](int i) {
+        if (PlanClock::now() > deadline)
+            return;
+        int s = cells[i] / (BOARD_WIDTH * BOARD_HEIGHT), c = cells[i] % (BOARD_WIDTH * BOARD_HEIGHT);
+        p.outcomes[s][c] = evalLanding(gs, {c / BOARD_WIDTH, c % BOARD_WIDTH}, things[s], gs.tuning.nToDrop);
+        evaluated.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    // neighbouring angles that end the same way form one plan, aimed at their middle
+    p.nBest = 0;
+    p.complete = true;
+    bool sameThing = !memcmp(&things[0], &things[1], sizeof(Thing));
+    for (int s = 0; s < (sameThing ? 1 : 2); ++s) {
+        for (int i = 0; i < PLAN_ANGLES;) {
+            auto& t = p.traces[i];
+            int e = i + 1;
+            while (e < PLAN_ANGLES && p.traces[e].valid == t.valid && p.traces[e].lands == t.lands && p.traces[e].bomb == t.bomb &&
+                   p.traces[e].cell.row == t.cell.row && p.traces[e].cell.col == t.cell.col && (!t.bomb || (p.traces[e].hit.row == t.hit.row && p.traces[e].hit.col == t.hit.col)))
+                e++;
+            auto& o = p.outcomes[s][cellIndex(t.cell)];
+            if (!t.valid || (t.lands && !t.bomb && !o.valid)) {
+                p.complete = false;
+                i = e;
+                continue;
+            }
+            ShotOutcome none = {};
+            auto& use = (t.lands && !t.bomb) ? o : none;
+            ShotPlan plan = {planAngle((i + e - 1) / 2), s == 1, t.bomb != BOMB_NONE, t.cell, use.popped, use.fallen,
+                rateLanding(f, t, use, (t.bomb == BOMB_ARMED) ? countBlast(gs, t.hit) : 0), e - i};
+            auto better = [](const ShotPlan& a, const ShotPlan& b) { return a.rating != b.rating ? a.rating > b.rating : a.width > b.width; };
+            if (p.nBest < PLAN_TOP || better(plan, p.best[p.nBest - 1])) {
+                int k = std::min(p.nBest, PLAN_TOP - 1);
+                while (k > 0 && better(plan, p.best[k - 1])) {
+                    p.best[k] = p.best[k - 1];
+                    k--;
+                }
+                p.best[k] = plan;
+                p.nBest = std::min(p.nBest + 1, PLAN_TOP);
+            }
+            i = e;
+        }
+    }
+    p.nTraced = traced.load();
+    p.nEvaluated = evaluated.load();
+    p.ms = std::chrono::duration<float, std::milli>(PlanClock::now() - t0).count();
+    return p.nBest;
+}
+
+// straight runs between wall bounces, ending where the bullet first comes within reach of a tile or leaves over the top.
+// flyBullet also tests half a bullet ahead, which is the same as moving every tile back along the run. Bounces and the hit
+// are snapped to its 60 fps substeps, since it turns only once past the wall and that offset adds up over several bounces
+void traceAimPath(GameState& gs, AimPath& path, float dir) {
+    auto& geom = path.geom;
+    float halfWidth = BULLET_RADIUS_H, reachSqr = BULLET_HIT_DIST_SQR;
+    float stepLen = BULLET_SPEED * PLAN_FRAME_DT / UPDATE_ITS;
+    float a = dir + PI * 0.5f;
+    Vector2 d = {cos(a), -sin(a)};
+    Vector2 p = {(float)SCREEN_WIDTH * 0.5f, (float)SCREEN_HEIGHT - geom.radius};
+    float left = geom.rect.x + halfWidth, right = geom.rect.x + geom.rect.width - halfWidth;
+    path.points[0] = p;
+    path.nPoints = 1;
+    path.lands = false;
+    path.pops = 0;
+    for (int b = 0; b <= AIM_MAX_BOUNCES; ++b) {
+        float tWall = (d.x > 0) ? (right - p.x) / d.x : ((d.x < 0) ? (left - p.x) / d.x : std::numeric_limits<float>::max());
+        if (d.x != 0)
+            tWall = ceilf(tWall / stepLen) * stepLen;
+        float tTop = (-geom.radius - p.y) / d.y;
+        float tEnd = std::min(tWall, tTop), tHit = tEnd;
+        ThingPos hit = {-1, -1};
+        for (int i = 0; i < BOARD_HEIGHT; ++i) {
+            for (int j = 0; j < BOARD_WIDTH - ((i + geom.even) % 2); ++j) {
+                if (!gs.board.things[i][j].exists)
+                    continue;
+                Vector2 m = p - (geomPixByPos(geom, {i, j}) - d * halfWidth);
+                float bq = Vector2DotProduct(m, d), cq = Vector2DotProduct(m, m) - reachSqr;
+                if (cq > 0 && (bq > 0 || bq * bq < cq))
+                    continue;
+                float t = (cq > 0) ? -bq - sqrtf(bq * bq - cq) : 0.0f;
+                if (t < tHit) {
+                    tHit = t;
+                    hit = {i, j};
+                }
+            }
+        }
+        if (hit.row >= 0)
+            tHit = ceilf(tHit / stepLen) * stepLen;
+        p = p + d * tHit;
+        path.points[path.nPoints++] = p;
+        if (hit.row >= 0) {
+            // the landing cell is the last empty one the bullet passed through
+            path.cell = geomPosByPix(geom, p);
+            for (int k = 1; k < 8 && getTile(gs, path.cell).exists; ++k)
+                path.cell = geomPosByPix(geom, p - d * (stepLen * k));
+            path.lands = true;
+            auto& tile = getTile(gs, hit);
+            if (tile.thing.bomb)
+                path.pops = (tile.thing.bomb == BOMB_ARMED) ? countBlast(gs, hit) : 0;
+            else if (!getTile(gs, path.cell).exists) {
+                auto o = evalLanding(gs, path.cell, gs.gun.armed, gs.tuning.nToDrop);
+                path.pops = o.popped ? o.popped + o.fallen : 0;
+            }
+            return;
+        }
+        if (tTop <= tWall)
+            return;
+        d.x = -d.x;
+    }
+}
+
+// the path widened to a strip with mitred joins at the bounces, left edge first so the triangles face the screen
+void buildAimStrip(AimPath& path, float halfWidth) {
+    auto& pts = path.points;
+    int n = path.nPoints;
+    for (int i = 0; i < n; ++i) {
+        int in = std::max(i, 1), out = std::min(i + 1, n - 1);
+        Vector2 din = Vector2Normalize(pts[in] - pts[in - 1]), dout = Vector2Normalize(pts[out] - pts[out - 1]);
+        Vector2 nin = {din.y, -din.x}, nout = {dout.y, -dout.x};
+        Vector2 m = Vector2Normalize(nin + nout);
+        Vector2 off = m * (halfWidth / std::max(Vector2DotProduct(m, nin), 0.25f));
+        path.strip[2 * i] = pts[i] + off;
+        path.strip[2 * i + 1] = pts[i] - off;
+    }
+}
+
+// gun.dir is snapped to AIM_DIR_STEPS, each step has a slot in a small direct-mapped cache
+void updateAimPreview(GameState& gs) {
+    PROFILE_ZONE("updateAimPreview");
+    auto& aim = gs.tmp.aim;
+    int step = std::clamp((int)lroundf((gs.gun.dir + PI * 0.45f) / (PI * 0.9f) * (AIM_DIR_STEPS - 1)), 0, AIM_DIR_STEPS - 1);
+    auto geom = getBoardGeom(gs);
+    aim.cur = step % AIM_CACHE_SIZE;
+    auto& path = aim.paths[aim.cur];
+    if (path.step == step && path.boardVersion == gs.tmp.boardVersion && sameGeom(path.geom, geom) && !memcmp(&path.thing, &gs.gun.armed, sizeof(Thing)) &&
+        path.nParams == gs.usr.n_params && path.nToDrop == gs.tuning.nToDrop) {
+        aim.hits++;
+        return;
     }
+    aim.misses++;
+    path.step = step;
+    path.boardVersion = gs.tmp.boardVersion;
+    path.geom = geom;
+    path.thing = gs.gun.armed;
+    path.nParams = gs.usr.n_params;
+    path.nToDrop = gs.tuning.nToDrop;
+    traceAimPath(gs, path, -PI * 0.45f + PI * 0.9f * step / (AIM_DIR_STEPS - 1));
+    buildAimStrip(path, TILE_PIXEL);
 }
 
 void flyScorePoints(GameState& gs) {
+    PROFILE_ZONE("flyScorePoints");
     bool someNotDone = false;
     for (int i = 0; i < gs.tmp.scorePoints.count(); ++i) {
         auto& sp = gs.tmp.scorePoints.at(i);
@@ -678,10 +2593,7 @@ void flyScorePoints(GameState& gs) {
         if (sp.done) {
             if (!wasDone) {
                 gs.tmp.visScore++;
-                if (getTime(gs) - gs.tmp.lastScoreSnd > SCORE_SND_CD) {
-                    playSound(gs, gs.ga.p->pop[GetRandomValue(0, 1)]);
-                    gs.tmp.lastScoreSnd = getTime(gs);
-                }
+                playSound(gs, ASSET_POP0, 2);
             }
         } else {
             someNotDone = true;
@@ -692,13 +2604,15 @@ void flyScorePoints(GameState& gs) {
 }
 
 void flyParticles(GameState& gs) {
+    PROFILE_ZONE("flyParticles");
+    PERF_PHASE(PERF_PARTICLES);
     bool someInFrame = false;
     for (int i = 0; i < gs.tmp.particles.count(); ++i) {
         auto& prt = gs.tmp.particles.at(i);
         if (prt.exists) {
             prt.pos += prt.vel * getFrameTime(gs);
             prt.vel += GRAVITY * Vector2{0.0f, 1.0f} * getFrameTime(gs);
-            if (prt.pos.y < GetScreenHeight())
+            if (prt.pos.y < SCREEN_HEIGHT)
                 someInFrame = true;
         }
     }
@@ -712,62 +2626,283 @@ void checkDrops(GameState& gs) {
         if (getTime(gs) - gs.tmp.shDropTimes[i] < WAVE_FADE_TIME) {
             someStillGoing = true;
             break;
-        }
+        }
+    }
+    if (!someStillGoing)
+        gs.tmp.shNDrops = 0;
+}
+
+void checkAnimations(GameState& gs) {
+    bool someStillGoing = false;
+    for (int i = 0; i < gs.tmp.animations.count(); ++i) {
+        auto& anim = gs.tmp.animations.at(i);
+        if (!anim.done) {
+            anim.done = ((getTime(gs) - anim.startTime) / anim.interval > 1.0f);
+            someStillGoing = true;
+        }
+    }
+    if (!someStillGoing)
+        gs.tmp.animations.clear();
+}
+
+void gameOver(GameState& gs) {
+    gs.gameOver = true;
+    gs.gameOverTime = getTime(gs);
+    gs.bullet.exists = false;
+    Vector2 gunPos = {(float)SCREEN_WIDTH * 0.5f, (float)SCREEN_HEIGHT - TILE_RADIUS};
+    addParticle(gs, gs.gun.armed, gunPos, Vector2{50.0f * RAND_FLOAT_SIGNED, -400.0f - 100.0f * RAND_FLOAT});
+    addParticle(gs, gs.gun.next, {SCREEN_WIDTH - TILE_RADIUS, SCREEN_HEIGHT - TILE_RADIUS}, Vector2{50.0f * RAND_FLOAT_SIGNED, -400.0f - 100.0f * RAND_FLOAT});
+    if (gs.gun.extraArmed)
+        addParticle(gs, gs.gun.extra, {TILE_RADIUS, SCREEN_HEIGHT - TILE_RADIUS}, Vector2{50.0f * RAND_FLOAT_SIGNED, -400.0f - 100.0f * RAND_FLOAT});
+    if (!gs.alteredDifficulty && gs.score > gs.usr.bestScore) {
+        gs.usr.bestScore = gs.score;
+        saveUserData(gs);
+    }
+    playSound(gs, ASSET_FAIL);
+    playSound(gs, ASSET_SHAKE);
+    auto& a = gs.tmp.audio.stats;
+    TraceLog(LOG_DEBUG, "HEX: sounds requested %llu, played %llu (coalesced %llu, limited %llu, dropped %llu, stolen %llu), peak %u voices, mix %.2f",
+        (unsigned long long)a.requested, (unsigned long long)a.played, (unsigned long long)a.coalesced, (unsigned long long)a.limited,
+        (unsigned long long)a.dropped, (unsigned long long)a.stolen, a.peakVoices, a.peakMix);
+}
+
+float getAimDir(const GameState& gs, Vector2 mpos) {
+    Vector2 gunPos = {(float)SCREEN_WIDTH * 0.5f, (float)SCREEN_HEIGHT - TILE_RADIUS};
+    return atan2(gunPos.y - mpos.y, mpos.x - gunPos.x) - PI * 0.5f;
+}
+
+void queueInput(GameState& gs, InputType type, double time, float value = 0.0f, ThingPos pos = {}) {
+    if (gs.tmp.inputs.count() < gs.tmp.inputs.capacity())
+        gs.tmp.inputs.acquire(InputEvent{type, time, value, pos});
+}
+
+// raylib only exposes the input state once per frame, so discrete events are stamped
+// at the middle of the polling interval and mouse aiming is interpolated across it
+void pollInputs(GameState& gs) {
+    PROFILE_ZONE("pollInputs");
+    double now = getTime(gs);
+    double prv = (gs.tmp.lastPollTime > 0 && gs.tmp.lastPollTime < now) ? gs.tmp.lastPollTime : (now - getFrameTime(gs));
+    double mid = 0.5 * (prv + now);
+    auto mpos = GetMousePosition();
+    bool bottom = mpos.y > SCREEN_HEIGHT - TILE_RADIUS * 2.0f;
+
+#ifdef PLATFORM_ANDROID
+    bool aiming = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
+    bool fire = IsMouseButtonReleased(MOUSE_BUTTON_LEFT);
+    bool swap = (GetTouchPointCount() == 2 && gs.tmp.lastTouchCount == 1) || (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && bottom);
+    bool track = aiming;
+#else
+    bool aiming = fabs(GetMouseDelta().x) > 0;
+    bool fire = IsKeyPressed(KEY_SPACE) || IsMouseButtonPressed(MOUSE_BUTTON_LEFT);
+    bool swap = IsKeyPressed(KEY_LEFT_CONTROL) || IsMouseButtonPressed(MOUSE_BUTTON_RIGHT) || (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && bottom);
+    bool track = true;
+#endif
+
+    if (aiming) {
+        if (gs.tmp.mouseTracked) {
+            for (int i = 1; i <= UPDATE_ITS; ++i) {
+                float t = float(i) / UPDATE_ITS;
+                queueInput(gs, INPUT_AIM, prv + (now - prv) * t, getAimDir(gs, gs.tmp.lastMousePos + (mpos - gs.tmp.lastMousePos) * t));
+            }
+        } else {
+            queueInput(gs, INPUT_AIM, mid, getAimDir(gs, mpos));
+        }
+    }
+    gs.tmp.lastMousePos = mpos;
+    gs.tmp.mouseTracked = track;
+
+    int turn = IsKeyDown(KEY_LEFT) ? 1 : (IsKeyDown(KEY_RIGHT) ? -1 : 0);
+    if (turn != gs.tmp.lastTurn)
+        queueInput(gs, INPUT_TURN, mid, (float)turn);
+    gs.tmp.lastTurn = turn;
+
+    if (gs.gameOver) {
+        if (fire)
+            queueInput(gs, INPUT_FIRE, mid);
+    } else {
+        if (IsKeyDown(KEY_LEFT_CONTROL)) {
+            if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+                queueInput(gs, INPUT_ADD_TILE, mid, 0.0f, getPosByPix(gs, mpos));
+            else if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT))
+                queueInput(gs, INPUT_REMOVE_TILE, mid, 0.0f, getPosByPix(gs, mpos));
+        } else if (fire && !bottom) {
+            queueInput(gs, INPUT_FIRE, mid);
+        }
+        if (swap)
+            queueInput(gs, INPUT_SWAP, mid);
+        if (IsKeyPressed(KEY_Q))
+            queueInput(gs, INPUT_PARAMS, mid);
+        if (IsKeyPressed(KEY_Z))
+            queueInput(gs, INPUT_DIFFICULTY, mid);
+    }
+    if (IsKeyPressed(KEY_REWIND))
+        queueInput(gs, INPUT_REWIND, mid, IsKeyDown(KEY_LEFT_SHIFT) ? -REWIND_SECONDS : 1.0f);
+    gs.tmp.lastTouchCount = GetTouchPointCount();
+    gs.tmp.lastPollTime = now;
+
+    // few events per frame, a stable insertion sort keeps same-time events in polling order
+    auto evs = gs.tmp.inputs.data();
+    for (int i = 1; i < gs.tmp.inputs.count(); ++i)
+        for (int j = i; j > 0 && evs[j - 1].time > evs[j].time; --j)
+            std::swap(evs[j - 1], evs[j]);
+}
+
+void recordInputLatency(GameState& gs, float latency) {
+    gs.tmp.inputLatencies[gs.tmp.nInputLatencies % INPUT_LATENCY_SAMPLES] = latency;
+    gs.tmp.nInputLatencies++;
+}
+
+float getInputLatencyPercentile(const GameState& gs, float p) {
+    size_t n = std::min(gs.tmp.nInputLatencies, (size_t)INPUT_LATENCY_SAMPLES);
+    if (n == 0)
+        return 0.0f;
+    auto samples = gs.tmp.inputLatencies;
+    size_t k = std::min(n - 1, size_t(p * n));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.begin() + n);
+    return samples[k];
+}
+
+void reportInputLatency(GameState& gs) {
+    if (gs.tmp.nInputLatencies == 0 || getTime(gs) - gs.tmp.lastLatencyReport < INPUT_LATENCY_REPORT_TIME)
+        return;
+    TraceLog(LOG_INFO, "HEX: input->sim latency p50 %.2fms p90 %.2fms p99 %.2fms (%d events)",
+        1000.0f * getInputLatencyPercentile(gs, 0.5f), 1000.0f * getInputLatencyPercentile(gs, 0.9f),
+        1000.0f * getInputLatencyPercentile(gs, 0.99f), (int)gs.tmp.nInputLatencies);
+    gs.tmp.lastLatencyReport = getTime(gs);
+}
+
+void probeStage(const GameState& gs, ProbeStage stage) {
+    auto& probe = gs.tmp.probe;
+    if (!probe.pending || stage != probe.stage + 1)
+        return;
+    probe.stamps[stage] = getWallTime(gs);
+    probe.stage = stage;
+    if (stage == PROBE_PRESENT) {
+        auto& smp = probe.samples[probe.nSamples % LATENCY_PROBE_SAMPLES];
+        for (int i = PROBE_SIM; i < PROBE_STAGES; ++i)
+            smp[i - 1] = float(1000.0 * (probe.stamps[i] - probe.stamps[PROBE_INPUT]));
+        probe.nSamples++;
+        probe.pending = false;
+    }
+}
+
+// only aims are followed, the aim draw stage is where they show up
+void probeInput(GameState& gs, const InputEvent& ev) {
+    auto& probe = gs.tmp.probe;
+    if (!probe.enabled || probe.pending || ev.type != INPUT_AIM)
+        return;
+    probe.pending = true;
+    probe.stage = PROBE_INPUT;
+    probe.stamps[PROBE_INPUT] = ev.time;
+    probeStage(gs, PROBE_SIM);
+}
+
+void dumpLatencyProbe(const GameState& gs) {
+    const auto& probe = gs.tmp.probe;
+    size_t n = std::min(probe.nSamples, (size_t)LATENCY_PROBE_SAMPLES);
+    std::string csv = "sim_ms,aim_draw_ms,render_tex_ms,present_ms\n";
+    for (size_t i = probe.nSamples - n; i < probe.nSamples; ++i) {
+        const auto& smp = probe.samples[i % LATENCY_PROBE_SAMPLES];
+        csv += TextFormat("%.3f,%.3f,%.3f,%.3f\n", smp[0], smp[1], smp[2], smp[3]);
+    }
+    SaveFileText(LATENCY_PROBE_FILE, (char*)csv.c_str());
+    TraceLog(LOG_INFO, "HEX: %d latency samples written to %s", (int)n, LATENCY_PROBE_FILE);
+}
+
+void toggleLatencyProbe(GameState& gs) {
+    auto& probe = gs.tmp.probe;
+    probe.enabled = !probe.enabled;
+    probe.pending = false;
+    if (probe.enabled)
+        probe.nSamples = 0;
+    else if (probe.nSamples > 0)
+        dumpLatencyProbe(gs);
+}
+
+void applyInput(GameState& gs, const InputEvent& ev) {
+    switch (ev.type) {
+        case INPUT_AIM:
+            gs.gun.dir = ev.value;
+            break;
+        case INPUT_TURN:
+            gs.gun.turn = (int8_t)ev.value;
+            break;
+        case INPUT_FIRE:
+            if (gs.gameOver) {
+                if (getTime(gs) > gs.gameOverTime + GAME_OVER_TIMEOUT)
+                    reset(gs);
+            } else if (!gs.bullet.exists) {
+                shootAndRearm(gs);
+            }
+            break;
+        case INPUT_SWAP:
+            swapExtra(gs);
+            break;
+        case INPUT_ADD_TILE:
+            addTile(gs, ev.pos, Tile{(ev.pos.col != (BOARD_WIDTH - 1)) || ((ev.pos.row + gs.board.even) % 2 == 0),
+                                   {(unsigned char)getRandVal(gs, 0, COLORS.size() - 1), (unsigned char)getRandVal(gs, 0, COLORS.size() - 1), (unsigned char)getRandVal(gs, 0, COLORS.size() - 1)}});
+            break;
+        case INPUT_REMOVE_TILE:
+            removeTile(gs, ev.pos);
+            break;
+        case INPUT_PARAMS:
+            gs.usr.n_params = (gs.usr.n_params % 3) + 1;
+            break;
+        case INPUT_DIFFICULTY:
+            if (gs.usr.accEnabled)
+                gs.usr.accEnabled = false;
+            else
+                gs.usr.velEnabled = false;
+            break;
+        case INPUT_REWIND:
+            rewindState(gs, ev.value);
+            break;
     }
-    if (!someStillGoing)
-        gs.tmp.shNDrops = 0;
 }
 
-void checkAnimations(GameState& gs) {
-    bool someStillGoing = false;
-    for (int i = 0; i < gs.tmp.animations.count(); ++i) {
-        auto& anim = gs.tmp.animations.at(i);
-        if (!anim.done) {
-            anim.done = ((getTime(gs) - anim.startTime) / anim.interval > 1.0f);
-            someStillGoing = true;
-        }
-    }
-    if (!someStillGoing)
-        gs.tmp.animations.clear();
+// substeps split the frame evenly and end at the sampled frame time
+double getTickTime(const GameState& gs, int tick) {
+    double tickStart = getTime(gs) - getFrameTime(gs);
+    return tickStart + (tick + 1) * (getFrameTime(gs) / UPDATE_ITS);
 }
 
-void gameOver(GameState& gs) {
-    gs.gameOver = true;
-    gs.gameOverTime = getTime(gs);
-    gs.bullet.exists = false;
-    Vector2 gunPos = {(float)GetScreenWidth() * 0.5f, (float)GetScreenHeight() - TILE_RADIUS};
-    addParticle(gs, gs.gun.armed, gunPos, Vector2{50.0f * RAND_FLOAT_SIGNED, -400.0f - 100.0f * RAND_FLOAT});
-    addParticle(gs, gs.gun.next, {GetScreenWidth() - TILE_RADIUS, GetScreenHeight() - TILE_RADIUS}, Vector2{50.0f * RAND_FLOAT_SIGNED, -400.0f - 100.0f * RAND_FLOAT});
-    if (gs.gun.extraArmed)
-        addParticle(gs, gs.gun.extra, {TILE_RADIUS, GetScreenHeight() - TILE_RADIUS}, Vector2{50.0f * RAND_FLOAT_SIGNED, -400.0f - 100.0f * RAND_FLOAT});
-    if (!gs.alteredDifficulty && gs.score > gs.usr.bestScore) {
-        gs.usr.bestScore = gs.score;
-        saveUserData(gs);
+// applies the queued events up to the time of the given substep, returns true if the gun was aimed
+bool applyInputs(GameState& gs, int tick) {
+    double tickTime = getTickTime(gs, tick);
+    bool aimed = false;
+    while (gs.tmp.nInputsApplied < gs.tmp.inputs.count()) {
+        auto ev = gs.tmp.inputs.get(gs.tmp.nInputsApplied);
+        if (ev.time > tickTime)
+            break;
+        gs.tmp.nInputsApplied++;
+        aimed |= (ev.type == INPUT_AIM);
+        // against the clock as it is now, the frame time is what the event stamps were made from
+        recordInputLatency(gs, float(getWallTime(gs) - ev.time));
+        probeInput(gs, ev);
+        recordReplayEvent(gs, ev, tick);
+        applyInput(gs, ev);
     }
-    playSound(gs, gs.ga.p->fail);
-    playSound(gs, gs.ga.p->shake);
+    return aimed;
+}
+
+void clearInputs(GameState& gs) {
+    gs.tmp.inputs.clear();
+    gs.tmp.nInputsApplied = 0;
 }
 
-void update(GameState& gs)
+void update(GameState& gs, int tick)
 {
+    PROFILE_ZONE("update");
     if (gs.gameStartTime + GAME_START_TIME < getTime(gs)) {
         auto delta = getFrameTime(gs) / UPDATE_ITS;
 
-#ifdef PLATFORM_ANDROID
-        if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
-#else
-        if (fabs(GetMouseDelta().x) > 0) {
-#endif
-            Vector2 gunPos = {(float)GetScreenWidth() * 0.5f, (float)GetScreenHeight() - TILE_RADIUS};
-            gs.gun.dir = atan2(gunPos.y - GetMouseY(), GetMouseX() - gunPos.x) - PI * 0.5f;
-        } else if (IsKeyDown(KEY_LEFT)) {
-            gs.gun.dir += gs.gun.speed * delta;
-            gs.gun.speed += GUN_ACC * delta;
-        } else if (IsKeyDown(KEY_RIGHT)) {
-            gs.gun.dir -= gs.gun.speed * delta;
-            gs.gun.speed += GUN_ACC * delta;
-        } else {
-            gs.gun.speed = GUN_START_SPEED;
+        if (!applyInputs(gs, tick)) {
+            if (gs.gun.turn != 0) {
+                gs.gun.dir += gs.gun.turn * gs.gun.speed * delta;
+                gs.gun.speed += GUN_ACC * delta;
+            } else {
+                gs.gun.speed = GUN_START_SPEED;
+            }
         }
         gs.gun.speed = std::clamp(gs.gun.speed, GUN_START_SPEED, GUN_FULL_SPEED);
         gs.gun.dir = std::clamp(gs.gun.dir, -PI * 0.45f, PI * 0.45f);
@@ -778,6 +2913,7 @@ void update(GameState& gs)
 
 void updateOnce(GameState& gs)
 {
+    PROFILE_ZONE("updateOnce");
     if (gs.gameOver) {
         for (int i = 0; i < BOARD_HEIGHT; ++i) {
             for (int j = 0; j < BOARD_WIDTH - ((i + gs.board.even) % 2); ++j) {
@@ -785,35 +2921,28 @@ void updateOnce(GameState& gs)
                 if (tile.exists) {
                     if ((getTime(gs) - gs.gameOverTime) > (GAME_OVER_TIME_PER_ROW * (BOARD_HEIGHT - 1 - i))) {
                         gs.board.things[i][j].exists = false;
+                        gs.tmp.boardVersion++;
                         Vector2 tpos = getPixByPos(gs, {i, j});
                         if (tpos.y > 0) {
-                            playSound(gs, gs.ga.p->clang[GetRandomValue(0, 2)]);
+                            playSound(gs, ASSET_CLANG0, 3);
                             addParticle(gs, gs.board.things[i][j].thing, getPixByPos(gs, {i, j}), Vector2{50.0f * RAND_FLOAT_SIGNED, -400.0f - 100.0f * RAND_FLOAT});
                         }
                     }
                 }
             }
         }
-        if (getTime(gs) > gs.gameOverTime + GAME_OVER_TIMEOUT) {
-#ifdef PLATFORM_ANDROID
-            if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT))
-#else
-            if ((IsKeyPressed(KEY_SPACE) || IsMouseButtonPressed(MOUSE_BUTTON_LEFT)))
-#endif
-                reset(gs);
-
-        }
     } else if (gs.gameStartTime + GAME_START_TIME < getTime(gs)) {
         for (int i = 0; i < BOARD_HEIGHT; ++i) {
             for (int j = 0; j < BOARD_WIDTH - ((i + gs.board.even) % 2); ++j) {
-                Tile& tile = gs.board.things[i][j];
+                const Tile& tile = gs.board.things[i][j];
                 if (tile.exists) {
-                    if (tile.shake < SHAKE_TIME || gs.board.todrop.count() < N_TO_DROP - 1)
-                        tile.shake = std::max(tile.shake - getFrameTime(gs), 0.0f);
+                    float& shake = gs.board.shakes[i][j];
+                    if (shake < SHAKE_TIME || gs.board.todrop.count() < gs.tuning.nToDrop - 1)
+                        shake = std::max(shake - getFrameTime(gs), 0.0f);
                     else
-                        tile.shake = std::min(tile.shake + getFrameTime(gs) * 2, MAX_SHAKE);
+                        shake = std::min(shake + getFrameTime(gs) * 2, MAX_SHAKE);
                     Vector2 tpos = getPixByPos(gs, {i, j});
-                    if ((GetScreenHeight() - 2 * TILE_RADIUS) - (tpos.y + TILE_RADIUS) < 0)
+                    if ((SCREEN_HEIGHT - 2 * TILE_RADIUS) - (tpos.y + TILE_RADIUS) < 0)
                         gameOver(gs);
                     if (tile.thing.bomb)
                         checkBomb(gs, {i, j});
@@ -821,70 +2950,229 @@ void updateOnce(GameState& gs)
             }
         }
 
-        if (IsKeyDown(KEY_LEFT_CONTROL)) {
-            auto mpos = getPosByPix(gs, {(float)GetMouseX(), (float)GetMouseY()});
-            if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-                addTile(gs, mpos, Tile{(mpos.col != (BOARD_WIDTH - 1)) || ((mpos.row + gs.board.even) % 2 == 0), {mpos.row, mpos.col},
-                                       {(unsigned char)getRandVal(gs, 0, COLORS.size() - 1), (unsigned char)getRandVal(gs, 0, COLORS.size() - 1), (unsigned char)getRandVal(gs, 0, COLORS.size() - 1)}});
-            } else if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT)) {
-                removeTile(gs, mpos);
-            }
-        }
+        auto& b = gs.board;
+        moveBoard(gs, b.scroll, b.speed, b.moveTime, b.totalMoveTime, gs.firstShotFired, getFrameTime(gs));
 
-        if (!IsKeyDown(KEY_LEFT_CONTROL) && GetMouseY() < GetScreenHeight() - TILE_RADIUS * 2.0f) {
-#ifdef PLATFORM_ANDROID
-            if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT) && !gs.bullet.exists)
-#else
-            if ((IsKeyPressed(KEY_SPACE) || IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) && !gs.bullet.exists)
-#endif
-                shootAndRearm(gs);
-        }
+        checkLines(gs);
+    }
+}
 
-        static int touchCount = 0;
-#ifdef PLATFORM_ANDROID
-        if ((GetTouchPointCount() == 2 && touchCount == 1) || (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && GetMouseY() > GetScreenHeight() - TILE_RADIUS * 2.0f))
-#else
-        if (IsKeyPressed(KEY_LEFT_CONTROL) || IsMouseButtonPressed(MOUSE_BUTTON_RIGHT) || (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && GetMouseY() > GetScreenHeight() - TILE_RADIUS * 2.0f))
-#endif
-            swapExtra(gs);
-        touchCount = GetTouchPointCount();
+// eased settings mark the running game, its score does not count for the best score
+void checkDifficulty(GameState& gs) {
+    if (!gs.usr.velEnabled || !gs.usr.accEnabled || (gs.usr.n_params == 1))
+        gs.alteredDifficulty = true;
+}
 
-        if (gs.board.moveTime > 0 && gs.board.pos < 0) {
-            gs.board.pos = gs.board.pos * (1.0f - easeOutQuad(1.0f - gs.board.moveTime/gs.board.totalMoveTime));
-            gs.board.moveTime -= getFrameTime(gs);
-        }
+// runs the substeps over the queued input events and the once-per-frame update
+void simulate(GameState& gs) {
+    recordReplayFrame(gs);
+    for (int i = 0; i < UPDATE_ITS; ++i)
+        update(gs, i);
+    clearInputs(gs);
+    updateOnce(gs);
+    auto& ring = gs.tmp.rewind;
+    if (!gs.gameOver && (ring.count() == 0 || getTime(gs) - ring.get(ring.count() - 1).time >= REWIND_INTERVAL))
+        recordRewind(gs, false);
+}
 
-        if (IsKeyPressed(KEY_Q))
-            gs.usr.n_params = (gs.usr.n_params % 3) + 1;
+#ifdef HEX_HEADLESS
+const GameAssets HEADLESS_ASSETS = {};
 
-        if (gs.firstShotFired) {
-            if (gs.usr.velEnabled)
-                gs.board.pos += TILE_PIXEL * (gs.usr.accEnabled ? gs.board.speed : BOARD_CONST_SPEED) * getFrameTime(gs);
-            if (gs.usr.accEnabled)
-                gs.board.speed += BOARD_ACC * getFrameTime(gs);
-        }
+DLL_EXPORT void initHeadless(GameState& gs, unsigned int seed) {
+    gs.ga.p = &HEADLESS_ASSETS;
+    resetSeeded(gs, seed);
+}
 
-        if (IsKeyPressed(KEY_Z)) {
-            if (gs.usr.accEnabled)
-                gs.usr.accEnabled = false;
-            else
-                gs.usr.velEnabled = false;
-        }
+// for hosts that load the module and only know GameState by pointer, the state is made and freed on this side
+DLL_EXPORT GameState* createHeadless(unsigned int seed) {
+    auto gs = new GameState();
+    initHeadless(*gs, seed);
+    return gs;
+}
 
-        checkLines(gs);
+DLL_EXPORT void destroyHeadless(GameState* gs) {
+    delete gs;
+}
+
+// aims and fires at the current time, the next step applies both
+DLL_EXPORT void shootHeadless(GameState& gs, float dir) {
+    queueInput(gs, INPUT_AIM, getTime(gs), dir);
+    queueInput(gs, INPUT_FIRE, getTime(gs));
+}
+
+DLL_EXPORT uint64_t hashHeadless(const GameState& gs) {
+    return stateHash(gs);
+}
+
+DLL_EXPORT void stepHeadless(GameState& gs, float dt) {
+    gs.time += dt;
+    gs.tmp.frameTime = dt;
+    checkDifficulty(gs);
+    simulate(gs);
+    flyParticles(gs);
+    flyScorePoints(gs);
+    checkDrops(gs);
+    checkAnimations(gs);
+    flushSounds(gs);
+}
+
+bool readReplayEvent(GameState& gs, ReplayReader& in, ReplayCodec& codec) {
+    uint8_t b;
+    if (!in.getByte(b))
+        return false;
+    auto type = InputType(b & 0xf);
+    int tick = b >> 4;
+    float value = 0.0f;
+    ThingPos pos = {};
+    int64_t v, row, col;
+    uint64_t u;
+    switch (type) {
+        case INPUT_AIM:
+            if (!in.getSigned(v))
+                return false;
+            codec.aimBits = uint32_t(int64_t(codec.aimBits) + v);
+            value = std::bit_cast<float>(codec.aimBits);
+            break;
+        case INPUT_TURN:
+            if (!in.getSigned(v))
+                return false;
+            value = (float)v;
+            break;
+        case INPUT_ADD_TILE:
+        case INPUT_REMOVE_TILE:
+            if (!in.getSigned(row) || !in.getSigned(col))
+                return false;
+            pos = {(int)row, (int)col};
+            break;
+        case INPUT_REWIND:
+            if (!in.getVarint(u))
+                return false;
+            value = std::bit_cast<float>(uint32_t(u));
+            break;
+        default:
+            break;
+    }
+    if (type > INPUT_REWIND || tick >= UPDATE_ITS)
+        return false;
+    queueInput(gs, type, getTickTime(gs, tick), value, pos);
+    return true;
+}
+
+const char* replayResultName(ReplayResult r) {
+    switch (r) {
+        case REPLAY_OK: return "ok";
+        case REPLAY_MISMATCH: return "mismatch";
+        case REPLAY_UNFINISHED: return "unfinished";
+        default: return "bad_file";
+    }
+}
+
+void runReplayFrame(GameState& gs) {
+    checkDifficulty(gs);
+    simulate(gs);
+}
+
+// runs a recording through the simulation as fast as it decodes, presentation updates are skipped.
+// The file is read front to back once, records of a frame are queued until the next frame starts
+ReplayReport playReplay(GameState& gs, ReplayReader& in) {
+    ReplayReport rep = {REPLAY_BAD_FILE};
+    ReplayHeader hdr;
+    if (!in.getBytes(&hdr, sizeof(hdr)) || hdr.magic != REPLAY_MAGIC || hdr.version != REPLAY_VERSION)
+        return rep;
+    // a state from another build would be migrated rather than restored and the replay would drift
+    if (hdr.layoutHash != STATE_LAYOUT_HASH || hdr.stateSize != STATE_BLOB_SIZE)
+        return rep;
+    initHeadless(gs, 0);
+    std::vector<char> blob(hdr.stateSize);
+    if (!in.getBytes(blob.data(), blob.size()) || !importState(gs, blob.data(), blob.size()))
+        return rep;
+    unpackSettings(gs, hdr.settings);
+    double start = gs.time;
+
+    ReplayCodec codec = {};
+    codec.settings = hdr.settings;
+    rep.result = REPLAY_UNFINISHED;
+    bool pending = false, ok = true;
+    uint8_t tag;
+    while (ok && in.getByte(tag)) {
+        if (pending && (tag == REPLAY_FRAME || tag == REPLAY_END)) {
+            runReplayFrame(gs);
+            pending = false;
+        }
+        int64_t dTime, dDt, score;
+        uint64_t u;
+        switch (tag) {
+            case REPLAY_FRAME:
+                ok = in.getSigned(dTime) && in.getSigned(dDt);
+                codec.timeStep += dTime;
+                codec.timeBits += codec.timeStep;
+                codec.dtBits = uint32_t(int64_t(codec.dtBits) + dDt);
+                gs.time = std::bit_cast<double>(codec.timeBits);
+                gs.tmp.frameTime = std::bit_cast<float>(codec.dtBits);
+                codec.frames++;
+                pending = ok;
+                break;
+            case REPLAY_EVENT:
+                ok = readReplayEvent(gs, in, codec);
+                break;
+            case REPLAY_SETTINGS:
+                ok = in.getVarint(u);
+                unpackSettings(gs, (uint32_t)u);
+                break;
+            case REPLAY_SEED:
+                ok = in.getVarint(u);
+                gs.tmp.replaySeed = (unsigned int)u;
+                gs.tmp.replaySeedPending = ok;
+                break;
+            case REPLAY_END:
+                ok = in.getVarint(u) && in.getSigned(score) && in.getBytes(&rep.claimedHash, sizeof(rep.claimedHash));
+                if (ok) {
+                    rep.claimedScore = (int)score;
+                    rep.result = (u == codec.frames && rep.claimedScore == gs.score && rep.claimedHash == stateHash(gs)) ? REPLAY_OK : REPLAY_MISMATCH;
+                }
+                ok = false;
+                break;
+            default:
+                rep.result = REPLAY_BAD_FILE;
+                ok = false;
+                break;
+        }
     }
+    // a recording cut off mid-frame still plays the frames it holds
+    if (pending)
+        runReplayFrame(gs);
+    rep.frames = codec.frames;
+    rep.simSeconds = gs.time - start;
+    rep.score = gs.score;
+    rep.hash = stateHash(gs);
+    return rep;
 }
+#endif
 
+// the stream plays by itself, this follows the setting and reports underruns at most once per MUSIC_REPORT_INTERVAL
 void updateMusic(GameState& gs) {
-    if (gs.usr.musEnabled) {
-        UpdateMusicStream(gs.ga.p->music);
-        auto musicLen = GetMusicTimeLength(gs.ga.p->music);
-        auto musicTimePlayed = GetMusicTimePlayed(gs.ga.p->music);
-        //if (gs.musicLoopDone && musicTimePlayed < musicLen * 0.5f)
-        //    SeekMusicStream(gs.ga.p->music, musicLen * 0.5f + musicTimePlayed);
-        //if (!gs.musicLoopDone && musicTimePlayed > musicLen * 0.5f)
-        //    gs.musicLoopDone = true;
+    auto& ms = musicStreamer();
+    auto& music = gs.ga.p->music;
+    if (gs.usr.musEnabled != IsAudioStreamPlaying(music)) {
+        if (gs.usr.musEnabled)
+            ResumeAudioStream(music);
+        else
+            PauseAudioStream(music);
     }
+    gs.musicLoopDone = ms.loopDone;
+    uint64_t underruns = ms.underruns;
+    if (underruns > ms.reportedUnderruns && GetTime() - ms.lastReport > MUSIC_REPORT_INTERVAL) {
+        TraceLog(LOG_WARNING, "HEX: music underran %llu times, %llu frames of silence, ring low water %u frames",
+            (unsigned long long)underruns, (unsigned long long)ms.silentFrames.load(), ms.lowWater.load());
+        ms.reportedUnderruns = underruns;
+        ms.lastReport = GetTime();
+    }
+}
+
+DLL_EXPORT MusicStats getMusicStats()
+{
+    auto& ms = musicStreamer();
+    return {ms.decodedFrames, ms.playedFrames, ms.underruns, ms.silentFrames, ms.loops, ms.primed ? ms.lowWater.load() : 0};
 }
 
 float getTextSize(const GameState& gs) {
@@ -892,13 +3180,214 @@ float getTextSize(const GameState& gs) {
     return sz;
 }
 
-void drawText(const GameState& gs, const std::string txt, Vector2 pos, Color col = WHITE) {
+// frees the glyphs that were on an emptied shelf for later codepoints
+void forgetShelf(GameAssets& ga, int shelf) {
+    auto& font = ga.font;
+    auto& gc = ga.glyphs;
+    for (int i = 0; i < font.glyphCount; ++i) {
+        if (gc.shelfOf[i] == shelf && font.glyphs[i].value != 0) {
+            gc.slotOf.erase(font.glyphs[i].value);
+            gc.freeSlots.push_back(i);
+            font.glyphs[i].value = 0;
+            gc.evicted++;
+        }
+    }
+}
+
+// a slot a forgotten glyph left, or a new one at the end of the font's arrays, which double when they are full
+int takeGlyphSlot(GameAssets& ga) {
+    auto& font = ga.font;
+    auto& gc = ga.glyphs;
+    if (!gc.freeSlots.empty()) {
+        int slot = gc.freeSlots.back();
+        gc.freeSlots.pop_back();
+        return slot;
+    }
+    if (font.glyphCount == (int)gc.shelfOf.size()) {
+        size_t cap = gc.shelfOf.size() * 2;
+        font.recs = (Rectangle*)MemRealloc(font.recs, unsigned(cap * sizeof(Rectangle)));
+        font.glyphs = (GlyphInfo*)MemRealloc(font.glyphs, unsigned(cap * sizeof(GlyphInfo)));
+        gc.shelfOf.resize(cap, 0);
+    }
+    return font.glyphCount++;
+}
+
+// doubles the texture's height up to FONT_ATLAS_SIZE and copies what is on it over, false once it is that tall.
+// It happens a couple of times at most, so reading the old texture back is fine
+bool growGlyphAtlas(GameAssets& ga) {
+    auto& font = ga.font;
+    auto& gc = ga.glyphs;
+    if (gc.atlas.height() >= FONT_ATLAS_SIZE)
+        return false;
+    int height = std::min(gc.atlas.height() * 2, FONT_ATLAS_SIZE);
+    Texture2D tex = {rlLoadTexture(nullptr, FONT_ATLAS_SIZE, height, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA, 1),
+        FONT_ATLAS_SIZE, height, 1, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA};
+    Image old = LoadImageFromTexture(font.texture);
+    if (old.data)
+        UpdateTextureRec(tex, {0, 0, (float)old.width, (float)old.height}, old.data);
+    UnloadImage(old);
+    UnloadTexture(font.texture);
+    font.texture = tex;
+    gc.atlas.grow(height);
+    return true;
+}
+
+// index of the codepoint's glyph, rasterized into the atlas the first time it is asked for. -1 when the font has
+// no glyph for it or the atlas no room, raylib then draws its fallback glyph. The atlas grows before anything is
+// evicted, and glyphs drawn this frame are never evicted
+int requestGlyph(GameAssets& ga, int cp) {
+    auto& font = ga.font;
+    auto& gc = ga.glyphs;
+    if (auto it = gc.slotOf.find(cp); it != gc.slotOf.end()) {
+        if (it->second >= 0)
+            gc.atlas.touch(gc.shelfOf[it->second], gc.frame);
+        return it->second;
+    }
+    auto g = LoadFontData(res_font_otf, res_font_otf_len, FONT_SIZE, &cp, 1, FONT_DEFAULT);
+    // raylib leaves a codepoint the font lacks without pixels or advance, it is remembered so the font is parsed once
+    if (!g || (!g->image.data && !g->advanceX)) {
+        if (g)
+            UnloadFontData(g, 1);
+        gc.slotOf[cp] = -1;
+        gc.missing++;
+        return -1;
+    }
+    auto& img = g->image;
+    int w = img.width + 2 * FONT_PADDING, h = img.height + 2 * FONT_PADDING;
+    int x, y, evicted = -1;
+    int shelf = gc.atlas.alloc(w, h, gc.frame, &x, &y);
+    while (shelf < 0 && growGlyphAtlas(ga))
+        shelf = gc.atlas.alloc(w, h, gc.frame, &x, &y);
+    if (shelf < 0)
+        shelf = gc.atlas.alloc(w, h, gc.frame, &x, &y, &evicted);
+    if (evicted >= 0)
+        forgetShelf(ga, evicted);
+    if (shelf < 0) {
+        UnloadFontData(g, 1);
+        return -1;
+    }
+    int slot = takeGlyphSlot(ga);
+    gc.scratch.assign(size_t(w) * h * 2, 0);
+    blitGlyph(gc.scratch.data(), w, FONT_PADDING, FONT_PADDING, img);
+    UpdateTextureRec(font.texture, {(float)x, (float)y, (float)w, (float)h}, gc.scratch.data());
+    font.recs[slot] = {float(x + FONT_PADDING), float(y + FONT_PADDING), (float)img.width, (float)img.height};
+    font.glyphs[slot] = {cp, g->offsetX, g->offsetY, g->advanceX, Image{}};
+    gc.shelfOf[slot] = int16_t(shelf);
+    gc.slotOf[cp] = slot;
+    gc.rasterized++;
+    UnloadFontData(g, 1);
+    return slot;
+}
+
+// printable ASCII is always in the atlas, so only text beyond it has to be looked at
+void requestGlyphs(const GameState& gs, const char* txt) {
+    auto& ga = *const_cast<GameAssets*>(gs.ga.p);
+    if (!ga.font.glyphs)
+        return;
+    while (*txt) {
+        int n = 1;
+        int cp = (uint8_t(*txt) < 0x80) ? *txt : GetCodepointNext(txt, &n);
+        if (cp > 126)
+            requestGlyph(ga, cp);
+        txt += n;
+    }
+}
+
+// starts the frame whose glyphs eviction leaves alone
+void tickGlyphs(const GameState& gs) {
+    if (gs.ga.p)
+        const_cast<GameAssets*>(gs.ga.p)->glyphs.frame++;
+}
+
+// the same quads DrawTextEx would emit for each printable character, with 1px spacing
+const GlyphRun& glyphRun(const GameState& gs, float size) {
+    auto& font = gs.ga.p->font;
+    auto& run = gs.tmp.text.glyphs;
+    if (run.texId == font.texture.id && run.size == size)
+        return run;
+    float scale = size / font.baseSize;
+    float pad = (float)font.glyphPadding;
+    for (int c = 0; c < 95; ++c) {
+        int idx = GetGlyphIndex(font, c + 32);
+        auto& rec = font.recs[idx];
+        auto& glyph = font.glyphs[idx];
+        run.quads[c].src = {rec.x - pad, rec.y - pad, rec.width + 2.0f * pad, rec.height + 2.0f * pad};
+        run.quads[c].dst = {(glyph.offsetX - pad) * scale, (glyph.offsetY - pad) * scale, (rec.width + 2.0f * pad) * scale, (rec.height + 2.0f * pad) * scale};
+        run.advance[c] = (glyph.advanceX ? glyph.advanceX : rec.width) * scale;
+        run.visible[c] = (c != 0);
+    }
+    run.texId = font.texture.id;
+    run.size = size;
+    return run;
+}
+
+// null for text the cache does not hold (too long or not printable ASCII), which is then drawn by raylib directly
+// once its glyphs are in the atlas
+const TextLayout* layoutText(const GameState& gs, const char* txt) {
+    auto size = getTextSize(gs);
+    auto& font = gs.ga.p->font;
+    uint64_t hash = 0xcbf29ce484222325ull ^ (uint64_t)size;
+    size_t len = 0;
+    for (; txt[len]; ++len) {
+        if (len == TEXT_MAX_GLYPHS || txt[len] < 32 || txt[len] > 126)
+            return nullptr;
+        hash = (hash ^ (uint8_t)txt[len]) * 0x100000001b3ull;
+    }
+    auto& cache = gs.tmp.text;
+    auto& lay = cache.labels[hash % TEXT_CACHE_SIZE];
+    if (lay.hash == hash && lay.texId == font.texture.id && lay.size == size && !strcmp(lay.str, txt)) {
+        cache.hits++;
+        return &lay;
+    }
+    cache.misses++;
+    auto& run = glyphRun(gs, size);
+    float x = 0;
+    lay.nQuads = 0;
+    for (size_t i = 0; i < len; ++i) {
+        int c = txt[i] - 32;
+        if (run.visible[c]) {
+            auto q = run.quads[c];
+            q.dst.x += x;
+            lay.quads[lay.nQuads++] = q;
+        }
+        x += run.advance[c] + 1.0f;
+    }
+    lay.extent = {len ? x - 1.0f : 0.0f, size};
+    memcpy(lay.str, txt, len + 1);
+    lay.hash = hash;
+    lay.texId = font.texture.id;
+    lay.size = size;
+    return &lay;
+}
+
+Vector2 measureText(const GameState& gs, const char* txt) {
+    auto lay = layoutText(gs, txt);
+    if (lay)
+        return lay->extent;
+    requestGlyphs(gs, txt);
+    return MeasureTextEx(gs.ga.p->font, txt, getTextSize(gs), 1.0);
+}
+
+void drawLayout(const GameState& gs, const TextLayout& lay, Vector2 pos, Color col) {
+    for (int i = 0; i < lay.nQuads; ++i) {
+        auto& q = lay.quads[i];
+        DrawTexturePro(gs.ga.p->font.texture, q.src, {pos.x + q.dst.x, pos.y + q.dst.y, q.dst.width, q.dst.height}, {0, 0}, 0, col);
+    }
+}
+
+void drawText(const GameState& gs, const char* txt, Vector2 pos, Color col = WHITE) {
     pos = {(float)int(pos.x), (float)int(pos.y)};
     auto pos2 = Vector2{pos.x, (float)int(pos.y + ceil(TILE_PIXEL))};
-    auto sz = getTextSize(gs);
     Color darkol = Color{uint8_t(col.r * 0.6f), uint8_t(col.g * 0.6f), uint8_t(col.b * 0.6f), 255};
-    DrawTextEx(gs.ga.p->font, txt.c_str(), pos2, sz, 1.0, darkol);
-    DrawTextEx(gs.ga.p->font, txt.c_str(), pos, sz, 1.0, col);
+    if (auto lay = layoutText(gs, txt)) {
+        drawLayout(gs, *lay, pos2, darkol);
+        drawLayout(gs, *lay, pos, col);
+        return;
+    }
+    requestGlyphs(gs, txt);
+    auto sz = getTextSize(gs);
+    DrawTextEx(gs.ga.p->font, txt, pos2, sz, 1.0, darkol);
+    DrawTextEx(gs.ga.p->font, txt, pos, sz, 1.0, col);
 }
 
 void drawTile(const GameState& gs, const ThingPos& tpos, Vector2 pos, Color col = WHITE, Vector2 sz = {TILE_SIZE, TILE_SIZE}) {
@@ -919,7 +3408,7 @@ void drawThing(const GameState& gs, Vector2 pos, const Thing& thing, bool masked
     }
 
     if (thing.bomb)
-        drawTile(gs, {4, thing.triggered ? ((int(floor(getTime(gs) * 20)) % 2 == 0) ? 4 : 5) : 3}, pos);
+        drawTile(gs, {4, (thing.bomb == BOMB_TRIGGERED) ? ((int(floor(getTime(gs) * 20)) % 2 == 0) ? 4 : 5) : 3}, pos);
     else
         drawTile(gs, {0, (gs.usr.n_params == 1) ? 0 : thing.shp}, pos, COLORS[thing.clr], {TILE_SIZE, TILE_SIZE + 1.0f});
 
@@ -965,23 +3454,18 @@ void drawParticles(const GameState& gs) {
 }
 
 void drawBoard(const GameState& gs) {
-    for (int i = 0; i < BOARD_HEIGHT; ++i) {
-        for (int j = 0; j < BOARD_WIDTH - ((i + gs.board.even) % 2); ++j) {
-            const Tile& tile = gs.board.things[i][j];
-            if (tile.exists) {
-                Vector2 tpos = getPixByPos(gs, {i, j});
-                Vector2 shake = SHAKE_STR * RAND_FLOAT_SIGNED_2D * (
-                        gs.gameOver ?
-                        std::clamp((getTime(gs) - gs.gameOverTime)/std::max((GAME_OVER_TIME_PER_ROW * (BOARD_HEIGHT - 1 - i)), 0.001f), 0.0, 1.0) :
-                        tile.shake
-                );
-                drawThing(gs, tpos + shake, tile.thing);
-            }
-        }
-    }
+    auto geom = getBoardGeom(gs);
+    forEachTile(gs.board, [&](ThingPos p, const Tile& tile) {
+        Vector2 shake = SHAKE_STR * RAND_FLOAT_SIGNED_2D * (
+                gs.gameOver ?
+                std::clamp((getTime(gs) - gs.gameOverTime)/std::max((GAME_OVER_TIME_PER_ROW * (Board::height - 1 - p.row)), 0.001f), 0.0, 1.0) :
+                gs.board.shakes[p.row][p.col]
+        );
+        drawThing(gs, geomPixByPos(geom, p) + shake, tile.thing);
+    });
     auto brect = getBoardRect(gs);
-    DrawRectangleRec({brect.x - 3.0f, 0.0f, 3.0f, (float)GetScreenHeight()}, WHITE);
-    DrawRectangleRec({brect.x + brect.width, 0.0f, 3.0f, (float)GetScreenHeight()}, WHITE);
+    DrawRectangleRec({brect.x - 3.0f, 0.0f, 3.0f, (float)SCREEN_HEIGHT}, WHITE);
+    DrawRectangleRec({brect.x + brect.width, 0.0f, 3.0f, (float)SCREEN_HEIGHT}, WHITE);
 
     //auto mpos = getPosByPix(gs, {(float)GetMouseX(), (float)GetMouseY()});
     //std::map<int, std::map<int, bool>> visited;
@@ -989,60 +3473,87 @@ void drawBoard(const GameState& gs) {
     //    DrawCircleV(getPixByPos(gs, mpos), 5, WHITE);
 }
 
+// a ring on the landing cell of the best planned shot, in the colour of the thing it is planned with
+void drawShotHint(const GameState& gs) {
+    auto& p = gs.tmp.planner;
+    if (!gs.tmp.shotHint || gs.gameOver || gs.bullet.exists || p.nBest == 0)
+        return;
+    auto& plan = p.best[0];
+    DrawCircleLinesV(getPixByPos(gs, plan.cell), TILE_RADIUS, COLORS[p.things[plan.swap].clr]);
+}
+
 void drawBullet(const GameState& gs) {
     drawThing(gs, gs.bullet.pos, gs.bullet.thing);
 }
 
 void drawGameOver(const GameState& gs) {
     float coeff = easeOutBounce(1.0f - std::clamp((gs.gameOverTime + GAME_OVER_TIMEOUT - getTime(gs))/GAME_OVER_TIMEOUT_BEF, 0.0, 1.0));
-    Vector2 skulpos = {GetScreenWidth() * 0.5f, GetScreenHeight() * -0.25f + coeff * GetScreenHeight() * 0.5f};
+    Vector2 skulpos = {SCREEN_WIDTH * 0.5f, SCREEN_HEIGHT * -0.25f + coeff * SCREEN_HEIGHT * 0.5f};
     drawTile(gs, {2, ((int(floor(getTime(gs) * 10)) % 2 == 0) ? 5 : (gs.alteredDifficulty ? 9 : ((gs.score == 0) ? 8 : ((gs.usr.bestScore == gs.score) ? 7 : 6))))}, skulpos);
-    auto verdictstr = (gs.usr.bestScore == gs.score && !gs.alteredDifficulty) ? ((gs.usr.bestScore > 0) ? std::string("NEW RECORD!") : std::string("Really now???")) : ("Best: " + std::to_string(gs.usr.bestScore));
-    auto sz = getTextSize(gs);
-    auto vmeas = MeasureTextEx(gs.ga.p->font, verdictstr.c_str(), sz, 1.0);
+    char verdictstr[32];
+    if (gs.usr.bestScore == gs.score && !gs.alteredDifficulty)
+        snprintf(verdictstr, sizeof(verdictstr), (gs.usr.bestScore > 0) ? "NEW RECORD!" : "Really now???");
+    else
+        snprintf(verdictstr, sizeof(verdictstr), "Best: %d", gs.usr.bestScore);
+    auto vmeas = measureText(gs, verdictstr);
     drawText(gs, verdictstr, skulpos + Vector2{-vmeas.x * 0.5f, TILE_RADIUS * 3.0f - vmeas.y * 0.5f}, WHITE);
 
-    auto scorestr = gs.alteredDifficulty ? ("\"" + std::to_string(gs.score) + "\"") : std::to_string(gs.score);
-    auto meas = MeasureTextEx(gs.ga.p->font, scorestr.c_str(), sz, 1.0);
-    auto txtPos1prv = Vector2{TILE_RADIUS * 2.0f + (GetScreenWidth() - TILE_RADIUS * 6.0f) * 0.25f - meas.x * 0.5f, GetScreenHeight() - TILE_RADIUS - meas.y * 0.5f};
-    auto scorestr2 = "x" + std::to_string(gs.combo);
-    auto txtPosnew = Vector2{GetScreenWidth() * 0.5f - meas.x * 0.5f, GetScreenHeight() * 0.5f - meas.y * 0.5f};
-    meas = MeasureTextEx(gs.ga.p->font, scorestr2.c_str(), getTextSize(gs), 1.0);
-    auto txtPos2prv = Vector2{GetScreenWidth() - TILE_RADIUS * 2.0f - (GetScreenWidth() - TILE_RADIUS * 6.0f) * 0.25f - meas.x * 0.5f, GetScreenHeight() - TILE_RADIUS - meas.y * 0.5f};
+    char scorestr[16];
+    snprintf(scorestr, sizeof(scorestr), gs.alteredDifficulty ? "\"%d\"" : "%d", gs.score);
+    auto meas = measureText(gs, scorestr);
+    auto txtPos1prv = Vector2{TILE_RADIUS * 2.0f + (SCREEN_WIDTH - TILE_RADIUS * 6.0f) * 0.25f - meas.x * 0.5f, SCREEN_HEIGHT - TILE_RADIUS - meas.y * 0.5f};
+    char scorestr2[8];
+    snprintf(scorestr2, sizeof(scorestr2), "x%d", gs.combo);
+    auto txtPosnew = Vector2{SCREEN_WIDTH * 0.5f - meas.x * 0.5f, SCREEN_HEIGHT * 0.5f - meas.y * 0.5f};
+    meas = measureText(gs, scorestr2);
+    auto txtPos2prv = Vector2{SCREEN_WIDTH - TILE_RADIUS * 2.0f - (SCREEN_WIDTH - TILE_RADIUS * 6.0f) * 0.25f - meas.x * 0.5f, SCREEN_HEIGHT - TILE_RADIUS - meas.y * 0.5f};
 
     drawText(gs, scorestr, txtPos1prv + (txtPosnew - txtPos1prv) * coeff, PINK);
     //drawText(scorestr, txtPos2prv + (txtPosnew - txtPos2prv) * coeff, PINK);
-    drawText(gs, scorestr2, txtPos2prv + Vector2{0, TILE_RADIUS} * 2.0f * coeff, COMBO_COLORS[gs.combo - 1]);
-    drawTile(gs, {2, 4}, {GetScreenWidth() * 0.5f, GetScreenHeight() * 1.25f - coeff * GetScreenHeight() * 0.5f}, WHITE, {TILE_SIZE, TILE_SIZE + 1});
+    drawText(gs, scorestr2, txtPos2prv + Vector2{0, TILE_RADIUS} * 2.0f * coeff, comboColor(gs.combo));
+    drawTile(gs, {2, 4}, {SCREEN_WIDTH * 0.5f, SCREEN_HEIGHT * 1.25f - coeff * SCREEN_HEIGHT * 0.5f}, WHITE, {TILE_SIZE, TILE_SIZE + 1});
+}
+
+// the bounced path in one strip, a ring on the landing cell and how many tiles would pop there
+void drawAimPreview(const GameState& gs) {
+    auto& aim = gs.tmp.aim;
+    if (aim.cur < 0)
+        return;
+    auto& path = aim.paths[aim.cur];
+    DrawTriangleStrip(path.strip.data(), 2 * path.nPoints, comboColor(gs.combo));
+    if (!path.lands)
+        return;
+    auto pos = geomPixByPos(path.geom, path.cell);
+    DrawCircleLinesV(pos, path.geom.radius, comboColor(gs.combo));
+    if (path.pops > 0) {
+        char popstr[8];
+        snprintf(popstr, sizeof(popstr), "%d", path.pops);
+        auto meas = measureText(gs, popstr);
+        drawText(gs, popstr, pos - meas * 0.5f, WHITE);
+    }
 }
 
 void drawBottom(const GameState& gs)
 {
     float startCoeff = easeOutQuad(std::clamp((getTime(gs) - gs.gameStartTime)/GAME_START_TIME, 0.0, 1.0));
 
-    Vector2 nextNextPos = {GetScreenWidth() - TILE_RADIUS + TILE_RADIUS  * 2.0f, GetScreenHeight() - TILE_RADIUS};
-    Vector2 nextPos = {GetScreenWidth() + TILE_RADIUS - startCoeff * 2 * TILE_RADIUS, GetScreenHeight() - TILE_RADIUS};
-    Vector2 gunPos = {(float)GetScreenWidth() * 0.5f, (float)GetScreenHeight() + TILE_RADIUS - startCoeff * 2 * TILE_RADIUS};
-    Vector2 extraPos = {-2.0f * TILE_RADIUS + startCoeff * 3.0f * TILE_RADIUS, GetScreenHeight() - TILE_RADIUS};
+    Vector2 nextNextPos = {SCREEN_WIDTH - TILE_RADIUS + TILE_RADIUS  * 2.0f, SCREEN_HEIGHT - TILE_RADIUS};
+    Vector2 nextPos = {SCREEN_WIDTH + TILE_RADIUS - startCoeff * 2 * TILE_RADIUS, SCREEN_HEIGHT - TILE_RADIUS};
+    Vector2 gunPos = {(float)SCREEN_WIDTH * 0.5f, (float)SCREEN_HEIGHT + TILE_RADIUS - startCoeff * 2 * TILE_RADIUS};
+    Vector2 extraPos = {-2.0f * TILE_RADIUS + startCoeff * 3.0f * TILE_RADIUS, SCREEN_HEIGHT - TILE_RADIUS};
     float rearmCoeff = easeOutQuad(std::clamp((getTime(gs) - gs.rearmTime)/REARM_TIMEOUT, 0.0, 1.0));
     float swapCoeff = easeOutQuad(std::clamp((getTime(gs) - gs.swapTime)/REARM_TIMEOUT, 0.0, 1.0));
     if (startCoeff < 1.0f) rearmCoeff = 1.0f;
 
     float gameOverCoeff = gs.gameOver ? easeOutQuad(std::clamp((getTime(gs) - gs.gameOverTime)/GAME_OVER_TIMEOUT, 0.0, 1.0)) : 0.0f;
-    //DrawCircleV(gunPos + gameOverCoeff * Vector2{0, TILE_RADIUS * 3.0f}, TILE_RADIUS + TILE_RADIUS * 0.2f, COMBO_COLORS[gs.combo - 1]);
+    //DrawCircleV(gunPos + gameOverCoeff * Vector2{0, TILE_RADIUS * 3.0f}, TILE_RADIUS + TILE_RADIUS * 0.2f, comboColor(gs.combo));
     DrawCircleV(extraPos + gameOverCoeff * Vector2{-TILE_RADIUS * 3.0f, 0}, TILE_RADIUS + TILE_RADIUS * 0.2f, DARKGRAY);
 
     if (!gs.gameOver) {
 
         if (gs.gameStartTime + GAME_START_TIME < getTime(gs)) {
-            const int NTICKS = 50;
-            const float TICKSTEP = TILE_RADIUS * 2;
-            Vector2 pos = gunPos;
-            float dir = gs.gun.dir + PI * 0.5f;
-            for (int i = 0; i < NTICKS; ++i) {
-                pos += TICKSTEP * Vector2{cos(dir), -sin(dir)};
-                DrawCircleV(pos, TILE_PIXEL, COMBO_COLORS[gs.combo - 1]);
-            }
+            drawAimPreview(gs);
+            probeStage(gs, PROBE_AIM_DRAW);
         }
         auto pt = GetSplinePointBezierQuad(nextPos, (nextPos + gunPos) * 0.5f - Vector2{0, 2.0f * TILE_RADIUS}, gunPos, rearmCoeff);
         auto pt2 = GetSplinePointBezierQuad(extraPos, (extraPos + gunPos) * 0.5f + Vector2{0, -2.0f * TILE_RADIUS}, gunPos, swapCoeff);
@@ -1052,12 +3563,14 @@ void drawBottom(const GameState& gs)
 
         if (gs.gun.extraArmed)
             drawThing(gs, gunPos + (extraPos - gunPos) * swapCoeff, gs.gun.extra);
-        auto scorestr = gs.alteredDifficulty ? ("\"" + std::to_string(gs.tmp.visScore) + "\"") : std::to_string(gs.tmp.visScore);
-        auto meas = MeasureTextEx(gs.ga.p->font, scorestr.c_str(), getTextSize(gs), 1.0);
-        drawText(gs, scorestr, {TILE_RADIUS * 2.0f + (GetScreenWidth() - TILE_RADIUS * 6.0f) * 0.25f - meas.x * 0.5f - (1.0f - startCoeff) * TILE_RADIUS * 2.0f, GetScreenHeight() - TILE_RADIUS - meas.y * 0.5f + (1.0f - startCoeff) * TILE_RADIUS * 2.0f}, PINK);
-        auto scorestr2 = "x" + std::to_string(gs.combo);
-        meas = MeasureTextEx(gs.ga.p->font, scorestr2.c_str(), getTextSize(gs), 1.0);
-        drawText(gs, scorestr2, {GetScreenWidth() - TILE_RADIUS * 2.0f - (GetScreenWidth() - TILE_RADIUS * 6.0f) * 0.25f - meas.x * 0.5f + (1.0f - startCoeff) * TILE_RADIUS * 2.0f, GetScreenHeight() - TILE_RADIUS - meas.y * 0.5f + (1.0f - startCoeff) * TILE_RADIUS * 2.0f}, COMBO_COLORS[gs.combo - 1]);
+        char scorestr[16];
+        snprintf(scorestr, sizeof(scorestr), gs.alteredDifficulty ? "\"%d\"" : "%d", gs.tmp.visScore);
+        auto meas = measureText(gs, scorestr);
+        drawText(gs, scorestr, {TILE_RADIUS * 2.0f + (SCREEN_WIDTH - TILE_RADIUS * 6.0f) * 0.25f - meas.x * 0.5f - (1.0f - startCoeff) * TILE_RADIUS * 2.0f, SCREEN_HEIGHT - TILE_RADIUS - meas.y * 0.5f + (1.0f - startCoeff) * TILE_RADIUS * 2.0f}, PINK);
+        char scorestr2[8];
+        snprintf(scorestr2, sizeof(scorestr2), "x%d", gs.combo);
+        meas = measureText(gs, scorestr2);
+        drawText(gs, scorestr2, {SCREEN_WIDTH - TILE_RADIUS * 2.0f - (SCREEN_WIDTH - TILE_RADIUS * 6.0f) * 0.25f - meas.x * 0.5f + (1.0f - startCoeff) * TILE_RADIUS * 2.0f, SCREEN_HEIGHT - TILE_RADIUS - meas.y * 0.5f + (1.0f - startCoeff) * TILE_RADIUS * 2.0f}, comboColor(gs.combo));
 
         bool warning = false;
 
@@ -1066,11 +3579,11 @@ void drawBottom(const GameState& gs)
                 const Tile& tile = gs.board.things[i][j];
                 if (tile.exists) {
                     Vector2 tpos = getPixByPos(gs, {i, j});
-                    float h = (GetScreenHeight() - 2 * TILE_RADIUS) - (tpos.y + TILE_RADIUS);
+                    float h = (SCREEN_HEIGHT - 2 * TILE_RADIUS) - (tpos.y + TILE_RADIUS);
                     if (h < ROW_HEIGHT * 2) {
-                        drawTile(gs, {2, 0}, {tpos.x, GetScreenHeight() - TILE_RADIUS - 3.0f * TILE_PIXEL}, WHITE, {3 * TILE_SIZE, TILE_SIZE});
+                        drawTile(gs, {2, 0}, {tpos.x, SCREEN_HEIGHT - TILE_RADIUS - 3.0f * TILE_PIXEL}, WHITE, {3 * TILE_SIZE, TILE_SIZE});
                         if (h < ROW_HEIGHT * 1) {
-                            drawTile(gs, {2, 3}, {tpos.x, GetScreenHeight() - TILE_RADIUS}, (int(floor(getTime(gs) * 10)) % 2 == 0) ? WHITE : BLANK);
+                            drawTile(gs, {2, 3}, {tpos.x, SCREEN_HEIGHT - TILE_RADIUS}, (int(floor(getTime(gs) * 10)) % 2 == 0) ? WHITE : BLANK);
                             warning = true;
                         }
                     }
@@ -1078,14 +3591,13 @@ void drawBottom(const GameState& gs)
             }
         }
 
-        if (warning && (int(floor(getTime(gs) * 10)) % 2 == 0) && (getTime(gs) - gs.tmp.lastWarnSnd > 0.1)) {
-            playSound(gs, gs.ga.p->beep);
-        }
+        if (warning && (int(floor(getTime(gs) * 10)) % 2 == 0))
+            playSound(gs, ASSET_BEEP, 1, 1.0f, 0.15f);
     }
 }
 
 void updateSettingsButton(GameState& gs) {
-    if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && Vector2DistanceSqr({(float)GetScreenWidth(), 0.0f}, GetMousePosition()) < TILE_RADIUS * TILE_RADIUS * 4 * 2.0f) {
+    if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && Vector2DistanceSqr({(float)SCREEN_WIDTH, 0.0f}, GetMousePosition()) < TILE_RADIUS * TILE_RADIUS * 4 * 2.0f) {
         gs.settingsOpened = !gs.settingsOpened;
         gs.inputTimeoutTime = getTime(gs);
     }
@@ -1095,12 +3607,15 @@ void updateSettingsButton(GameState& gs) {
 }
 
 void drawSettingsButton(const GameState& gs) {
-    drawTile(gs, {3, (gs.settingsOpened ? 7 : 6)}, {GetScreenWidth() - TILE_RADIUS, TILE_RADIUS});
+    drawTile(gs, {3, (gs.settingsOpened ? 7 : 6)}, {SCREEN_WIDTH - TILE_RADIUS, TILE_RADIUS});
 }
 
 void draw(const GameState& gs) {
+    PROFILE_ZONE("draw");
+    PERF_PHASE(PERF_DRAW);
     if (IsWindowFocused()) {
         drawBoard(gs);
+        drawShotHint(gs);
         if (gs.gameOver)
             drawGameOver(gs);
         drawBottom(gs);
@@ -1116,10 +3631,8 @@ void updateAndDrawSettings(GameState& gs)
 {
     auto prvusr = gs.usr;
 
-    updateMusic(gs);
-
-    auto sndPos = Vector2{(float)int(GetScreenWidth() * 0.333f), (float)int(GetScreenHeight() * 0.25f)};
-    auto musPos = Vector2{(float)int(GetScreenWidth() * 0.666f), (float)int(GetScreenHeight() * 0.25f)};
+    auto sndPos = Vector2{(float)int(SCREEN_WIDTH * 0.333f), (float)int(SCREEN_HEIGHT * 0.25f)};
+    auto musPos = Vector2{(float)int(SCREEN_WIDTH * 0.666f), (float)int(SCREEN_HEIGHT * 0.25f)};
     drawTile(gs, {3, 2}, sndPos);
     if (!gs.usr.sndEnabled)
         drawTile(gs, {3, 3}, sndPos);
@@ -1131,7 +3644,7 @@ void updateAndDrawSettings(GameState& gs)
     if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && Vector2DistanceSqr(musPos, GetMousePosition()) < TILE_RADIUS * TILE_RADIUS)
         gs.usr.musEnabled = !gs.usr.musEnabled;
 
-    auto movPos = Vector2{(float)int(GetScreenWidth() * 0.333f) - TILE_RADIUS * 2.0f, (float)int(GetScreenHeight() * 0.25f + TILE_RADIUS * 4.0f)};
+    auto movPos = Vector2{(float)int(SCREEN_WIDTH * 0.333f) - TILE_RADIUS * 2.0f, (float)int(SCREEN_HEIGHT * 0.25f + TILE_RADIUS * 4.0f)};
     drawTile(gs, {3, (gs.usr.velEnabled ? 1 : 0)}, movPos);
     drawText(gs, "board movement", movPos + Vector2{TILE_RADIUS * 1.5f, -TILE_RADIUS + TILE_PIXEL * 2.0f}, WHITE);
     if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && abs(movPos.y - GetMousePosition().y) < TILE_RADIUS) {
@@ -1154,55 +3667,509 @@ void updateAndDrawSettings(GameState& gs)
     drawSettingsButton(gs);
 }
 
+// pipelined mode: the simulation steps on its own thread at PIPELINE_SIM_HZ and publishes a RenderSnapshot per step,
+// the main thread polls input for it and draws the newest snapshot into a view GameState. While it runs the main
+// thread leaves gs alone apart from fields the simulation never writes (settingsOpened, the render texture, the
+// toggles), anything else parks the simulation first
+using PipeClock = std::chrono::steady_clock;
+
+struct SimPipeline {
+    std::thread thread;
+    std::mutex m;
+    std::condition_variable cv;
+    bool running = false, stepping = false, quit = false;
+    GameState* gs = nullptr;
+    double hz = PIPELINE_SIM_HZ;
+    double base = 0;
+    std::unique_ptr<GameState> view;
+    std::unique_ptr<TripleBuffer<RenderSnapshot>> snaps;
+    SpscRing<InputEvent> inputs{MAX_INPUT_EVENTS};
+    std::atomic<bool> focused = false, shotHint = false;
+    // simulation side
+    std::array<uint32_t, SOUND_COUNT> soundTotals;
+    std::array<SoundRequest, SOUND_COUNT> sounds;
+    double lastInput = 0;
+    std::atomic<uint64_t> steps = 0, published = 0, skipped = 0;
+    std::atomic<float> simMs = 0;
+    // render side
+    uint64_t rendered = 0, repeated = 0, droppedInputs = 0;
+    std::array<uint32_t, SOUND_COUNT> soundsHeard;
+    double shownPublished = 0, shownInput = 0, newInput = 0;
+    std::array<float, PIPELINE_LATENCY_SAMPLES> ages, inputLatencies;
+    size_t nAges = 0, nInputLatencies = 0;
+    double lastReport = 0;
+
+    ~SimPipeline();
+};
+
+SimPipeline& simPipeline() {
+    static SimPipeline p;
+    return p;
+}
+
+// the game clock of the pipeline, continuing from gs.time at the moment it started
+double pipelineTime(const SimPipeline& p) {
+    return std::chrono::duration<double>(PipeClock::now().time_since_epoch()).count() + p.base;
+}
+
+void captureRender(const GameState& gs, RenderSnapshot& s) {
+    PROFILE_ZONE("captureRender");
+    s.sim = gs;
+    s.usr = gs.usr;
+    s.particles.assign(gs.tmp.particles);
+    s.animations.assign(gs.tmp.animations);
+    s.scorePoints.assign(gs.tmp.scorePoints);
+    s.visScore = gs.tmp.visScore;
+    s.boardVersion = gs.tmp.boardVersion;
+    s.nDrops = gs.tmp.shNDrops;
+    std::copy_n(gs.tmp.shDropTimes.begin(), s.nDrops, s.dropTimes.begin());
+    std::copy_n(gs.tmp.shDropCenters.begin(), s.nDrops, s.dropCenters.begin());
+    s.nBest = gs.tmp.planner.nBest;
+    s.best = gs.tmp.planner.best[0];
+    s.things[0] = gs.tmp.planner.things[0];
+    s.things[1] = gs.tmp.planner.things[1];
+}
+
+void applyRender(GameState& view, const RenderSnapshot& s) {
+    PROFILE_ZONE("applyRender");
+    static_cast<SimState&>(view) = s.sim;
+    view.usr = s.usr;
+    view.tmp.particles.assign(s.particles);
+    view.tmp.animations.assign(s.animations);
+    view.tmp.scorePoints.assign(s.scorePoints);
+    view.tmp.visScore = s.visScore;
+    view.tmp.boardVersion = s.boardVersion;
+    view.tmp.shNDrops = s.nDrops;
+    std::copy_n(s.dropTimes.begin(), s.nDrops, view.tmp.shDropTimes.begin());
+    std::copy_n(s.dropCenters.begin(), s.nDrops, view.tmp.shDropCenters.begin());
+    view.tmp.planner.nBest = s.nBest;
+    view.tmp.planner.best[0] = s.best;
+    view.tmp.planner.things[0] = s.things[0];
+    view.tmp.planner.things[1] = s.things[1];
+}
+
+void publishRender(SimPipeline& p, GameState& gs, double inputTime) {
+    auto& s = p.snaps->writeSlot();
+    captureRender(gs, s);
+    for (int i = 0; i < SOUND_COUNT; ++i) {
+        auto& req = gs.tmp.audio.pending[i];
+        if (req.count) {
+            p.soundTotals[i] += req.count;
+            p.sounds[i] = req;
+        }
+    }
+    gs.tmp.audio.pending = {};
+    p.lastInput = std::max(p.lastInput, inputTime);
+    s.soundTotals = p.soundTotals;
+    s.sounds = p.sounds;
+    s.inputTime = p.lastInput;
+    s.step = p.steps;
+    s.published = pipelineTime(p);
+    p.skipped += p.snaps->publish();
+    p.published++;
+}
+
+// one frame of the classic loop minus polling and drawing, with the inputs the main thread handed over
+void pipelineStep(SimPipeline& p) {
+    PROFILE_ZONE("pipelineStep");
+    auto t0 = PipeClock::now();
+    auto& gs = *p.gs;
+    double now = pipelineTime(p);
+    gs.tmp.frameTime = float(now - gs.time);
+    gs.time = now;
+    double inputTime = 0;
+    InputEvent ev;
+    while (p.inputs.pop(&ev, 1)) {
+        queueInput(gs, ev.type, ev.time, ev.value, ev.pos);
+        inputTime = std::max(inputTime, ev.time);
+    }
+    checkDifficulty(gs);
+    if (p.focused) {
+        if (gs.inputTimeoutTime == 0)
+            gs.inputTimeoutTime = now;
+        if (now - gs.inputTimeoutTime > INPUT_TIMEOUT && gs.tmp.frameTime < 1.0) {
+            simulate(gs);
+            reportInputLatency(gs);
+            if (p.shotHint && !gs.gameOver)
+                planShots(gs, PLAN_BUDGET_MS, true);
+        } else {
+            gs.tmp.inputs.clear();
+            inputTime = 0;
+        }
+        flyParticles(gs);
+        flyScorePoints(gs);
+        checkDrops(gs);
+        checkAnimations(gs);
+    } else {
+        gs.inputTimeoutTime = 0;
+    }
+    publishRender(p, gs, inputTime);
+    p.steps++;
+    p.simMs = std::chrono::duration<float, std::milli>(PipeClock::now() - t0).count();
+}
+
+void pipelineThread(SimPipeline& p) {
+#ifdef HEX_ALLOC_TRACKER
+    allocCountThisThread();
+#endif
+    auto period = std::chrono::duration_cast<PipeClock::duration>(std::chrono::duration<double>(1.0 / p.hz));
+    auto next = PipeClock::now();
+    std::unique_lock<std::mutex> lock(p.m);
+    for (;;) {
+        p.cv.wait(lock, [&] { return p.quit || p.running; });
+        if (p.quit)
+            return;
+        p.stepping = true;
+        lock.unlock();
+        pipelineStep(p);
+        next = std::max(next + period, PipeClock::now());
+        lock.lock();
+        p.stepping = false;
+        p.cv.notify_all();
+        p.cv.wait_until(lock, next, [&] { return p.quit || !p.running; });
+    }
+}
+
+// waits for the step in flight, gs is the main thread's again afterwards. Classic frames go on from the
+// simulation's clock, and a latency probe the simulation started is dropped
+void parkPipeline(SimPipeline& p) {
+    std::unique_lock<std::mutex> lock(p.m);
+    if (!p.running)
+        return;
+    p.running = false;
+    p.cv.notify_all();
+    p.cv.wait(lock, [&] { return !p.stepping; });
+    p.gs->tmp.timeOffset = p.gs->time - GetTime();
+    p.gs->tmp.probe.pending = false;
+}
+
+void stopPipeline(SimPipeline& p) {
+    parkPipeline(p);
+    {
+        std::lock_guard<std::mutex> lock(p.m);
+        p.quit = true;
+    }
+    p.cv.notify_all();
+    if (p.thread.joinable())
+        p.thread.join();
+    p.gs = nullptr;
+}
+
+void startPipeline(GameState& gs, double hz) {
+    auto& p = simPipeline();
+    if (p.gs && p.gs != &gs)
+        stopPipeline(p);
+    std::unique_lock<std::mutex> lock(p.m);
+    if (p.running)
+        return;
+    if (!p.snaps) {
+        p.snaps = std::make_unique<TripleBuffer<RenderSnapshot>>();
+        p.view = std::make_unique<GameState>();
+    }
+    p.gs = &gs;
+    p.hz = hz;
+    p.base = 0;
+    p.base = gs.time - pipelineTime(p);
+    p.view->ga = gs.ga;
+    p.view->tmp.shotHint = gs.tmp.shotHint;
+    p.inputs.clear();
+    p.soundTotals = {};
+    p.sounds = {};
+    p.soundsHeard = {};
+    p.lastInput = p.shownInput = p.newInput = 0;
+    // published here so the render side never starts from an empty snapshot
+    publishRender(p, gs, 0);
+    p.running = true;
+    if (!p.thread.joinable()) {
+        p.quit = false;
+        p.thread = std::thread(pipelineThread, std::ref(p));
+    }
+    p.cv.notify_all();
+}
+
+// the simulation thread is stopped by shutdownGame(), one still running here is detached rather than joined
+SimPipeline::~SimPipeline() {
+    if (thread.joinable())
+        thread.detach();
+}
+
+// for entry points the host may call between frames
+void quiescePipeline(const GameState& gs) {
+    auto& p = simPipeline();
+    if (p.gs == &gs)
+        parkPipeline(p);
+}
+
+// true while the simulation runs on its own thread, started or parked to follow the toggle and the settings screen
+bool syncPipeline(GameState& gs) {
+    auto& p = simPipeline();
+    bool want = gs.tmp.pipelined && !gs.settingsOpened;
+    if (want && !p.running) {
+        gs.time = GetTime() + gs.tmp.timeOffset;
+        startPipeline(gs, PIPELINE_SIM_HZ);
+    } else if (!want && p.running) {
+        parkPipeline(p);
+    }
+    return want;
+}
+
+void sendInputs(SimPipeline& p, GameState& view) {
+    auto& evs = view.tmp.inputs;
+    p.droppedInputs += evs.count() - p.inputs.push(evs.data(), evs.count());
+    evs.clear();
+}
+
+bool takeRender(SimPipeline& p, GameState& view) {
+    if (!p.snaps->take()) {
+        p.repeated++;
+        return false;
+    }
+    auto& s = p.snaps->readSlot();
+    applyRender(view, s);
+    // sounds of replaced snapshots are still in the totals
+    for (int i = 0; i < SOUND_COUNT; ++i) {
+        uint32_t n = s.soundTotals[i] - p.soundsHeard[i];
+        if (!n)
+            continue;
+        auto& req = view.tmp.audio.pending[i];
+        req.count += uint16_t(std::min<uint32_t>(n, UINT16_MAX));
+        req.variants = std::max(req.variants, s.sounds[i].variants);
+        req.volume = std::max(req.volume, s.sounds[i].volume);
+        req.interval = std::max(req.interval, s.sounds[i].interval);
+        p.soundsHeard[i] = s.soundTotals[i];
+    }
+    p.shownPublished = s.published;
+    if (s.inputTime > p.shownInput)
+        p.newInput = p.shownInput = s.inputTime;
+    p.rendered++;
+    return true;
+}
+
+float percentileOf(std::array<float, PIPELINE_LATENCY_SAMPLES> samples, size_t n, float pct) {
+    n = std::min(n, samples.size());
+    if (n == 0)
+        return 0.0f;
+    size_t k = std::min(n - 1, size_t(pct * n));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.begin() + n);
+    return samples[k];
+}
+
+DLL_EXPORT PipelineStats getPipelineStats()
+{
+    auto& p = simPipeline();
+    return {p.steps, p.published, p.skipped, p.rendered, p.repeated, p.droppedInputs, p.simMs,
+        percentileOf(p.ages, p.nAges, 0.5f), percentileOf(p.ages, p.nAges, 0.99f),
+        percentileOf(p.inputLatencies, p.nInputLatencies, 0.5f), percentileOf(p.inputLatencies, p.nInputLatencies, 0.99f)};
+}
+
+// called right after the frame is presented
+void presentPipeline(SimPipeline& p, double now) {
+    p.ages[p.nAges++ % PIPELINE_LATENCY_SAMPLES] = float(1000.0 * (now - p.shownPublished));
+    if (p.newInput > 0) {
+        p.inputLatencies[p.nInputLatencies++ % PIPELINE_LATENCY_SAMPLES] = float(1000.0 * (now - p.newInput));
+        p.newInput = 0;
+    }
+    if (now - p.lastReport < PIPELINE_REPORT_TIME)
+        return;
+    auto st = getPipelineStats();
+    TraceLog(LOG_INFO, "HEX: pipeline %llu steps (%.2fms), %llu frames, %llu skipped, %llu repeated, age p50 %.2fms p99 %.2fms, input->present p50 %.2fms p99 %.2fms",
+        (unsigned long long)st.steps, st.simMs, (unsigned long long)st.rendered, (unsigned long long)st.skipped, (unsigned long long)st.repeated,
+        st.ageP50, st.ageP99, st.inputP50, st.inputP99);
+    p.lastReport = now;
+}
+
+// the render half of a pipelined frame: hands the polled inputs over and draws the newest snapshot
+void updateAndDrawPipelined(GameState& gs) {
+    PROFILE_ZONE("updateAndDrawPipelined");
+    auto& p = simPipeline();
+    auto& view = *p.view;
+    bool focused = IsWindowFocused();
+    p.focused = focused;
+    p.shotHint = gs.tmp.shotHint;
+    view.time = pipelineTime(p);
+    view.tmp.frameTime = GetFrameTime();
+    if (focused) {
+        pollInputs(view);
+        sendInputs(p, view);
+    } else {
+        view.tmp.lastPollTime = 0;
+    }
+    takeRender(p, view);
+    view.tmp.shotHint = gs.tmp.shotHint;
+    updateSettingsButton(view);
+    if (view.settingsOpened) {
+        parkPipeline(p);
+        view.settingsOpened = false;
+        gs.settingsOpened = true;
+        gs.inputTimeoutTime = getTime(gs);
+    }
+    if (!view.gameOver)
+        updateAimPreview(view);
+    draw(view);
+    drawSettingsButton(gs);
+}
+
+void drawLatencyProbe(const GameState& gs) {
+    const auto& probe = gs.tmp.probe;
+    if (!probe.enabled)
+        return;
+    size_t n = std::min(probe.nSamples, (size_t)LATENCY_PROBE_SAMPLES);
+    std::array<int, LATENCY_HIST_BINS> bins = {};
+    int maxBin = 1;
+    for (size_t i = 0; i < n; ++i) {
+        int b = std::clamp(int(probe.samples[i][PROBE_PRESENT - 1] / LATENCY_HIST_BIN_MS), 0, LATENCY_HIST_BINS - 1);
+        maxBin = std::max(maxBin, ++bins[b]);
+    }
+    float w = SCREEN_WIDTH * 0.5f / LATENCY_HIST_BINS;
+    float h = SCREEN_HEIGHT * 0.1f;
+    Vector2 org = {TILE_RADIUS, SCREEN_HEIGHT * 0.2f};
+    DrawRectangleRec({org.x, org.y - h, w * LATENCY_HIST_BINS, h}, Color{0, 0, 0, 160});
+    for (int b = 0; b < LATENCY_HIST_BINS; ++b) {
+        float bh = h * bins[b] / maxBin;
+        DrawRectangleRec({org.x + b * w, org.y - bh, w - 1.0f, bh}, (b == LATENCY_HIST_BINS - 1) ? RED : GREEN);
+    }
+    DrawText(TextFormat("input->present: %d samples, %.0fms bins", (int)n, LATENCY_HIST_BIN_MS), (int)org.x, (int)org.y + 2, 10, WHITE);
+    if (n > 0) {
+        const auto& last = probe.samples[(probe.nSamples - 1) % LATENCY_PROBE_SAMPLES];
+        DrawText(TextFormat("last: sim %.1f aim %.1f tex %.1f present %.1f ms", last[0], last[1], last[2], last[3]), (int)org.x, (int)org.y + 14, 10, WHITE);
+    }
+}
+
+void drawProfiler(const GameState& gs) {
+#ifdef HEX_PROFILER
+    if (!gs.tmp.profilerOverlay)
+        return;
+    std::array<ProfileZoneStats, PROFILER_MAX_ZONES> stats;
+    size_t n = std::min(profilerCollect(stats, PROFILER_OVERLAY_FRAMES), (size_t)PROFILER_OVERLAY_ZONES);
+    int x = int(TILE_RADIUS), y = int(SCREEN_HEIGHT * 0.3f);
+    DrawRectangle(x - 2, y - 2, int(SCREEN_WIDTH * 0.6f), 14 * int(n + 3) + 4, Color{0, 0, 0, 160});
+    DrawText(TextFormat("slowest zones, last %d frames (max / avg ms)", PROFILER_OVERLAY_FRAMES), x, y, 10, YELLOW);
+    for (size_t i = 0; i < n; ++i)
+        DrawText(TextFormat("%-16s %7.3f %7.3f", stats[i].name, stats[i].max * 1e-6, stats[i].total * 1e-6 / stats[i].count), x, y + 14 * int(i + 1), 10, WHITE);
+    auto& gc = gs.ga.p->glyphs;
+    DrawText(TextFormat("text: %u hits %u misses, glyphs: %d slots, %d/%d rows, %u rasterized %u evicted %u missing", gs.tmp.text.hits, gs.tmp.text.misses,
+        gs.ga.p->font.glyphCount, gc.atlas.usedHeight(), gc.atlas.height(), gc.rasterized, gc.evicted, gc.missing), x, y + 14 * int(n + 2), 10, YELLOW);
+    if (simPipeline().running) {
+        auto st = getPipelineStats();
+        DrawText(TextFormat("pipeline: step %.2f ms, %llu skipped, %llu repeated, age p50 %.1f p99 %.1f ms, input p50 %.1f p99 %.1f ms", st.simMs,
+            (unsigned long long)st.skipped, (unsigned long long)st.repeated, st.ageP50, st.ageP99, st.inputP50, st.inputP99), x, y + 14 * int(n + 1), 10, YELLOW);
+        return;
+    }
+    auto rw = gs.tmp.rewind.stats();
+    DrawText(TextFormat("rewind: %d records, %.1f KB, %.0f B/snapshot (last %d B, full %d B)", (int)rw.count, rw.bytesUsed / 1024.0f, rw.avgBytes, (int)rw.lastBytes, (int)sizeof(SimState)),
+        x, y + 14 * int(n + 1), 10, YELLOW);
+#endif
+}
+
+void trackAllocations(GameState& gs) {
+#ifdef HEX_ALLOC_TRACKER
+    allocCountThisThread();
+    auto frame = allocEndFrame();
+    bool gameplay = !gs.settingsOpened && !gs.gameOver && IsWindowFocused();
+    gs.tmp.nGameplayFrames = gameplay ? gs.tmp.nGameplayFrames + 1 : 0;
+    if (frame.count > 0) {
+        bool strict = false;
+#ifdef HEX_ALLOC_STRICT
+        strict = gameplay && gs.tmp.nGameplayFrames > ALLOC_WARMUP_FRAMES;
+#endif
+        int level = strict ? LOG_ERROR : LOG_DEBUG;
+        TraceLog(level, "HEX: frame allocated %llu times, %llu bytes", (unsigned long long)frame.count, (unsigned long long)frame.bytes);
+        allocForEachSite([&](const char* zone, uint64_t n, uint64_t bytes) {
+            TraceLog(level, "HEX:     %s: %llu allocations, %llu bytes", zone, (unsigned long long)n, (unsigned long long)bytes);
+        });
+        // not an assert, strict mode has to stop release builds too
+        if (strict)
+            abort();
+    }
+    allocResetSites();
+#endif
+}
+
 DLL_EXPORT void updateAndDraw(GameState& gs)
 {
-    if (!gs.tmp.timeOffsetSet) {
+    PROFILE_ZONE("updateAndDraw");
+    // gs belongs to the simulation thread while the pipeline runs, the offset is set before it starts
+    if (!gs.tmp.timeOffsetSet && !simPipeline().running) {
         if (gs.time == 0) gs.time = GetTime();
         gs.tmp.timeOffset = gs.time - GetTime();
         gs.tmp.timeOffsetSet = true;
     }
+    bool pipelined = syncPipeline(gs);
+    auto& rs = pipelined ? *simPipeline().view : gs;
+    if (!pipelined) {
+        gs.time = GetTime() + gs.tmp.timeOffset;
+        gs.tmp.frameTime = GetFrameTime();
+        checkDifficulty(gs);
+    }
 
-    if (!gs.usr.velEnabled || !gs.usr.accEnabled || (gs.usr.n_params == 1))
-        gs.alteredDifficulty = true;
+    updateAssets(gs);
+    updateMusic(gs);
+    tickGlyphs(gs);
 
     BeginTextureMode(gs.tmp.renderTex);
     ClearBackground(BLACK);
     if (gs.settingsOpened) {
         updateAndDrawSettings(gs);
+    } else if (pipelined) {
+        updateAndDrawPipelined(gs);
     } else {
         updateSettingsButton(gs);
         if (IsWindowFocused()) {
             if (gs.inputTimeoutTime == 0)
                 gs.inputTimeoutTime = getTime(gs);
             if (getTime(gs) - gs.inputTimeoutTime > INPUT_TIMEOUT && getFrameTime(gs) < 1.0) {
-                for (int i = 0; i < UPDATE_ITS; ++i)
-                    update(gs);
-                updateOnce(gs);
+                pollInputs(gs);
+                simulate(gs);
+                reportInputLatency(gs);
+                if (gs.tmp.shotHint && !gs.gameOver)
+                    planShots(gs, PLAN_BUDGET_MS, true);
+            } else {
+                gs.tmp.lastPollTime = 0;
             }
             flyParticles(gs);
             flyScorePoints(gs);
             checkDrops(gs);
             checkAnimations(gs);
-            updateMusic(gs);
         } else  {
             gs.inputTimeoutTime = 0;
         }
+        if (!gs.gameOver)
+            updateAimPreview(gs);
         draw(gs);
         drawSettingsButton(gs);
     }
+    flushSounds(rs);
     EndTextureMode();
+    probeStage(rs, PROBE_RENDER_TEX);
 
+    if (pipelined && (IsMouseButtonPressed(MOUSE_BUTTON_MIDDLE) || IsKeyPressed(KEY_LATENCY_PROBE) || IsKeyPressed(KEY_REPLAY_RECORD)))
+        parkPipeline(simPipeline());
     if (IsMouseButtonPressed(MOUSE_BUTTON_MIDDLE))
         addDrop(gs, GetMousePosition());
+    if (IsKeyPressed(KEY_LATENCY_PROBE))
+        toggleLatencyProbe(gs);
+    if (IsKeyPressed(KEY_REPLAY_RECORD))
+        toggleReplayRecord(gs);
+    if (IsKeyPressed(KEY_SHOT_HINT))
+        gs.tmp.shotHint = !gs.tmp.shotHint;
+    if (IsKeyPressed(KEY_PIPELINE))
+        gs.tmp.pipelined = !gs.tmp.pipelined;
+#ifdef HEX_PROFILER
+    if (IsKeyPressed(KEY_PROFILER_OVERLAY))
+        gs.tmp.profilerOverlay = !gs.tmp.profilerOverlay;
+    if (IsKeyPressed(KEY_PROFILER_DUMP) && profilerWriteTrace(PROFILER_TRACE_FILE))
+        TraceLog(LOG_INFO, "HEX: profiler trace written to %s", PROFILER_TRACE_FILE);
+#endif
 
-    gs.tmp.shTime = getTime(gs);
-    gs.tmp.shScreenSize = {(float)GetScreenWidth(), (float)GetScreenHeight()};
-    SetShaderValue(gs.ga.p->postProcFragShader, GetShaderLocation(gs.ga.p->postProcFragShader, "time"), &gs.tmp.shTime, SHADER_UNIFORM_FLOAT);
-    SetShaderValue(gs.ga.p->postProcFragShader, GetShaderLocation(gs.ga.p->postProcFragShader, "screenSize"), &gs.tmp.shScreenSize, SHADER_UNIFORM_VEC2);
-    SetShaderValue(gs.ga.p->postProcFragShader, GetShaderLocation(gs.ga.p->postProcFragShader, "nDrops"), &gs.tmp.shNDrops, SHADER_UNIFORM_INT);
-    if (gs.tmp.shNDrops) {
-        SetShaderValueV(gs.ga.p->postProcFragShader, GetShaderLocation(gs.ga.p->postProcFragShader, "dropTimes"), gs.tmp.shDropTimes.data(), SHADER_UNIFORM_FLOAT, gs.tmp.shNDrops);
-        SetShaderValueV(gs.ga.p->postProcFragShader, GetShaderLocation(gs.ga.p->postProcFragShader, "dropCenters"), gs.tmp.shDropCenters.data(), SHADER_UNIFORM_VEC2, gs.tmp.shNDrops);
+    PROFILE_ZONE("postProcess");
+    rs.tmp.shTime = getTime(rs);
+    rs.tmp.shScreenSize = {(float)SCREEN_WIDTH, (float)SCREEN_HEIGHT};
+    SetShaderValue(gs.ga.p->postProcFragShader, GetShaderLocation(gs.ga.p->postProcFragShader, "time"), &rs.tmp.shTime, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(gs.ga.p->postProcFragShader, GetShaderLocation(gs.ga.p->postProcFragShader, "screenSize"), &rs.tmp.shScreenSize, SHADER_UNIFORM_VEC2);
+    SetShaderValue(gs.ga.p->postProcFragShader, GetShaderLocation(gs.ga.p->postProcFragShader, "nDrops"), &rs.tmp.shNDrops, SHADER_UNIFORM_INT);
+    if (rs.tmp.shNDrops) {
+        SetShaderValueV(gs.ga.p->postProcFragShader, GetShaderLocation(gs.ga.p->postProcFragShader, "dropTimes"), rs.tmp.shDropTimes.data(), SHADER_UNIFORM_FLOAT, rs.tmp.shNDrops);
+        SetShaderValueV(gs.ga.p->postProcFragShader, GetShaderLocation(gs.ga.p->postProcFragShader, "dropCenters"), rs.tmp.shDropCenters.data(), SHADER_UNIFORM_VEC2, rs.tmp.shNDrops);
     }
 
     BeginDrawing();
@@ -1213,9 +4180,30 @@ DLL_EXPORT void updateAndDraw(GameState& gs)
     } else {
         ClearBackground(BLACK);
     }
+    drawLatencyProbe(rs);
+    drawProfiler(rs);
     EndDrawing();
+    probeStage(rs, PROBE_PRESENT);
+    rs.tmp.probe.pending = false;
+    if (pipelined)
+        presentPipeline(simPipeline(), pipelineTime(simPipeline()));
+
+    PROFILE_FRAME();
+    perfEndFrame();
+    reportPerfCounters(false);
+    trackAllocations(rs);
+}
 
-    gs.time = GetTime();
+// the host calls this before it unloads the module and before it exits. Statics are torn down under the loader
+// lock on Windows and after main on exit, joining a thread from there can hang, so the workers end here instead.
+// Anything used again afterwards starts up on demand
+DLL_EXPORT void shutdownGame()
+{
+    stopPipeline(simPipeline());
+    stopMusic(musicStreamer());
+    stopUserData();
+    stopPool(assetPoolSlot());
+    stopPool(plannerPoolSlot());
 }
 
 } // extern "C"
\ No newline at end of file
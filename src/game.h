@@ -1,9 +1,15 @@
 #include <array>
 #include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include "raylib.h"
 
 #include "util/arena.h"
+#include "util/delta_ring.h"
+#include "util/replay.h"
+#include "util/shelf_atlas.h"
 #include "raymath.h"
 #include "game_cfg.h"
 
@@ -17,36 +23,71 @@ struct ThingPos {
     int row, col;
 };
 
+enum BombState : uint8_t {
+    BOMB_NONE,
+    BOMB_ARMED,
+    BOMB_TRIGGERED
+};
+
 struct Thing {
     unsigned char clr, shp, sym;
-    bool bomb = false;
-    double triggerTime;
-    bool triggered = false;
+    BombState bomb = BOMB_NONE;
 };
 
+// a board cell is 5 bytes, its position is the index and the rarely used state lives in Board side tables
 struct Tile {
     bool exists;
-    ThingPos pos;
     Thing thing;
-    float shake = 0.0f;
 };
 
-struct Board {
-    float pos = 0;
+struct BombTimer {
+    ThingPos pos;
+    double triggerTime;
+};
+
+// W by H cells, rows alternate between W and W - 1 of them depending on even. The game plays on Board, the board
+// algorithms are templates over the dimensions so stress runs and variant modes can instantiate other sizes
+template <int W, int H>
+struct BoardT {
+    static constexpr int width = W, height = H, cells = W * H;
+    // scroll offset in 1/2^SCROLL_FRAC_BITS rows, whole-row shifts are exact so long sessions do not drift
+    int64_t scroll = 0;
     float speed = BOARD_SPEED;
     int nFulRowsTop = 0;
     int nRowsGap = BOARD_EMP_BOT_ROW_GAP;
-    std::array<std::array<Tile, BOARD_WIDTH>, BOARD_HEIGHT> things;
+    std::array<std::array<Tile, W>, H> things;
+    std::array<std::array<float, W>, H> shakes = {};
+    Arena<MAX_BOMB_TIMERS, BombTimer> bombTimers;
     bool even = false;
     double moveTime, totalMoveTime;
-    Arena<MAX_TODROP, ThingPos> todrop;
-    Arena<MAX_TODROP, ThingPos> uncon;
+    Arena<W * H, ThingPos> todrop;
+    Arena<W * H, ThingPos> uncon;
     uint8_t lastDropCombo = 1;
 };
 
+using Board = BoardT<BOARD_WIDTH, BOARD_HEIGHT>;
+
+// STREAM_CHUNK_ROWS rows of the stream, a pure function of the stream seed, the bomb probability and the chunk
+// index, so a chunk that was released or rewound past is simply made again
+struct RowChunk {
+    int64_t index = -1;
+    unsigned int seed;
+    float bombProb;
+    uint64_t lastUsed;
+    std::array<std::array<Thing, BOARD_WIDTH>, STREAM_CHUNK_ROWS> rows;
+};
+
+// the chunks above the visible window, released once all their rows are on the board
+struct RowStream {
+    std::array<RowChunk, STREAM_CACHE_CHUNKS> chunks;
+    uint64_t uses = 0;
+    uint64_t generated = 0;
+};
+
 struct Gun {
     float speed;
     float dir = 0;
+    int8_t turn = 0;
     Thing armed;
     bool extraArmed = false;
     bool firstSwap = true;
@@ -95,12 +136,126 @@ struct Bullet {
     double rebTime;
 };
 
+enum InputType : uint8_t {
+    INPUT_AIM,
+    INPUT_TURN,
+    INPUT_FIRE,
+    INPUT_SWAP,
+    INPUT_ADD_TILE,
+    INPUT_REMOVE_TILE,
+    INPUT_PARAMS,
+    INPUT_DIFFICULTY,
+    INPUT_REWIND
+};
+
+enum ReplayRecordType : uint8_t {
+    REPLAY_FRAME,
+    REPLAY_EVENT,
+    REPLAY_SETTINGS,
+    REPLAY_SEED,
+    REPLAY_END
+};
+
+// the values each replay record is delta coded against, kept in step by the recorder and the player
+struct ReplayCodec {
+    uint64_t timeBits = 0;
+    uint64_t timeStep = 0;
+    uint32_t dtBits = 0;
+    uint32_t aimBits = 0;
+    uint32_t settings = 0;
+    uint64_t frames = 0;
+};
+
+enum ReplayResult : uint8_t {
+    REPLAY_OK,
+    REPLAY_MISMATCH,
+    REPLAY_UNFINISHED,
+    REPLAY_BAD_FILE
+};
+
+// claimed values come from the end record, a recording that was never stopped has none
+struct ReplayReport {
+    ReplayResult result;
+    uint64_t frames;
+    double simSeconds;
+    int score, claimedScore;
+    uint64_t hash, claimedHash;
+};
+
+// value is the gun direction for INPUT_AIM, the turn sign for INPUT_TURN and for INPUT_REWIND
+// the number of shots to go back, or the number of seconds when negative,
+// pos is the board cell for the tile editing events
+struct InputEvent {
+    InputType type;
+    double time;
+    float value = 0.0f;
+    ThingPos pos = {};
+};
+
+enum ProbeStage : uint8_t {
+    PROBE_INPUT,
+    PROBE_SIM,
+    PROBE_AIM_DRAW,
+    PROBE_RENDER_TEX,
+    PROBE_PRESENT,
+    PROBE_STAGES
+};
+
+// follows one tagged input event at a time through the frame,
+// samples keep the time of every stage after PROBE_INPUT relative to it
+struct LatencyProbe {
+    bool enabled = false;
+    bool pending = false;
+    uint8_t stage = PROBE_INPUT;
+    std::array<double, PROBE_STAGES> stamps;
+    std::array<std::array<float, PROBE_STAGES - 1>, LATENCY_PROBE_SAMPLES> samples;
+    size_t nSamples = 0;
+};
+
+// the deferred sounds come last
+enum AssetId {
+    ASSET_FONT, ASSET_TILES, ASSET_EXPLOSION, ASSET_SPLASH,
+    ASSET_CLANG0, ASSET_CLANG1, ASSET_CLANG2, ASSET_POP0, ASSET_POP1, ASSET_POP2, ASSET_SHATTER0, ASSET_SHATTER1,
+    ASSET_WHOOSH0, ASSET_WHOOSH1, ASSET_SIZZLE, ASSET_BEEP, ASSET_SNDEXP, ASSET_FAIL, ASSET_SHAKE,
+    ASSET_COUNT
+};
+
+#define SOUND_COUNT (ASSET_COUNT - ASSET_CLANG0)
+
+// milliseconds since loadAssets started, -1 for what has not happened yet
+struct AssetTiming {
+    float decodeStart = -1, decodeMs = 0, uploadMs = 0, ready = -1;
+};
+
+struct AssetLoadReport {
+    std::array<AssetTiming, ASSET_COUNT> assets;
+    uint32_t ready = 0;
+    bool packed = false;
+    float initMs = -1, firstFrameMs = -1, allEagerMs = -1;
+};
+
+// the font atlas fills as codepoints are first drawn. Printable ASCII is rasterized with the other startup assets
+// and never leaves, other glyphs sit on shelves that are reused least recently used first once the atlas has grown
+// to its full height. slotOf maps a codepoint to its glyph, or to -1 when the font has none for it. shelfOf is the
+// shelf of each glyph slot, freeSlots the slots emptied with their shelf, frame stamps the shelves a frame draws from
+struct GlyphCache {
+    ShelfAtlas atlas;
+    std::unordered_map<int, int> slotOf;
+    std::vector<int16_t> shelfOf;
+    std::vector<int> freeSlots;
+    std::vector<uint8_t> scratch;
+    uint64_t frame = 1;
+    uint32_t rasterized = 0, evicted = 0, missing = 0;
+};
+
 struct GameAssets {
     Texture2D tiles;
     Texture2D explosion;
     Texture2D splash;
     Font font;
-    Music music;
+    GlyphCache glyphs;
+    // fed by musicCallback, not a raylib Music
+    AudioStream music;
     Sound clang[3];
     Sound pop[3];
     Sound sndexp;
@@ -112,9 +267,207 @@ struct GameAssets {
     Sound beep;
     Shader postProcFragShader;
     Shader maskFragShader;
+    AssetLoadReport load;
+    // the loaded sound and its aliases, so a sample can sound several times at once
+    std::array<std::array<Sound, AUDIO_VOICES>, SOUND_COUNT> voices;
+};
+
+// triggers of one sound within a frame, variants is how many consecutive samples it picks from
+struct SoundRequest {
+    uint16_t count;
+    uint8_t variants;
+    float volume;
+    float interval;
+};
+
+struct Voice {
+    double end;
+    float volume;
+};
+
+// requested counts every trigger, coalesced the ones merged into another of the same frame, limited the ones that
+// came sooner than their interval and dropped those the mix budget had no room for
+struct AudioStats {
+    uint64_t requested, coalesced, limited, dropped, played, stolen;
+    uint32_t peakVoices;
+    float peakMix;
+};
+
+// requests gather during the frame and flushSounds turns them into voices. Voice lengths are kept here rather than
+// asked from the device, so headless runs make the same decisions
+struct AudioMixer {
+    std::array<SoundRequest, SOUND_COUNT> pending;
+    std::array<std::array<Voice, AUDIO_VOICES>, SOUND_COUNT> voices;
+    std::array<double, SOUND_COUNT> lastStart;
+    AudioStats stats;
+};
+
+// underruns counts the callbacks that found the ring short and silentFrames the frames they filled with silence.
+// lowWater is the fewest frames a callback found waiting once the ring had been filled
+struct MusicStats {
+    uint64_t decodedFrames, playedFrames, underruns, silentFrames;
+    uint32_t loops, lowWater;
 };
 
-struct GameState {
+// requested counts saveUserData calls, coalesced the ones folded into a later write before it started.
+// writeMs is how long the last write took on the worker, the frame that asked for it never waits on it
+struct PersistStats {
+    uint64_t requested, coalesced, written, failed;
+    float writeMs, maxWriteMs;
+};
+
+// bump when a GameState change is not visible to the layout hash (same-size reorders inside Temp)
+#define STATE_LAYOUT_VERSION 1
+
+// stamped by the module that owns the state, a reloaded module adopts the buffer as is when it matches
+struct StateHeader {
+    uint64_t layoutHash;
+    uint32_t version;
+    uint32_t size;
+};
+
+// balance constants a harness can change per state, game_cfg.h holds the defaults. Kept across resets
+struct Tuning {
+    float boardAcc = BOARD_ACC;
+    float bombProb = BOMB_PROB;
+    int nToDrop = N_TO_DROP;
+    int botRowGap = BOARD_EMP_BOT_ROW_GAP;
+    int maxCombo = MAX_COMBO;
+};
+
+// per game counters for tools, not read by the simulation
+struct PlayStats {
+    uint32_t shots = 0;
+    uint32_t drops = 0;
+    uint32_t cascades = 0;
+    uint32_t cascadeTiles = 0;
+    uint32_t bombs = 0;
+    int maxCombo = 1;
+};
+
+// where the board sits on screen, sampled once so code off the main thread never asks the window
+struct BoardGeom {
+    Rectangle rect;
+    float radius, rowHeight;
+    bool even;
+};
+
+// what a trace depends on besides the cells along its path: how far below the board the gun sits, how fast
+// the board comes down in pixels a second and how much of an ease back up is left
+struct TraceKey {
+    float gunY, drift;
+    double ease;
+};
+
+// where a bullet fired at one gun angle stops, touched has a bit for every cell the path was tested against
+struct ShotTrace {
+    std::array<uint64_t, PLAN_MASK_WORDS> touched;
+    TraceKey key;
+    ThingPos cell, hit;
+    uint8_t bounces;
+    BombState bomb;
+    bool lands, valid;
+};
+
+// what putting a thing into an empty cell would pop and cut loose, for the best matching parameter.
+// read has a bit for every cell the result depends on
+struct ShotOutcome {
+    std::array<uint64_t, PLAN_MASK_WORDS> read;
+    uint16_t popped, fallen;
+    uint8_t touching;
+    bool valid;
+};
+
+// swap means the shot is fired with the extra thing, or the next one when nothing is held yet.
+// width is how many neighbouring angles land in the same cell, dir is the middle one
+struct ShotPlan {
+    float dir;
+    bool swap;
+    bool bomb;
+    ThingPos cell;
+    int popped, fallen;
+    int rating;
+    int width;
+};
+
+// traces are redone where the board changed under their path or moved too far against the gun,
+// outcomes where the board changed under a cell they read. rev counts board changes seen by the planner
+struct ShotPlanner {
+    bool primed = false;
+    BoardGeom geom;
+    std::array<std::array<Tile, BOARD_WIDTH>, BOARD_HEIGHT> board;
+    Thing things[2];
+    int nParams, nToDrop, nFulRowsTop;
+    uint32_t rev = 0;
+    std::array<ShotTrace, PLAN_ANGLES> traces;
+    std::array<std::array<ShotOutcome, BOARD_WIDTH * BOARD_HEIGHT>, 2> outcomes;
+    std::array<ShotPlan, PLAN_TOP> best;
+    int nBest = 0;
+    bool complete = false;
+    uint32_t nTraced = 0, nEvaluated = 0;
+    float ms = 0;
+};
+
+// the aim preview for one step of gun.dir: the bounced path, the same path widened into a triangle strip,
+// and where it ends. Valid while the board version, the board placement and the armed thing stay the same
+struct AimPath {
+    int step = -1;
+    uint32_t boardVersion;
+    BoardGeom geom;
+    Thing thing;
+    int nParams, nToDrop;
+    std::array<Vector2, AIM_MAX_BOUNCES + 2> points;
+    int nPoints;
+    std::array<Vector2, 2 * (AIM_MAX_BOUNCES + 2)> strip;
+    ThingPos cell;
+    bool lands;
+    int pops;
+};
+
+struct AimPreview {
+    std::array<AimPath, AIM_CACHE_SIZE> paths;
+    int cur = -1;
+    uint32_t hits = 0, misses = 0;
+};
+
+// where one glyph comes from in the font atlas and where it lands, relative to the top left of its label
+struct TextQuad {
+    Rectangle src, dst;
+};
+
+// printable ASCII laid out once per font size, so building a label is a table lookup per character
+struct GlyphRun {
+    unsigned int texId = 0;
+    float size = 0;
+    std::array<TextQuad, 95> quads;
+    std::array<float, 95> advance;
+    std::array<bool, 95> visible;
+};
+
+// a label measured and turned into quads, drawn again without touching the font until its text changes
+struct TextLayout {
+    uint64_t hash = 0;
+    unsigned int texId = 0;
+    float size = 0;
+    char str[TEXT_MAX_GLYPHS + 1] = {};
+    int nQuads = 0;
+    std::array<TextQuad, TEXT_MAX_GLYPHS> quads;
+    Vector2 extent;
+};
+
+struct TextCache {
+    GlyphRun glyphs;
+    std::array<TextLayout, TEXT_CACHE_SIZE> labels;
+    uint32_t hits = 0, misses = 0;
+};
+
+// everything the simulation reads and writes, fixed-size and trivially copyable so snapshots are a memcpy
+struct SimState {
+    StateHeader header;
+#ifdef HEX_LAYOUT_VARIANT
+    // the reload check's second module: every field after it moves and it is a field the first module lacks
+    uint64_t variantTag = 0;
+#endif
     unsigned int seed;
     Board board;
     Gun gun;
@@ -129,9 +482,25 @@ struct GameState {
     double inputTimeoutTime;
     double rearmTime;
     double swapTime;
+    bool alteredDifficulty = false;
+    Tuning tuning;
+    // new rows come from the stream, streamRow is the index of the next one to come in
+    unsigned int streamSeed = 0;
+    int64_t streamRow = 0;
+};
+
+static_assert(std::is_trivially_copyable_v<SimState>, "SimState must stay memcpy-able");
+
+struct GameState : SimState {
+#ifdef GAME_BASE_DLL
+    friend zpp::bits::access;
+    constexpr static auto serialize(auto& archive, auto& self) {
+        using Sim = std::conditional_t<std::is_const_v<std::remove_reference_t<decltype(self)>>, const SimState, SimState>;
+        return archive(static_cast<Sim&>(self), self.musicLoopDone, self.settingsOpened, self.usr, self.tmp, self.ga);
+    }
+#endif
     bool musicLoopDone = false;
     bool settingsOpened = false;
-    bool alteredDifficulty = false;
     struct UserData {
         DO_NOT_SERIALIZE
         int bestScore = 0;
@@ -159,8 +528,37 @@ struct GameState {
         std::array<Vector2, 128> shDropCenters;
         Vector2 shMaskTilePos;
         uint32_t shMaskId;
-        double lastScoreSnd;
-        double lastWarnSnd;
+        Arena<MAX_INPUT_EVENTS, InputEvent> inputs;
+        size_t nInputsApplied = 0;
+        double lastPollTime = 0;
+        Vector2 lastMousePos;
+        bool mouseTracked = false;
+        int lastTurn = 0;
+        int lastTouchCount = 0;
+        std::array<float, INPUT_LATENCY_SAMPLES> inputLatencies;
+        size_t nInputLatencies = 0;
+        double lastLatencyReport = 0;
+        // the draw stages stamp the latency probe
+        mutable LatencyProbe probe;
+        bool profilerOverlay = false;
+        uint32_t nGameplayFrames = 0;
+        float frameTime = 0;
+        DeltaRing<SimState, REWIND_BYTES, REWIND_ENTRIES> rewind;
+        ReplayWriter replayOut;
+        ReplayCodec replayCodec;
+        bool replaySeedPending = false;
+        unsigned int replaySeed = 0;
+        PlayStats stats;
+        bool shotHint = false;
+        ShotPlanner planner;
+        uint32_t boardVersion = 0;
+        AimPreview aim;
+        // draw code asks for sounds too
+        mutable AudioMixer audio;
+        // and for text layouts
+        mutable TextCache text;
+        bool pipelined = PIPELINE_DEFAULT;
+        RowStream stream;
     } tmp;
     struct AssetsPtr {
         DO_NOT_SERIALIZE
@@ -168,10 +566,65 @@ struct GameState {
     } ga;
 };
 
+// what a pipelined frame draws, published by the simulation thread. Only the live particles, animations and score
+// points are copied. Snapshots may be replaced before the render side takes one, so sound and input carry running
+// totals: soundTotals counts the requests of each sound since the pipeline started, sounds holds their latest
+// parameters, and inputTime is the time of the newest input applied so far
+struct RenderSnapshot {
+    SimState sim;
+    GameState::UserData usr;
+    Arena<MAX_PARTICLES, Particle> particles;
+    Arena<MAX_PARTICLES, Animation> animations;
+    Arena<MAX_PARTICLES, ScorePoint> scorePoints;
+    int visScore;
+    uint32_t boardVersion;
+    uint32_t nDrops;
+    std::array<float, 128> dropTimes;
+    std::array<Vector2, 128> dropCenters;
+    int nBest;
+    ShotPlan best;
+    Thing things[2];
+    std::array<uint32_t, SOUND_COUNT> soundTotals;
+    std::array<SoundRequest, SOUND_COUNT> sounds;
+    uint64_t step;
+    double published, inputTime;
+};
+
+// skipped snapshots were replaced before the render side took them, repeated frames found nothing new.
+// age is how old the drawn snapshot was at present, input how long an input took to reach the screen (ms)
+struct PipelineStats {
+    uint64_t steps, published, skipped, rendered, repeated, droppedInputs;
+    float simMs, ageP50, ageP99, inputP50, inputP99;
+};
+
+#ifdef HEX_HEADLESS
+extern "C" {
+    void initHeadless(GameState& gs, unsigned int seed);
+    GameState* createHeadless(unsigned int seed);
+    void destroyHeadless(GameState* gs);
+    void shootHeadless(GameState& gs, float dir);
+    uint64_t hashHeadless(const GameState& gs);
+    void stepHeadless(GameState& gs, float dt);
+    ReplayReport playReplay(GameState& gs, ReplayReader& in);
+    const char* replayResultName(ReplayResult r);
+}
+#endif
+
 #ifndef GAME_BASE_DLL
 extern "C" {
     void init(GameAssets& ga, GameState& gs);
     void setState(GameState& gs, const GameState& ngs);
+    void takeSnapshot(const GameState& gs, SimState& snap);
+    void restoreSnapshot(GameState& gs, const SimState& snap);
+    uint64_t getStateLayoutHash();
+    bool adoptState(GameState& gs, const GameAssets* ga);
+    size_t exportState(const GameState& gs, void* buf, size_t cap);
+    bool importState(GameState& gs, const void* buf, size_t size);
+    uint64_t stateHash(const SimState& sim);
+    bool startReplayRecord(GameState& gs, const char* path);
+    void stopReplayRecord(GameState& gs);
+    int planShots(GameState& gs, float budgetMs, bool parallel);
     void updateAndDraw(GameState& gs);
+    void shutdownGame();
 }
 #endif
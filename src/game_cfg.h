@@ -5,20 +5,32 @@
 
 #define WINDOW_WIDTH   432
 #define WINDOW_HEIGHT  864
+#ifdef HEX_HEADLESS
+    #define SCREEN_WIDTH  WINDOW_WIDTH
+    #define SCREEN_HEIGHT WINDOW_HEIGHT
+#else
+    #define SCREEN_WIDTH  GetScreenWidth()
+    #define SCREEN_HEIGHT GetScreenHeight()
+#endif
 #define BOARD_WIDTH    9
 #define BOARD_HEIGHT   36
 #define TILE_SIZE      16.0f
-#define TILE_RADIUS    std::min(GetScreenWidth(), GetScreenHeight()) / (BOARD_WIDTH * 2.0f)
+#define TILE_RADIUS    std::min(SCREEN_WIDTH, SCREEN_HEIGHT) / (BOARD_WIDTH * 2.0f)
 #define TILE_PIXEL     (TILE_RADIUS * 2.0f) / TILE_SIZE
 #define MAX_PARTICLES  1024
-#define MAX_TODROP     1024
+#define MAX_BOMB_TIMERS 32
+#define MAX_INPUT_EVENTS 64
 
 #define BOARD_EMP_BOT_ROW_GAP 10
 #define BOARD_WARNING_GAP 3
 #define BOARD_SPEED 1.0f
 #define BOARD_CONST_SPEED 3.0f
 #define BOARD_ACC 0.01f
-#define RAND_FLOAT static_cast <float> (rand()) / (static_cast <float> (RAND_MAX) + 1.0f)
+#define SCROLL_FRAC_BITS 32
+#define STREAM_CHUNK_ROWS 8
+// a fresh board fills up to BOARD_HEIGHT rows in one go, the chunk after them is made ahead
+#define STREAM_CACHE_CHUNKS ((BOARD_HEIGHT + STREAM_CHUNK_ROWS - 1) / STREAM_CHUNK_ROWS + 1)
+#define RAND_FLOAT randFloat(fxRand)
 #define RAND_FLOAT_SIGNED (2.0f * RAND_FLOAT - 1.0f)
 #define RAND_FLOAT_SIGNED_2D Vector2{RAND_FLOAT_SIGNED, RAND_FLOAT_SIGNED}
 #define UPDATE_ITS  5
@@ -44,13 +56,79 @@
 #define GRAVITY 2500.0f
 #define COLORS std::array<Color, 5>{ RED, GREEN, BLUE, GOLD, PINK }
 #define COMBO_COLORS std::array<Color, 5>{ WHITE, GREEN, YELLOW, ORANGE, RED }
-#define TOGOI std::vector<int>{1, 0, 3, 2, 5, 4}
-#define TOGO std::vector<ThingPos>{{pos.row, pos.col + 1}, {pos.row, pos.col - 1}, {pos.row - 1, pos.col}, {pos.row + 1, pos.col}, {pos.row - 1, ((pos.row + gs.board.even) % 2) ? (pos.col + 1) : (pos.col - 1)}, {pos.row + 1, ((pos.row + gs.board.even) % 2) ? (pos.col + 1) : (pos.col - 1)}}
+#define TOGOI std::array<int, 6>{1, 0, 3, 2, 5, 4}
 #ifdef PLATFORM_ANDROID
     #define INPUT_TIMEOUT 1.0f
 #else
     #define INPUT_TIMEOUT 0.1f
 #endif
+#define INPUT_LATENCY_SAMPLES 256
+#define INPUT_LATENCY_REPORT_TIME 10.0f
+#define KEY_LATENCY_PROBE KEY_F2
+#define LATENCY_PROBE_SAMPLES 512
+#define LATENCY_PROBE_FILE "latency.csv"
+#define LATENCY_HIST_BINS 20
+#define LATENCY_HIST_BIN_MS 5.0f
+#define KEY_PROFILER_OVERLAY KEY_F3
+#define KEY_PROFILER_DUMP KEY_F4
+#define PROFILER_OVERLAY_FRAMES 120
+#define PROFILER_OVERLAY_ZONES 12
+#define PROFILER_TRACE_FILE "trace.json"
+#define ALLOC_WARMUP_FRAMES 120
+#define KEY_REWIND KEY_BACKSPACE
+#define REWIND_BYTES (64 * 1024)
+#define REWIND_ENTRIES 256
+#define REWIND_INTERVAL 1.0f
+#define REWIND_SECONDS 5.0f
+#define KEY_REPLAY_RECORD KEY_F5
+#define REPLAY_FILE_FORMAT "replay_%lld.hexr"
+#define KEY_SHOT_HINT KEY_F6
+#define KEY_PIPELINE KEY_F7
+#ifdef HEX_PIPELINE
+    #define PIPELINE_DEFAULT true
+#else
+    #define PIPELINE_DEFAULT false
+#endif
+#define PIPELINE_SIM_HZ 240.0
+#define PIPELINE_LATENCY_SAMPLES 256
+#define PIPELINE_REPORT_TIME 10.0
+#define PLAN_ANGLES 512
+#define PLAN_CHUNK 32
+#define PLAN_TOP 8
+#define PLAN_BUDGET_MS 3.0f
+#define PLAN_THREADS 0
+#define PLAN_FRAME_DT (1.0f / 60.0f)
+#define PLAN_MAX_STEPS 4096
+#define PLAN_MASK_WORDS ((BOARD_WIDTH * BOARD_HEIGHT + 63) / 64)
+#define PLAN_TRACE_SLACK 2.0f
+#define PLAN_TRACE_FLIGHT 1.0f
+#define AIM_DIR_STEPS 2048
+#define AIM_CACHE_SIZE 64
+#define AIM_MAX_BOUNCES 16
+#define TEXT_CACHE_SIZE 32
+#define TEXT_MAX_GLYPHS 32
+#define ASSET_THREADS 2
+#define ASSET_STARTUP_BUDGET_MS 100.0f
+#define ASSET_UPLOAD_BUDGET_MS 2.0f
+#define FONT_SIZE 39
+#define FONT_PADDING 4
+#define FONT_ATLAS_SIZE 1024
+#define FONT_GLYPH_SLOTS 256
+#define ASSET_PACK_FILE "assets.hexpack"
+#define USERDATA_FILE "userdata"
+#define USERDATA_COALESCE_MS 250
+#define AUDIO_VOICES 4
+#define AUDIO_MIX_BUDGET 2.5f
+#define AUDIO_MAX_STARTS 6
+#define AUDIO_COALESCE_GAIN 0.25f
+#define AUDIO_PITCH_JITTER 0.06f
+#define AUDIO_MIN_VOLUME 0.15f
+#define AUDIO_FALLBACK_LENGTH 0.25f
+#define MUSIC_RING_FRAMES 16384
+#define MUSIC_CHUNK_FRAMES 2048
+#define MUSIC_REFILL_MS 10
+#define MUSIC_LOOP_START 0.5f
+#define MUSIC_REPORT_INTERVAL 1.0
 #define REARM_TIMEOUT 0.25f
 #define N_TO_DROP 4
 #define WAVE_FADE_TIME 1.0f
@@ -61,4 +139,3 @@
 #define MAX_COMBO 5
 #define SCORE_FLY_TIME 0.5f
 #define SCORE_FLY_SPREAD 0.25f
-#define SCORE_SND_CD 0.01f
\ No newline at end of file
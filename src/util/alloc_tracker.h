@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "profiler.h"
+
+#define ALLOC_MAX_SITES 64
+
+// allocations are grouped by the innermost profiler zone, so HEX_PROFILER gives the finest breakdown
+struct AllocSite {
+    std::atomic<const char*> zone = nullptr;
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> bytes = 0;
+};
+
+struct AllocStats {
+    uint64_t count, bytes;
+};
+
+inline const char ALLOC_NO_ZONE[] = "(no zone)";
+inline std::array<AllocSite, ALLOC_MAX_SITES> allocSites;
+inline std::atomic<uint64_t> allocCount = 0;
+inline std::atomic<uint64_t> allocBytes = 0;
+// only the threads that run a frame are counted, the save writer, the music decoder and the pools are not
+inline thread_local bool allocCounted = false;
+
+inline void allocCountThisThread() {
+    allocCounted = true;
+}
+
+inline void allocRecord(size_t sz) {
+    if (!allocCounted)
+        return;
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    allocBytes.fetch_add(sz, std::memory_order_relaxed);
+    const char* zone = profilerCurZone ? profilerCurZone : ALLOC_NO_ZONE;
+    for (auto& site : allocSites) {
+        const char* cur = site.zone.load(std::memory_order_acquire);
+        // a failed exchange means another zone took the free slot and leaves it in cur
+        if (!cur && site.zone.compare_exchange_strong(cur, zone))
+            cur = zone;
+        if (cur != zone)
+            continue;
+        site.count.fetch_add(1, std::memory_order_relaxed);
+        site.bytes.fetch_add(sz, std::memory_order_relaxed);
+        return;
+    }
+}
+
+// returns the totals since the previous call, the per-site counters are cleared by allocResetSites
+inline AllocStats allocEndFrame() {
+    return {allocCount.exchange(0), allocBytes.exchange(0)};
+}
+
+template <typename F>
+void allocForEachSite(F&& f) {
+    for (auto& site : allocSites) {
+        if (auto zone = site.zone.load(std::memory_order_acquire))
+            if (auto n = site.count.load(std::memory_order_relaxed))
+                f(zone, n, site.bytes.load(std::memory_order_relaxed));
+    }
+}
+
+inline void allocResetSites() {
+    for (auto& site : allocSites) {
+        site.count.store(0, std::memory_order_relaxed);
+        site.bytes.store(0, std::memory_order_relaxed);
+    }
+}
+
+#ifdef HEX_ALLOC_TRACKER_IMPL
+
+void* operator new(size_t sz) {
+    allocRecord(sz);
+    if (void* p = malloc(sz ? sz : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t sz) {
+    allocRecord(sz);
+    if (void* p = malloc(sz ? sz : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// over-aligned types come through these, msvc has no aligned_alloc and needs its own free for them
+inline void* allocAligned(size_t sz, std::align_val_t al) {
+    allocRecord(sz);
+    size_t a = (size_t)al;
+#ifdef _WIN32
+    void* p = _aligned_malloc(sz ? sz : 1, a);
+#else
+    void* p = aligned_alloc(a, ((sz ? sz : 1) + a - 1) / a * a);
+#endif
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+inline void freeAligned(void* p) noexcept {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+void* operator new(size_t sz, std::align_val_t al) { return allocAligned(sz, al); }
+void* operator new[](size_t sz, std::align_val_t al) { return allocAligned(sz, al); }
+void operator delete(void* p, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { freeAligned(p); }
+
+#endif
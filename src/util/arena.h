@@ -1,6 +1,6 @@
 #include <algorithm>
+#include <array>
 #include <cstddef>
-#include <vector>
 
 #ifdef GAME_BASE_DLL
 #include "../../../src/util/zpp_bits.h"
@@ -14,16 +14,14 @@ class Arena
 	using serialize = zpp::bits::members<2>;
 #endif
 
-    std::vector<T> _data;
+    std::array<T, CAP> _data;
     size_t _firstAvailableIdx;
 
 public:
     
     Arena() :
         _firstAvailableIdx(0)
-    {
-        _data.resize(CAP);
-    }
+    {}
 
     T* data() {
         return _data.data();
@@ -34,7 +32,8 @@ public:
     }
 
     size_t acquire(const T& obj, size_t count = 1) {
-        _data[_firstAvailableIdx++] = obj;
+        if (_firstAvailableIdx < CAP)
+            _data[_firstAvailableIdx++] = obj;
         return _firstAvailableIdx;
     }
 
@@ -53,6 +52,18 @@ public:
         _firstAvailableIdx = 0;
     }
 
+    // copies only the live elements
+    void assign(const Arena& other) {
+        std::copy(other._data.begin(), other._data.begin() + other._firstAvailableIdx, _data.begin());
+        _firstAvailableIdx = other._firstAvailableIdx;
+    }
+
+    // unordered removal, the last element takes the freed slot
+    void release(size_t idx) {
+        if (idx < _firstAvailableIdx)
+            _data[idx] = _data[--_firstAvailableIdx];
+    }
+
     bool has(const T& obj) {
         bool found = false;
         for (int i = 0; i < count(); ++i) {
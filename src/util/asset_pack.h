@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(_WIN32)
+// windows.h clashes with raylib's names, so the few kernel32 calls are declared by hand
+extern "C" {
+__declspec(dllimport) void* __stdcall CreateFileA(const char*, unsigned long, unsigned long, void*, unsigned long, unsigned long, void*);
+__declspec(dllimport) int __stdcall GetFileSizeEx(void*, long long*);
+__declspec(dllimport) void* __stdcall CreateFileMappingA(void*, void*, unsigned long, unsigned long, unsigned long, const char*);
+__declspec(dllimport) void* __stdcall MapViewOfFile(void*, unsigned long, unsigned long, unsigned long, size_t);
+__declspec(dllimport) int __stdcall UnmapViewOfFile(const void*);
+__declspec(dllimport) int __stdcall CloseHandle(void*);
+}
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// a pack is a header, one entry per asset and the payloads, each starting on an ASSET_PACK_ALIGN boundary.
+// Payloads are stored the way the engine consumes them (RGBA pixels, PCM frames, the top rows of the glyph atlas
+// with the startup glyphs' rects and metrics), so a mapped pack is used in place with nothing left to decode
+#define ASSET_PACK_MAGIC 0x4b505848 // "HXPK"
+#define ASSET_PACK_VERSION 2
+#define ASSET_PACK_ALIGN 64
+#define ASSET_PACK_NAME 16
+
+enum PackKind : uint32_t {
+    PACK_IMAGE,
+    PACK_WAVE,
+    PACK_FONT
+};
+
+struct PackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t align;
+    uint64_t size;
+    uint64_t sourceHash;
+};
+
+// images and the font atlas fill width..format, waves frameCount..channels, fonts also baseSize..glyphPadding.
+// Offsets are from the start of the pack, a font's recs and glyphs hold glyphCount Rectangles and PackGlyphs
+struct PackEntry {
+    char name[ASSET_PACK_NAME];
+    uint32_t kind;
+    int32_t width, height, format;
+    uint32_t frameCount, sampleRate, sampleSize, channels;
+    int32_t baseSize, glyphCount, glyphPadding;
+    uint64_t data, dataBytes;
+    uint64_t recs, glyphs;
+};
+
+// raylib's GlyphInfo without the per-glyph image, which only matters for rebuilding the atlas
+struct PackGlyph {
+    int32_t value, offsetX, offsetY, advanceX;
+};
+
+inline uint64_t packAlign(uint64_t off) {
+    return (off + ASSET_PACK_ALIGN - 1) & ~uint64_t(ASSET_PACK_ALIGN - 1);
+}
+
+// FNV-1a over every source length and every 256th byte, cheap enough to check on each launch and
+// enough to notice that the pack was built from other resources
+inline void packHashSource(uint64_t& h, const unsigned char* data, size_t len) {
+    auto mix = [&](uint8_t b) { h = (h ^ b) * 0x100000001b3ull; };
+    for (int i = 0; i < 8; ++i)
+        mix(uint8_t(uint64_t(len) >> (8 * i)));
+    for (size_t i = 0; i < len; i += 256)
+        mix(data[i]);
+}
+
+// read-only view of a whole file, mapped where the platform allows it and read into memory otherwise
+class MappedFile
+{
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+    bool _mapped = false;
+    std::vector<uint8_t> _copy;
+#if defined(_WIN32)
+    void* _file = nullptr;
+    void* _map = nullptr;
+#endif
+
+    bool readAll(const char* path) {
+        FILE* f = fopen(path, "rb");
+        if (!f)
+            return false;
+        fseek(f, 0, SEEK_END);
+        long n = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        _copy.resize(n > 0 ? size_t(n) : 0);
+        bool ok = n > 0 && fread(_copy.data(), 1, _copy.size(), f) == _copy.size();
+        fclose(f);
+        if (!ok) {
+            _copy.clear();
+            return false;
+        }
+        _data = _copy.data();
+        _size = _copy.size();
+        return true;
+    }
+
+public:
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const char* path) {
+        close();
+#if defined(_WIN32)
+        // GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, then PAGE_READONLY and FILE_MAP_READ
+        _file = CreateFileA(path, 0x80000000ul, 1, nullptr, 3, 0x80, nullptr);
+        long long sz = 0;
+        if (_file == (void*)-1)
+            _file = nullptr;
+        if (_file && GetFileSizeEx(_file, &sz) && sz > 0)
+            _map = CreateFileMappingA(_file, nullptr, 2, 0, 0, nullptr);
+        if (_map)
+            _data = (const uint8_t*)MapViewOfFile(_map, 4, 0, 0, 0);
+        if (_data) {
+            _size = size_t(sz);
+            _mapped = true;
+            return true;
+        }
+        close();
+#else
+        int fd = ::open(path, O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                ::close(fd);
+                _data = (const uint8_t*)p;
+                _size = size_t(st.st_size);
+                _mapped = true;
+                return true;
+            }
+        }
+        if (fd >= 0)
+            ::close(fd);
+#endif
+        return readAll(path);
+    }
+
+    void close() {
+#if defined(_WIN32)
+        if (_mapped)
+            UnmapViewOfFile(_data);
+        if (_map)
+            CloseHandle(_map);
+        if (_file)
+            CloseHandle(_file);
+        _map = nullptr;
+        _file = nullptr;
+#else
+        if (_mapped)
+            munmap((void*)_data, _size);
+#endif
+        _copy.clear();
+        _data = nullptr;
+        _size = 0;
+        _mapped = false;
+    }
+
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool mapped() const { return _mapped; }
+};
+
+// checks the header and that every entry's payload lies inside the file, returns the entries or null
+inline const PackEntry* packEntries(const MappedFile& file, uint32_t count, uint64_t sourceHash) {
+    if (file.size() < sizeof(PackHeader))
+        return nullptr;
+    PackHeader hdr;
+    memcpy(&hdr, file.data(), sizeof(hdr));
+    if (hdr.magic != ASSET_PACK_MAGIC || hdr.version != ASSET_PACK_VERSION || hdr.count != count || hdr.align != ASSET_PACK_ALIGN ||
+        hdr.size != file.size() || hdr.sourceHash != sourceHash || sizeof(PackHeader) + count * sizeof(PackEntry) > file.size())
+        return nullptr;
+    auto entries = (const PackEntry*)(file.data() + sizeof(PackHeader));
+    for (uint32_t i = 0; i < count; ++i) {
+        auto& e = entries[i];
+        if (e.data % ASSET_PACK_ALIGN || e.data + e.dataBytes > file.size() || e.recs > file.size() || e.glyphs > file.size())
+            return nullptr;
+    }
+    return entries;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "varint.h"
+
+// zero runs shorter than this are cheaper to keep inside a literal run
+#define DELTA_MIN_ZERO_RUN 4
+// worst case of deltaEncode: every literal run is followed by a minimal zero run
+#define DELTA_BOUND(n) ((n) + ((n) / (DELTA_MIN_ZERO_RUN + 1) + 1) * 2 * 3)
+
+// encodes cur ^ prev as (zero run, literal run, literal bytes) triples
+inline size_t deltaEncode(uint8_t* dst, const uint8_t* cur, const uint8_t* prev, size_t n) {
+    size_t out = 0, i = 0;
+    while (i < n) {
+        size_t zeros = 0;
+        while (i + zeros < n && cur[i + zeros] == prev[i + zeros]) zeros++;
+        if (i + zeros == n)
+            break;
+        size_t lit = i + zeros, end = lit;
+        while (end < n) {
+            size_t z = 0;
+            while (end + z < n && z < DELTA_MIN_ZERO_RUN && cur[end + z] == prev[end + z]) z++;
+            if (z == DELTA_MIN_ZERO_RUN || end + z == n)
+                break;
+            end += z + 1;
+        }
+        out += varintPut(dst + out, zeros);
+        out += varintPut(dst + out, end - lit);
+        for (size_t k = lit; k < end; ++k)
+            dst[out++] = cur[k] ^ prev[k];
+        i = end;
+    }
+    return out;
+}
+
+// xors an encoded delta into state, applying it twice gives the original bytes back
+inline bool deltaApply(uint8_t* state, size_t n, const uint8_t* src, size_t size) {
+    size_t in = 0, i = 0;
+    while (in < size) {
+        uint64_t zeros, lit;
+        size_t r = varintGet(src + in, size - in, zeros);
+        if (!r) return false;
+        in += r;
+        r = varintGet(src + in, size - in, lit);
+        if (!r) return false;
+        in += r;
+        i += zeros;
+        if (i + lit > n || in + lit > size)
+            return false;
+        for (uint64_t k = 0; k < lit; ++k)
+            state[i++] ^= src[in++];
+    }
+    return true;
+}
+
+// bounded history of T values stored as xor deltas against the previous record, newest state kept in full.
+// Walking back from the newest state undoes one delta per record, the oldest records are evicted first
+template <typename T, size_t BYTES, size_t ENTRIES>
+class DeltaRing
+{
+    static_assert(std::is_trivially_copyable_v<T>, "DeltaRing stores raw bytes");
+    static_assert(BYTES >= DELTA_BOUND(sizeof(T)), "DeltaRing must fit a worst case delta");
+
+public:
+
+    // time is moved by offsetTimes when history is cut, recorded keeps the clock the record was taken at
+    struct Entry {
+        uint64_t offset;
+        uint32_t size;
+        bool mark;
+        double time;
+        double recorded;
+    };
+
+    struct Stats {
+        size_t count, bytesUsed, lastBytes;
+        double avgBytes;
+    };
+
+private:
+
+    std::array<uint8_t, BYTES> _bytes;
+    std::array<Entry, ENTRIES> _entries;
+    T _last;
+    size_t _first = 0;
+    size_t _count = 0;
+    uint64_t _head = 0;
+    uint64_t _recorded = 0;
+    uint64_t _recordedBytes = 0;
+
+    Entry& entry(size_t idx) {
+        return _entries[(_first + idx) % ENTRIES];
+    }
+
+    void popOldest() {
+        _first = (_first + 1) % ENTRIES;
+        _count--;
+    }
+
+public:
+
+    size_t count() const { return _count; }
+
+    const Entry& get(size_t idx) const {
+        return _entries[(_first + idx) % ENTRIES];
+    }
+
+    void clear() {
+        _first = _count = 0;
+        _head = 0;
+    }
+
+    // mark flags records that can be looked up with findMarked (shot boundaries)
+    void push(const T& cur, double time, bool mark) {
+        if (_count == ENTRIES)
+            popOldest();
+        uint64_t pos = _head;
+        if (pos % BYTES + DELTA_BOUND(sizeof(T)) > BYTES)
+            pos += BYTES - pos % BYTES;
+        uint64_t end = pos + DELTA_BOUND(sizeof(T));
+        while (_count && entry(0).offset + BYTES < end)
+            popOldest();
+        uint32_t size = 0;
+        if (_count)
+            size = (uint32_t)deltaEncode(&_bytes[pos % BYTES], (const uint8_t*)&cur, (const uint8_t*)&_last, sizeof(T));
+        _entries[(_first + _count) % ENTRIES] = {pos, size, mark, time, time};
+        _count++;
+        _head = pos + size;
+        _last = cur;
+        if (_count > 1) {
+            _recorded++;
+            _recordedBytes += size;
+        }
+    }
+
+    // index of the n-th newest marked record (n = 1 is the newest), -1 when history is too short
+    int findMarked(int n) const {
+        for (int i = int(_count) - 1; i >= 0; --i)
+            if (get(i).mark && --n == 0)
+                return i;
+        return -1;
+    }
+
+    // index of the newest record at or before time, -1 when history does not reach that far
+    int findTime(double time) const {
+        for (int i = int(_count) - 1; i >= 0; --i)
+            if (get(i).time <= time)
+                return i;
+        return -1;
+    }
+
+    void offsetTimes(double dt) {
+        for (size_t i = 0; i < _count; ++i)
+            entry(i).time += dt;
+    }
+
+    // writes record idx into out and drops every newer record so recording continues from there,
+    // the restored record is unmarked since the current state is not a step to go back to
+    bool restore(size_t idx, T& out) {
+        if (idx >= _count)
+            return false;
+        T work = _last;
+        for (size_t i = _count - 1; i > idx; --i) {
+            auto& e = entry(i);
+            if (!deltaApply((uint8_t*)&work, sizeof(T), &_bytes[e.offset % BYTES], e.size))
+                return false;
+        }
+        _count = idx + 1;
+        entry(idx).mark = false;
+        _head = entry(idx).offset + entry(idx).size;
+        _last = work;
+        out = work;
+        return true;
+    }
+
+    Stats stats() const {
+        Stats s = {_count, 0, 0, _recorded ? double(_recordedBytes) / _recorded : 0.0};
+        if (_count) {
+            s.bytesUsed = size_t(_head - get(0).offset);
+            s.lastBytes = get(_count - 1).size;
+        }
+        return s;
+    }
+};
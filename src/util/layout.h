@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// describes where a field lives inside a trivially copyable struct, nested members use dotted paths
+// and typeHash carries the layout of compound element types so a changed Tile or Thing changes the field
+struct FieldDesc {
+    const char* name;
+    uint32_t offset;
+    uint32_t size;
+    uint64_t typeHash = 0;
+};
+
+#define LAYOUT_FIELD(T, f) FieldDesc{#f, (uint32_t)offsetof(T, f), (uint32_t)sizeof(((T*)nullptr)->f)}
+#define LAYOUT_FIELD_T(T, f, h) FieldDesc{#f, (uint32_t)offsetof(T, f), (uint32_t)sizeof(((T*)nullptr)->f), h}
+
+constexpr uint64_t LAYOUT_FNV_BASIS = 14695981039346656037ull;
+constexpr uint64_t LAYOUT_FNV_PRIME = 1099511628211ull;
+
+constexpr uint64_t layoutHashBytes(uint64_t h, uint64_t v, int n) {
+    for (int i = 0; i < n; ++i) {
+        h ^= (v >> (i * 8)) & 0xff;
+        h *= LAYOUT_FNV_PRIME;
+    }
+    return h;
+}
+
+constexpr uint64_t layoutHashStr(uint64_t h, const char* s) {
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= LAYOUT_FNV_PRIME;
+    }
+    return h;
+}
+
+template <size_t N>
+constexpr uint64_t layoutHash(const FieldDesc (&fields)[N], size_t size, uint64_t h = LAYOUT_FNV_BASIS) {
+    for (auto& f : fields) {
+        h = layoutHashStr(h, f.name);
+        h = layoutHashBytes(h, f.offset, 4);
+        h = layoutHashBytes(h, f.size, 4);
+        h = layoutHashBytes(h, f.typeHash, 8);
+    }
+    return layoutHashBytes(h, size, 8);
+}
+
+// fixed-width record of a FieldDesc as it is stored in a state blob
+struct FieldRecord {
+    char name[48];
+    uint32_t offset;
+    uint32_t size;
+    uint64_t typeHash;
+};
+
+inline FieldRecord layoutRecord(const FieldDesc& f) {
+    FieldRecord rec = {};
+    strncpy(rec.name, f.name, sizeof(rec.name) - 1);
+    rec.offset = f.offset;
+    rec.size = f.size;
+    rec.typeHash = f.typeHash;
+    return rec;
+}
+
+// the record of a field with the given name and size that lies inside an old layout of srcSize bytes, or nullptr
+inline const FieldRecord* layoutFind(const FieldRecord* oldFields, size_t nOld, const char* name, uint32_t size, size_t srcSize) {
+    for (size_t j = 0; j < nOld; ++j) {
+        const auto& o = oldFields[j];
+        if (!strncmp(o.name, name, sizeof(o.name)) && o.size == size && o.offset + o.size <= srcSize)
+            return &o;
+    }
+    return nullptr;
+}
+
+// copies every field of dst whose name, size and element layout match a record of the old layout,
+// returns the number of fields migrated, the rest keep whatever dst held
+template <size_t N>
+size_t layoutMigrate(const FieldDesc (&fields)[N], void* dst, const FieldRecord* oldFields, size_t nOld, const void* src, size_t srcSize, bool* migrated = nullptr) {
+    size_t n = 0;
+    for (size_t i = 0; i < N; ++i) {
+        const auto& f = fields[i];
+        bool ok = false;
+        for (size_t j = 0; j < nOld && !ok; ++j) {
+            const auto& o = oldFields[j];
+            if (strncmp(o.name, f.name, sizeof(o.name)) || o.size != f.size || o.typeHash != f.typeHash || o.offset + o.size > srcSize)
+                continue;
+            memcpy((char*)dst + f.offset, (const char*)src + o.offset, f.size);
+            ok = true;
+        }
+        if (migrated)
+            migrated[i] = ok;
+        n += ok;
+    }
+    return n;
+}
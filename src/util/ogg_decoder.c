@@ -0,0 +1,34 @@
+// a private copy of the stb_vorbis raylib builds in, for the music stream. raylib keeps its copy internal, which a
+// shared raylib on windows does not export, so this one is compiled static here and reached through the calls below
+#define STB_VORBIS_STATIC
+#include "external/stb_vorbis.c"
+
+#include "ogg_decoder.h"
+
+stb_vorbis* oggOpen(const unsigned char* data, int len, int* channels, unsigned int* sampleRate, unsigned int* length)
+{
+    int err = 0;
+    stb_vorbis* v = stb_vorbis_open_memory(data, len, &err, NULL);
+    if (!v)
+        return NULL;
+    stb_vorbis_info info = stb_vorbis_get_info(v);
+    *channels = info.channels;
+    *sampleRate = info.sample_rate;
+    *length = stb_vorbis_stream_length_in_samples(v);
+    return v;
+}
+
+int oggRead(stb_vorbis* v, int channels, short* dst, int frames)
+{
+    return stb_vorbis_get_samples_short_interleaved(v, channels, dst, frames * channels);
+}
+
+int oggSeek(stb_vorbis* v, unsigned int frame)
+{
+    return stb_vorbis_seek(v, frame);
+}
+
+void oggClose(stb_vorbis* v)
+{
+    stb_vorbis_close(v);
+}
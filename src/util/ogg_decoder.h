@@ -0,0 +1,19 @@
+#pragma once
+
+// the decoder behind OggStream, compiled from ogg_decoder.c
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct stb_vorbis;
+
+// returns NULL when the data does not decode, the rest is filled in otherwise
+struct stb_vorbis* oggOpen(const unsigned char* data, int len, int* channels, unsigned int* sampleRate, unsigned int* length);
+// interleaved 16-bit frames, returns the frames decoded, 0 at the end of the stream
+int oggRead(struct stb_vorbis* v, int channels, short* dst, int frames);
+int oggSeek(struct stb_vorbis* v, unsigned int frame);
+void oggClose(struct stb_vorbis* v);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ogg_decoder.h"
+
+// an ogg in memory decoded a chunk at a time into interleaved 16-bit frames
+class OggStream
+{
+    stb_vorbis* _v = nullptr;
+    int _channels = 0;
+    uint32_t _sampleRate = 0, _length = 0;
+
+public:
+
+    OggStream() = default;
+    OggStream(const OggStream&) = delete;
+    OggStream& operator=(const OggStream&) = delete;
+    ~OggStream() { close(); }
+
+    bool open(const unsigned char* data, int len) {
+        close();
+        _v = oggOpen(data, len, &_channels, &_sampleRate, &_length);
+        return _v != nullptr;
+    }
+
+    void close() {
+        if (_v)
+            oggClose(_v);
+        _v = nullptr;
+        _channels = 0;
+        _sampleRate = _length = 0;
+    }
+
+    bool valid() const { return _v != nullptr; }
+    int channels() const { return _channels; }
+    uint32_t sampleRate() const { return _sampleRate; }
+    uint32_t length() const { return _length; }
+
+    // returns the frames decoded, 0 at the end of the stream
+    int read(int16_t* dst, int frames) { return oggRead(_v, _channels, dst, frames); }
+    bool seek(uint32_t frame) { return oggSeek(_v, frame) != 0; }
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__) && defined(HEX_PERF_COUNTERS)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define PERF_PHASE(phase) PerfScope _perfScope##phase(phase)
+#else
+#define PERF_PHASE(phase)
+#endif
+
+enum PerfPhase : uint8_t {
+    PERF_COLLISION,
+    PERF_MATCH,
+    PERF_FLOATING,
+    PERF_PARTICLES,
+    PERF_DRAW,
+    PERF_PHASES
+};
+
+enum PerfCounter : uint8_t {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTERS
+};
+
+inline const char* PERF_PHASE_NAMES[PERF_PHASES] = {"collision", "match", "floating", "particles", "draw"};
+inline const char* PERF_COUNTER_NAMES[PERF_COUNTERS] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+using PerfValues = std::array<uint64_t, PERF_COUNTERS>;
+
+struct PerfPhaseTotals {
+    PerfValues values = {};
+    uint32_t calls = 0;
+};
+
+struct PerfTotals {
+    std::array<PerfPhaseTotals, PERF_PHASES> phases = {};
+
+    void add(const PerfTotals& other) {
+        for (int p = 0; p < PERF_PHASES; ++p) {
+            for (int c = 0; c < PERF_COUNTERS; ++c)
+                phases[p].values[c] += other.phases[p].values[c];
+            phases[p].calls += other.phases[p].calls;
+        }
+    }
+};
+
+// one counter group per thread, phases nest and are counted inclusively
+struct PerfState {
+    int fds[PERF_COUNTERS] = {-1, -1, -1, -1};
+    bool tried = false;
+    bool available = false;
+    PerfTotals frame, shot;
+    PerfTotals lastFrame, lastShot;
+    uint32_t nShots = 0;
+};
+
+inline thread_local PerfState perfState;
+
+#if defined(__linux__) && defined(HEX_PERF_COUNTERS)
+
+inline bool perfOpen() {
+    auto& ps = perfState;
+    if (ps.tried)
+        return ps.available;
+    ps.tried = true;
+    const uint64_t configs[PERF_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (int c = 0; c < PERF_COUNTERS; ++c) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[c];
+        attr.disabled = (c == 0);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        ps.fds[c] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, (c == 0) ? -1 : ps.fds[0], 0);
+        if (ps.fds[c] < 0) {
+            fprintf(stderr, "HEX: perf_event_open failed for %s, hardware counters disabled\n", PERF_COUNTER_NAMES[c]);
+            for (int i = 0; i < c; ++i)
+                close(ps.fds[i]);
+            return false;
+        }
+    }
+    ioctl(ps.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    ps.available = true;
+    return true;
+}
+
+inline bool perfRead(PerfValues& out) {
+    struct { uint64_t nr; uint64_t values[PERF_COUNTERS]; } data;
+    if (!perfOpen() || read(perfState.fds[0], &data, sizeof(data)) != sizeof(data))
+        return false;
+    for (int c = 0; c < PERF_COUNTERS; ++c)
+        out[c] = data.values[c];
+    return true;
+}
+
+class PerfScope {
+    PerfPhase _phase;
+    PerfValues _start;
+    bool _ok;
+
+public:
+
+    PerfScope(PerfPhase phase) :
+        _phase(phase)
+    {
+        _ok = perfRead(_start);
+    }
+
+    ~PerfScope() {
+        PerfValues end;
+        if (!_ok || !perfRead(end))
+            return;
+        auto& ps = perfState;
+        for (int c = 0; c < PERF_COUNTERS; ++c) {
+            ps.frame.phases[_phase].values[c] += end[c] - _start[c];
+            ps.shot.phases[_phase].values[c] += end[c] - _start[c];
+        }
+        ps.frame.phases[_phase].calls++;
+        ps.shot.phases[_phase].calls++;
+    }
+};
+
+#else
+
+inline bool perfOpen() { return false; }
+
+#endif
+
+inline void perfEndFrame() {
+    perfState.lastFrame = perfState.frame;
+    perfState.frame = {};
+}
+
+inline void perfEndShot() {
+    perfState.lastShot = perfState.shot;
+    perfState.shot = {};
+    perfState.nShots++;
+}
+
+inline void perfFormat(char* buf, size_t sz, const PerfTotals& totals) {
+    size_t off = 0;
+    for (int p = 0; p < PERF_PHASES && off < sz; ++p) {
+        const auto& ph = totals.phases[p];
+        if (ph.calls == 0)
+            continue;
+        double ipc = ph.values[PERF_CYCLES] ? double(ph.values[PERF_INSTRUCTIONS]) / ph.values[PERF_CYCLES] : 0.0;
+        off += snprintf(buf + off, sz - off, "%s: %llu cyc, ipc %.2f, %llu cache miss, %llu br miss; ", PERF_PHASE_NAMES[p],
+            (unsigned long long)ph.values[PERF_CYCLES], ipc, (unsigned long long)ph.values[PERF_CACHE_MISSES], (unsigned long long)ph.values[PERF_BRANCH_MISSES]);
+    }
+    if (off == 0 && sz > 0)
+        buf[0] = '\0';
+}
+
+// writes {"available":..,"<phase>":{"calls":..,"cycles":..,...},...} averaged over n samples (frames, shots, iterations)
+inline void perfWriteJson(FILE* f, const PerfTotals& totals, uint64_t n = 1) {
+    n = n ? n : 1;
+    fprintf(f, "{\"available\":%s", perfOpen() ? "true" : "false");
+    for (int p = 0; p < PERF_PHASES; ++p) {
+        const auto& ph = totals.phases[p];
+        fprintf(f, ",\"%s\":{\"calls\":%.3f", PERF_PHASE_NAMES[p], double(ph.calls) / n);
+        for (int c = 0; c < PERF_COUNTERS; ++c)
+            fprintf(f, ",\"%s\":%.1f", PERF_COUNTER_NAMES[c], double(ph.values[c]) / n);
+        fprintf(f, "}");
+    }
+    fprintf(f, "}");
+}
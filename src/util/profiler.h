@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#define PROFILER_RING_SIZE    8192
+#define PROFILER_MAX_THREADS  64
+#define PROFILER_MAX_ZONES    64
+
+#ifdef HEX_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(_profileZone, __LINE__)(name)
+#define PROFILE_FRAME() profilerNextFrame()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FRAME()
+#endif
+
+struct ProfileEvent {
+    const char* name;
+    uint64_t start, end;
+    uint32_t frame;
+};
+
+// written by its owning thread only, readers may observe a slot that is being overwritten
+struct ProfileRing {
+    std::array<ProfileEvent, PROFILER_RING_SIZE> events;
+    std::atomic<uint64_t> head = 0;
+    uint32_t tid;
+
+    void push(const ProfileEvent& ev) {
+        auto h = head.load(std::memory_order_relaxed);
+        events[h % PROFILER_RING_SIZE] = ev;
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+struct ProfileZoneStats {
+    const char* name;
+    uint64_t total, max;
+    uint32_t count;
+};
+
+inline std::array<std::atomic<ProfileRing*>, PROFILER_MAX_THREADS> profilerRings = {};
+inline std::atomic<uint32_t> profilerNRings = 0;
+inline std::atomic<uint32_t> profilerFrame = 0;
+inline thread_local const char* profilerCurZone = nullptr;
+
+inline uint64_t profilerNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// rings are allocated once per thread and never freed, so readers can hold on to them
+inline ProfileRing* profilerThreadRing() {
+    thread_local ProfileRing* ring = nullptr;
+    if (!ring) {
+        auto idx = profilerNRings.fetch_add(1);
+        if (idx >= PROFILER_MAX_THREADS)
+            return nullptr;
+        ring = new ProfileRing();
+        ring->tid = idx;
+        profilerRings[idx].store(ring, std::memory_order_release);
+    }
+    return ring;
+}
+
+inline void profilerNextFrame() {
+    profilerFrame.fetch_add(1, std::memory_order_relaxed);
+}
+
+class ProfileZone {
+    const char* _name;
+    const char* _parent;
+    uint64_t _start;
+    uint32_t _frame;
+
+public:
+
+    ProfileZone(const char* name) :
+        _name(name),
+        _parent(profilerCurZone),
+        _start(profilerNow()),
+        _frame(profilerFrame.load(std::memory_order_relaxed))
+    {
+        profilerCurZone = name;
+    }
+
+    ~ProfileZone() {
+        profilerCurZone = _parent;
+        if (auto ring = profilerThreadRing())
+            ring->push({_name, _start, profilerNow(), _frame});
+    }
+};
+
+template <typename F>
+void profilerForEach(F&& f) {
+    uint32_t n = std::min(profilerNRings.load(), (uint32_t)PROFILER_MAX_THREADS);
+    for (uint32_t r = 0; r < n; ++r) {
+        auto ring = profilerRings[r].load(std::memory_order_acquire);
+        if (!ring)
+            continue;
+        auto head = ring->head.load(std::memory_order_acquire);
+        for (auto i = head - std::min(head, (uint64_t)PROFILER_RING_SIZE); i < head; ++i)
+            f(*ring, ring->events[i % PROFILER_RING_SIZE]);
+    }
+}
+
+// fills stats with the zones recorded over the last nFrames frames, slowest first
+inline size_t profilerCollect(std::array<ProfileZoneStats, PROFILER_MAX_ZONES>& stats, uint32_t nFrames) {
+    size_t n = 0;
+    uint32_t cur = profilerFrame.load(std::memory_order_relaxed);
+    profilerForEach([&](const ProfileRing&, const ProfileEvent& ev) {
+        if (ev.frame + nFrames < cur || ev.frame > cur)
+            return;
+        size_t i = 0;
+        while (i < n && stats[i].name != ev.name) i++;
+        if (i == n) {
+            if (n == stats.size())
+                return;
+            stats[n++] = {ev.name, 0, 0, 0};
+        }
+        auto dur = ev.end - ev.start;
+        stats[i].total += dur;
+        stats[i].max = std::max(stats[i].max, dur);
+        stats[i].count++;
+    });
+    std::sort(stats.begin(), stats.begin() + n, [](const auto& a, const auto& b) { return a.max > b.max; });
+    return n;
+}
+
+// dumps every buffered zone in the Chrome trace_event format (chrome://tracing, Perfetto)
+inline bool profilerWriteTrace(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f)
+        return false;
+    uint64_t base = UINT64_MAX;
+    profilerForEach([&](const ProfileRing&, const ProfileEvent& ev) { base = std::min(base, ev.start); });
+    bool first = true;
+    fprintf(f, "{\"traceEvents\":[");
+    profilerForEach([&](const ProfileRing& ring, const ProfileEvent& ev) {
+        fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+            first ? "" : ",", ev.name, ring.tid, (ev.start - base) * 0.001, (ev.end - ev.start) * 0.001, ev.frame);
+        first = false;
+    });
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+    return true;
+}
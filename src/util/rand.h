@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+// xoshiro128** seeded through splitmix64, the generator behind raylib's SetRandomSeed/GetRandomValue
+// (rprand). Keeping a copy here lets every game state draw from its own seed on any thread
+struct RandState {
+    uint32_t s[4];
+};
+
+inline uint64_t randSplitmix(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+inline RandState randSeed(uint64_t seed) {
+    RandState r;
+    r.s[0] = (uint32_t)(randSplitmix(seed) & 0xffffffff);
+    r.s[1] = (uint32_t)((randSplitmix(seed) & 0xffffffff00000000ull) >> 32);
+    r.s[2] = (uint32_t)(randSplitmix(seed) & 0xffffffff);
+    r.s[3] = (uint32_t)((randSplitmix(seed) & 0xffffffff00000000ull) >> 32);
+    return r;
+}
+
+inline uint32_t randRotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+inline uint32_t randNext(RandState& r) {
+    uint32_t result = randRotl(r.s[1] * 5, 7) * 9;
+    uint32_t t = r.s[1] << 9;
+    r.s[2] ^= r.s[0];
+    r.s[3] ^= r.s[1];
+    r.s[1] ^= r.s[2];
+    r.s[0] ^= r.s[3];
+    r.s[2] ^= t;
+    r.s[3] = randRotl(r.s[3], 11);
+    return result;
+}
+
+// inclusive range, same mapping as GetRandomValue
+inline int randValue(RandState& r, int min, int max) {
+    if (min > max) {
+        int tmp = max;
+        max = min;
+        min = tmp;
+    }
+    return (int)(randNext(r) % (uint32_t)(abs(max - min) + 1)) + min;
+}
+
+// in [0, 1)
+inline float randFloat(RandState& r) {
+    return (randNext(r) >> 8) * (1.0f / 16777216.0f);
+}
+
+// cosmetic randomness (particle spread, sound variations) that never feeds back into the simulation
+inline thread_local RandState fxRand = randSeed(0x48455846);
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "varint.h"
+
+// a replay is a fixed header, the exported starting state and then a flat stream of tagged records.
+// Nothing points backwards or needs an index, so a file can be appended to while recording
+// and read front to back through a small window or straight out of a mapped file
+#define REPLAY_MAGIC 0x52584548 // "HEXR"
+#define REPLAY_VERSION 2
+#define REPLAY_WRITE_BYTES 4096
+#define REPLAY_WINDOW_BYTES (64 * 1024)
+
+struct ReplayHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t layoutHash;
+    uint32_t stateSize;
+    uint32_t settings;
+};
+
+class ReplayWriter
+{
+    FILE* _file = nullptr;
+    std::array<uint8_t, REPLAY_WRITE_BYTES> _buf;
+    size_t _len = 0;
+    uint64_t _written = 0;
+
+public:
+
+    bool open(const char* path) {
+        close();
+        _file = fopen(path, "wb");
+        _written = 0;
+        return _file;
+    }
+
+    bool isOpen() const { return _file; }
+    uint64_t written() const { return _written + _len; }
+
+    void flush() {
+        if (_file && _len)
+            fwrite(_buf.data(), 1, _len, _file);
+        _written += _len;
+        _len = 0;
+    }
+
+    void close() {
+        if (!_file)
+            return;
+        flush();
+        fclose(_file);
+        _file = nullptr;
+    }
+
+    void putByte(uint8_t b) {
+        if (_len == _buf.size())
+            flush();
+        _buf[_len++] = b;
+    }
+
+    void putVarint(uint64_t v) {
+        if (_len + VARINT_MAX_BYTES > _buf.size())
+            flush();
+        _len += varintPut(&_buf[_len], v);
+    }
+
+    void putSigned(int64_t v) {
+        putVarint(zigzagEncode(v));
+    }
+
+    void putBytes(const void* src, size_t n) {
+        if (_len + n > _buf.size()) {
+            flush();
+            if (n > _buf.size()) {
+                if (_file)
+                    fwrite(src, 1, n, _file);
+                _written += n;
+                return;
+            }
+        }
+        memcpy(&_buf[_len], src, n);
+        _len += n;
+    }
+};
+
+// reads either a file through a sliding window or a caller-owned block of memory such as a mapped file
+class ReplayReader
+{
+    FILE* _file = nullptr;
+    std::array<uint8_t, REPLAY_WINDOW_BYTES> _buf;
+    const uint8_t* _data = nullptr;
+    size_t _pos = 0;
+    size_t _len = 0;
+    uint64_t _consumed = 0;
+
+    // makes at least n bytes available unless the input ends first
+    bool fill(size_t n) {
+        if (_len - _pos >= n)
+            return true;
+        if (!_file)
+            return false;
+        size_t left = _len - _pos;
+        memmove(_buf.data(), _buf.data() + _pos, left);
+        _consumed += _pos;
+        _pos = 0;
+        _len = left + fread(_buf.data() + left, 1, _buf.size() - left, _file);
+        return _len >= n;
+    }
+
+public:
+
+    ~ReplayReader() { close(); }
+
+    bool open(const char* path) {
+        close();
+        _file = fopen(path, "rb");
+        _data = _buf.data();
+        return _file;
+    }
+
+    void openMemory(const void* data, size_t size) {
+        close();
+        _data = (const uint8_t*)data;
+        _len = size;
+    }
+
+    void close() {
+        if (_file)
+            fclose(_file);
+        _file = nullptr;
+        _data = nullptr;
+        _pos = _len = 0;
+        _consumed = 0;
+    }
+
+    uint64_t consumed() const { return _consumed + _pos; }
+
+    bool atEnd() {
+        return !fill(1);
+    }
+
+    bool getByte(uint8_t& b) {
+        if (!fill(1))
+            return false;
+        b = _data[_pos++];
+        return true;
+    }
+
+    bool getVarint(uint64_t& v) {
+        fill(VARINT_MAX_BYTES);
+        size_t n = varintGet(_data + _pos, _len - _pos, v);
+        _pos += n;
+        return n;
+    }
+
+    bool getSigned(int64_t& v) {
+        uint64_t u;
+        if (!getVarint(u))
+            return false;
+        v = zigzagDecode(u);
+        return true;
+    }
+
+    bool getBytes(void* dst, size_t n) {
+        auto out = (uint8_t*)dst;
+        while (n) {
+            if (!fill(1))
+                return false;
+            size_t k = std::min(n, _len - _pos);
+            memcpy(out, _data + _pos, k);
+            _pos += k;
+            out += k;
+            n -= k;
+        }
+        return true;
+    }
+};
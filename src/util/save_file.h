@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+// windows.h clashes with raylib's names, MoveFileExA is declared by hand like the mapping calls in asset_pack.h
+extern "C" __declspec(dllimport) int __stdcall MoveFileExA(const char*, const char*, unsigned long);
+#else
+#include <unistd.h>
+#endif
+
+#include "layout.h"
+
+// a save record is a header, one FieldRecord per saved field and then the raw struct, the same shape as a state
+// blob, so a struct that gained, lost or moved fields still loads whatever it shares with the file. The checksum
+// covers everything after the header, a torn or damaged record is refused rather than half loaded
+#define SAVE_MAGIC 0x55584548 // "HEXU"
+#define SAVE_VERSION 1
+
+struct SaveHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t layoutHash;
+    uint32_t nFields;
+    uint32_t dataSize;
+    uint32_t sequence;
+    uint32_t checksum;
+};
+
+// FNV-1a, 32 bits
+inline uint32_t saveChecksum(const uint8_t* p, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+template <size_t N>
+std::vector<uint8_t> saveRecord(const FieldDesc (&fields)[N], uint64_t layoutHash, const void* data, uint32_t size, uint32_t sequence) {
+    std::vector<uint8_t> out(sizeof(SaveHeader) + N * sizeof(FieldRecord) + size);
+    auto p = out.data() + sizeof(SaveHeader);
+    for (auto& f : fields) {
+        auto rec = layoutRecord(f);
+        memcpy(p, &rec, sizeof(rec));
+        p += sizeof(rec);
+    }
+    memcpy(p, data, size);
+    SaveHeader hdr = {SAVE_MAGIC, SAVE_VERSION, layoutHash, (uint32_t)N, size, sequence, 0};
+    hdr.checksum = saveChecksum(out.data() + sizeof(hdr), out.size() - sizeof(hdr));
+    memcpy(out.data(), &hdr, sizeof(hdr));
+    return out;
+}
+
+enum SaveResult { SAVE_OK, SAVE_MIGRATED, SAVE_NOT_A_RECORD, SAVE_CORRUPT };
+
+// fills dst from a record. A record of another layout copies the fields that still match and leaves the rest
+template <size_t N>
+SaveResult loadRecord(const FieldDesc (&fields)[N], uint64_t layoutHash, void* dst, uint32_t size, const uint8_t* buf, size_t len) {
+    SaveHeader hdr;
+    if (len < sizeof(hdr))
+        return SAVE_NOT_A_RECORD;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.magic != SAVE_MAGIC)
+        return SAVE_NOT_A_RECORD;
+    size_t dataOff = sizeof(hdr) + size_t(hdr.nFields) * sizeof(FieldRecord);
+    if (hdr.version != SAVE_VERSION || dataOff + hdr.dataSize != len || saveChecksum(buf + sizeof(hdr), len - sizeof(hdr)) != hdr.checksum)
+        return SAVE_CORRUPT;
+    if (hdr.layoutHash == layoutHash && hdr.dataSize == size) {
+        memcpy(dst, buf + dataOff, size);
+        return SAVE_OK;
+    }
+    std::vector<FieldRecord> records(hdr.nFields);
+    memcpy(records.data(), buf + sizeof(hdr), records.size() * sizeof(FieldRecord));
+    layoutMigrate(fields, dst, records.data(), records.size(), buf + dataOff, hdr.dataSize);
+    return SAVE_MIGRATED;
+}
+
+// the file at path is replaced whole or not at all: the bytes go to path.tmp, are flushed to the device and the
+// temporary is then renamed over the old file
+inline bool writeFileAtomic(const char* path, const void* data, size_t n) {
+    std::string tmp = std::string(path) + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(data, 1, n, f) == n && fflush(f) == 0;
+#if defined(_WIN32)
+    ok = ok && _commit(_fileno(f)) == 0;
+#else
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    ok = (fclose(f) == 0) && ok;
+#if defined(_WIN32)
+    // MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH
+    ok = ok && MoveFileExA(tmp.c_str(), path, 0x1 | 0x8);
+#else
+    ok = ok && rename(tmp.c_str(), path) == 0;
+#endif
+    if (!ok)
+        remove(tmp.c_str());
+    return ok;
+}
+
+// the whole file, empty when it cannot be read
+inline std::vector<uint8_t> readFile(const char* path) {
+    std::vector<uint8_t> out;
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return out;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out.resize(n > 0 ? size_t(n) : 0);
+    if (fread(out.data(), 1, out.size(), f) != out.size())
+        out.clear();
+    fclose(f);
+    return out;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// rectangles packed into rows ("shelves") that fill left to right. A shelf opens at the height of the first
+// rectangle put on it, rounded up to a multiple of 16 so freed shelves suit most later rectangles, and takes
+// anything up to that height that is not much shorter. The atlas can grow taller under its shelves. When nothing
+// fits and the caller allows it, the least recently used shelf that is neither pinned nor used since `now` is
+// emptied and reused, so callers have to forget whatever they had placed on the shelf that alloc() reports as evicted
+class ShelfAtlas
+{
+public:
+
+    struct Shelf {
+        int y, height, x;
+        uint64_t lastUsed;
+        bool pinned;
+    };
+
+private:
+
+    int _width = 0, _height = 0, _top = 0;
+    std::vector<Shelf> _shelves;
+
+    // a shelf wastes at most a third of its height on a shorter rectangle
+    static bool suits(const Shelf& s, int h) { return h <= s.height && 3 * h >= 2 * s.height; }
+
+public:
+
+    ShelfAtlas() = default;
+    ShelfAtlas(int width, int height) { reset(width, height); }
+
+    void reset(int width, int height) {
+        _width = width;
+        _height = height;
+        _top = 0;
+        _shelves.clear();
+    }
+
+    int width() const { return _width; }
+    int height() const { return _height; }
+    int usedHeight() const { return _top; }
+    int shelfCount() const { return (int)_shelves.size(); }
+    const Shelf& shelf(int i) const { return _shelves[i]; }
+
+    // more rows below the ones in use, the shelves keep their places
+    void grow(int height) { _height = std::max(_height, height); }
+
+    // keeps the top `height` rows, already filled by the caller, out of reach for good
+    void reserve(int height) {
+        if (height <= 0 || _top + height > _height)
+            return;
+        _shelves.push_back({_top, height, _width, 0, true});
+        _top += height;
+    }
+
+    void touch(int shelf, uint64_t now) {
+        if (_shelves[shelf].lastUsed < now)
+            _shelves[shelf].lastUsed = now;
+    }
+
+    void pin(int shelf) { _shelves[shelf].pinned = true; }
+
+    // shelf index of the placed rectangle or -1 when it does not fit. Without evicted only free room is used,
+    // otherwise a shelf may be emptied to make room and *evicted is that shelf, or -1
+    int alloc(int w, int h, uint64_t now, int* x, int* y, int* evicted = nullptr) {
+        if (evicted)
+            *evicted = -1;
+        if (w > _width || h > _height)
+            return -1;
+        int best = -1;
+        for (int i = 0; i < (int)_shelves.size(); ++i) {
+            auto& s = _shelves[i];
+            if (s.x + w <= _width && suits(s, h) && (best < 0 || s.height < _shelves[best].height))
+                best = i;
+        }
+        int rows = std::min((h + 15) & ~15, _height - _top);
+        if (best < 0 && h <= rows) {
+            _shelves.push_back({_top, rows, 0, 0, false});
+            _top += rows;
+            best = (int)_shelves.size() - 1;
+        }
+        if (best < 0 && !evicted)
+            return -1;
+        if (best < 0) {
+            for (int i = 0; i < (int)_shelves.size(); ++i) {
+                auto& s = _shelves[i];
+                if (!s.pinned && s.lastUsed < now && suits(s, h) && (best < 0 || s.lastUsed < _shelves[best].lastUsed))
+                    best = i;
+            }
+            if (best < 0)
+                return -1;
+            _shelves[best].x = 0;
+            *evicted = best;
+        }
+        auto& s = _shelves[best];
+        *x = s.x;
+        *y = s.y;
+        s.x += w;
+        touch(best, now);
+        return best;
+    }
+};
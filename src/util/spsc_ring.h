@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <vector>
+
+// single producer, single consumer ring without locks, so the consumer can be a real-time callback.
+// The producer only moves the tail and the consumer only moves the head, each side copies in at most two runs
+template <typename T>
+class SpscRing
+{
+    std::vector<T> _buf;
+    size_t _mask;
+    alignas(64) std::atomic<size_t> _head = 0;
+    alignas(64) std::atomic<size_t> _tail = 0;
+
+public:
+
+    // the capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) : _buf(std::bit_ceil(std::max<size_t>(capacity, 2))), _mask(_buf.size() - 1) {}
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return _buf.size(); }
+
+    // exact on either side for what that side may take, only a hint anywhere else
+    size_t size() const { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+    size_t space() const { return capacity() - size(); }
+
+    // producer side, returns how many items fit
+    size_t push(const T* src, size_t n) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        n = std::min(n, capacity() - (tail - _head.load(std::memory_order_acquire)));
+        size_t at = tail & _mask, first = std::min(n, capacity() - at);
+        std::copy(src, src + first, _buf.begin() + at);
+        std::copy(src + first, src + n, _buf.begin());
+        _tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // consumer side, returns how many items were there
+    size_t pop(T* dst, size_t n) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        n = std::min(n, _tail.load(std::memory_order_acquire) - head);
+        size_t at = head & _mask, first = std::min(n, capacity() - at);
+        std::copy(_buf.begin() + at, _buf.begin() + at + first, dst);
+        std::copy(_buf.begin(), _buf.begin() + (n - first), dst + first);
+        _head.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    // only while neither side is running
+    void clear() {
+        _head.store(0);
+        _tail.store(0);
+    }
+
+    // empties the ring and sizes it for at least capacity items, only while neither side is running
+    void resize(size_t capacity) {
+        _buf.assign(std::bit_ceil(std::max<size_t>(capacity, 2)), T());
+        _mask = _buf.size() - 1;
+        clear();
+    }
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of workers with one deque each. Owners push and pop at the back, idle workers steal
+// from the front of the others, so uneven tasks (long and short replays, deep and shallow searches)
+// spread out without a shared queue. wait() runs tasks on the calling thread too
+class ThreadPool
+{
+    struct Queue {
+        std::mutex m;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _threads;
+    std::mutex _m;
+    std::condition_variable _wake, _done;
+    std::atomic<int64_t> _queued = 0;
+    std::atomic<int64_t> _pending = 0;
+    std::atomic<size_t> _next = 0;
+    bool _stop = false;
+
+    // a thread only counts as a worker of the pool that started it, one waiting on another pool helps there as an outsider
+    struct Worker {
+        const ThreadPool* pool = nullptr;
+        int index = -1;
+    };
+
+    static Worker& thisWorker() {
+        thread_local Worker w;
+        return w;
+    }
+
+    int workerIndex() const {
+        const auto& w = thisWorker();
+        return w.pool == this ? w.index : -1;
+    }
+
+    bool popOwn(size_t q, std::function<void()>& task) {
+        std::lock_guard<std::mutex> lock(_queues[q]->m);
+        auto& tasks = _queues[q]->tasks;
+        if (tasks.empty())
+            return false;
+        task = std::move(tasks.back());
+        tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t q, std::function<void()>& task) {
+        std::lock_guard<std::mutex> lock(_queues[q]->m);
+        auto& tasks = _queues[q]->tasks;
+        if (tasks.empty())
+            return false;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+        return true;
+    }
+
+    bool take(int self, std::function<void()>& task) {
+        size_t n = _queues.size();
+        if (self >= 0 && popOwn(self, task))
+            return true;
+        size_t start = (self >= 0) ? size_t(self) + 1 : _next.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < n; ++i)
+            if (steal((start + i) % n, task))
+                return true;
+        return false;
+    }
+
+    void run(std::function<void()>& task) {
+        _queued.fetch_sub(1);
+        task();
+        task = nullptr;
+        if (_pending.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(_m);
+            _done.notify_all();
+        }
+    }
+
+    void work(int self) {
+        thisWorker() = {this, self};
+        std::function<void()> task;
+        for (;;) {
+            if (take(self, task)) {
+                run(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_m);
+            _wake.wait(lock, [&] { return _stop || _queued.load() > 0; });
+            if (_stop)
+                return;
+        }
+    }
+
+public:
+
+    // 0 threads means one per hardware thread, the caller of wait() is not counted
+    explicit ThreadPool(size_t nThreads = 0) {
+        if (nThreads == 0)
+            nThreads = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < nThreads; ++i)
+            _queues.push_back(std::make_unique<Queue>());
+        for (size_t i = 0; i < nThreads; ++i)
+            _threads.emplace_back([this, i] { work((int)i); });
+    }
+
+    ~ThreadPool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (auto& t : _threads)
+            t.join();
+    }
+
+    size_t size() const { return _threads.size(); }
+
+    // index of this pool's worker running the current task, -1 on other threads
+    int currentWorker() const { return workerIndex(); }
+
+    // tasks submitted from a worker go to its own deque, others are dealt round-robin
+    void submit(std::function<void()> fn) {
+        int self = workerIndex();
+        size_t q = (self >= 0) ? size_t(self) : _next.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+        _pending.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(_queues[q]->m);
+            _queues[q]->tasks.push_back(std::move(fn));
+        }
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _queued.fetch_add(1);
+        }
+        _wake.notify_one();
+    }
+
+    // blocks until every submitted task has finished, helping with queued ones meanwhile
+    void wait() {
+        std::function<void()> task;
+        while (_pending.load() > 0) {
+            if (take(workerIndex(), task)) {
+                run(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_m);
+            _done.wait(lock, [&] { return _pending.load() == 0; });
+        }
+    }
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// one writer and one reader exchanging whole values without locks or waiting. The writer fills its slot and
+// publishes it, the reader takes the newest published slot and keeps it until its next take. Values published
+// while the reader was busy replace each other, publish() tells the writer when that happened
+template <typename T>
+class TripleBuffer
+{
+    static constexpr uint8_t FRESH = 4;
+
+    std::array<T, 3> _slots;
+    alignas(64) std::atomic<uint8_t> _shared = 2;
+    alignas(64) uint8_t _write = 0;
+    alignas(64) uint8_t _read = 1;
+
+public:
+
+    TripleBuffer() = default;
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // writer side. After a publish that returned true the slot holds the value the reader never took
+    T& writeSlot() { return _slots[_write]; }
+
+    bool publish() {
+        uint8_t prev = _shared.exchange(_write | FRESH, std::memory_order_acq_rel);
+        _write = prev & ~FRESH;
+        return prev & FRESH;
+    }
+
+    // reader side, false when nothing was published since the last take
+    bool take() {
+        if (!(_shared.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        _read = _shared.exchange(_read, std::memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+
+    const T& readSlot() const { return _slots[_read]; }
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// LEB128, 7 bits per byte with the high bit set on every byte but the last
+#define VARINT_MAX_BYTES 10
+
+inline size_t varintPut(uint8_t* dst, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        dst[n++] = uint8_t(v) | 0x80;
+        v >>= 7;
+    }
+    dst[n++] = uint8_t(v);
+    return n;
+}
+
+// returns the number of bytes read, 0 when the input ends mid-value
+inline size_t varintGet(const uint8_t* src, size_t avail, uint64_t& v) {
+    v = 0;
+    for (size_t n = 0; n < avail && n < VARINT_MAX_BYTES; ++n) {
+        v |= uint64_t(src[n] & 0x7f) << (7 * n);
+        if (!(src[n] & 0x80))
+            return n + 1;
+    }
+    return 0;
+}
+
+inline int64_t zigzagDecode(uint64_t v) {
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+inline uint64_t zigzagEncode(int64_t v) {
+    return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
@@ -0,0 +1,100 @@
+// hex_pack: decodes the embedded assets once at build time into the pack the game maps at startup.
+// Images are stored as RGBA8, sounds as PCM frames and the font as the atlas rows of its startup glyphs with their rects and metrics
+#include "../src/game.cpp"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+struct PackBuilder {
+    std::vector<uint8_t> blob;
+
+    uint64_t append(const void* src, uint64_t n) {
+        uint64_t off = packAlign(blob.size());
+        blob.resize(off + n);
+        memcpy(blob.data() + off, src, n);
+        return off;
+    }
+};
+
+bool packAsset(PackBuilder& pb, int id, PackEntry& e) {
+    auto& src = ASSET_SOURCES[id];
+    DecodedAsset out = {};
+    decodeSource(id, out);
+    e = {};
+    strncpy(e.name, src.name, ASSET_PACK_NAME - 1);
+    e.kind = src.kind;
+    if (src.kind == PACK_WAVE) {
+        auto& w = out.wave;
+        if (!w.data)
+            return false;
+        e.frameCount = w.frameCount;
+        e.sampleRate = w.sampleRate;
+        e.sampleSize = w.sampleSize;
+        e.channels = w.channels;
+        e.dataBytes = uint64_t(w.frameCount) * w.channels * w.sampleSize / 8;
+        e.data = pb.append(w.data, e.dataBytes);
+        UnloadWave(w);
+        return true;
+    }
+    auto& img = out.image;
+    if (!img.data)
+        return false;
+    if (src.kind == PACK_IMAGE)
+        ImageFormat(&img, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    e.width = img.width;
+    e.height = img.height;
+    e.format = img.format;
+    e.dataBytes = GetPixelDataSize(img.width, img.height, img.format);
+    e.data = pb.append(img.data, e.dataBytes);
+    UnloadImage(img);
+    if (src.kind == PACK_FONT) {
+        std::vector<PackGlyph> glyphs(out.glyphCount);
+        for (int i = 0; i < out.glyphCount; ++i)
+            glyphs[i] = {out.glyphs[i].value, out.glyphs[i].offsetX, out.glyphs[i].offsetY, out.glyphs[i].advanceX};
+        e.baseSize = FONT_SIZE;
+        e.glyphCount = out.glyphCount;
+        e.glyphPadding = FONT_PADDING;
+        e.recs = pb.append(out.recs, out.glyphCount * sizeof(Rectangle));
+        e.glyphs = pb.append(glyphs.data(), glyphs.size() * sizeof(PackGlyph));
+        UnloadFontData(out.glyphs, out.glyphCount);
+        MemFree(out.recs);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s OUT.hexpack\n", argv[0]);
+        return 2;
+    }
+    SetTraceLogLevel(LOG_WARNING);
+    PackBuilder pb;
+    pb.blob.resize(sizeof(PackHeader) + ASSET_COUNT * sizeof(PackEntry));
+    std::vector<PackEntry> entries(ASSET_COUNT);
+    for (int i = 0; i < ASSET_COUNT; ++i) {
+        if (!packAsset(pb, i, entries[i])) {
+            fprintf(stderr, "hex_pack: could not decode %s\n", ASSET_SOURCES[i].name);
+            return 1;
+        }
+    }
+    pb.blob.resize(packAlign(pb.blob.size()));
+    PackHeader hdr = {ASSET_PACK_MAGIC, ASSET_PACK_VERSION, ASSET_COUNT, ASSET_PACK_ALIGN, pb.blob.size(), assetSourceHash()};
+    memcpy(pb.blob.data(), &hdr, sizeof(hdr));
+    memcpy(pb.blob.data() + sizeof(hdr), entries.data(), entries.size() * sizeof(PackEntry));
+
+    FILE* f = fopen(argv[1], "wb");
+    if (!f || fwrite(pb.blob.data(), 1, pb.blob.size(), f) != pb.blob.size()) {
+        fprintf(stderr, "hex_pack: could not write %s\n", argv[1]);
+        if (f)
+            fclose(f);
+        return 1;
+    }
+    fclose(f);
+    uint64_t embedded = 0;
+    for (auto& src : ASSET_SOURCES)
+        embedded += src.len;
+    printf("hex_pack: %d assets, %llu embedded bytes -> %llu bytes in %s\n", ASSET_COUNT, (unsigned long long)embedded,
+        (unsigned long long)pb.blob.size(), argv[1]);
+    return 0;
+}
@@ -0,0 +1,182 @@
+// hex_reload: hot-reloads a played state between two builds of the game module whose GameState layouts differ, the
+// way a reload onto a rebuilt module meets it. The second module is built with HEX_LAYOUT_VARIANT, which moves every
+// SimState field and adds one the first module does not have. Exits non-zero when a state does not survive the trip
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#define RELOAD_DT (1.0f / 60.0f)
+#define RELOAD_FRAMES (8 * 60)
+#define RELOAD_SHOT_FRAMES 60
+
+// the modules are only reached through their exports, a GameState is never touched on this side
+struct GameState;
+
+struct Module {
+    const char* path = nullptr;
+    void* lib = nullptr;
+    GameState* (*create)(unsigned int seed);
+    void (*destroy)(GameState* gs);
+    void (*shoot)(GameState& gs, float dir);
+    void (*step)(GameState& gs, float dt);
+    uint64_t (*hash)(const GameState& gs);
+    uint64_t (*layoutHash)();
+    size_t (*exportState)(const GameState& gs, void* buf, size_t cap);
+    bool (*importState)(GameState& gs, const void* buf, size_t size);
+    void (*shutdown)();
+};
+
+void* findSymbol(void* lib, const char* name) {
+#ifdef _WIN32
+    return (void*)GetProcAddress((HMODULE)lib, name);
+#else
+    return dlsym(lib, name);
+#endif
+}
+
+// each module is loaded privately so both keep their own copy of every symbol they share a name with
+bool loadModule(Module& m, const char* path) {
+    m.path = path;
+#ifdef _WIN32
+    m.lib = (void*)LoadLibraryA(path);
+#else
+    m.lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif
+    if (!m.lib) {
+        fprintf(stderr, "could not load %s\n", path);
+        return false;
+    }
+    bool ok = true;
+    auto bind = [&](auto& fn, const char* name) {
+        fn = (std::remove_reference_t<decltype(fn)>)findSymbol(m.lib, name);
+        if (!fn) {
+            fprintf(stderr, "%s does not export %s\n", path, name);
+            ok = false;
+        }
+    };
+    bind(m.create, "createHeadless");
+    bind(m.destroy, "destroyHeadless");
+    bind(m.shoot, "shootHeadless");
+    bind(m.step, "stepHeadless");
+    bind(m.hash, "hashHeadless");
+    bind(m.layoutHash, "getStateLayoutHash");
+    bind(m.exportState, "exportState");
+    bind(m.importState, "importState");
+    bind(m.shutdown, "shutdownGame");
+    return ok;
+}
+
+void unloadModule(Module& m) {
+    if (!m.lib)
+        return;
+    if (m.shutdown)
+        m.shutdown();
+#ifdef _WIN32
+    FreeLibrary((HMODULE)m.lib);
+#else
+    dlclose(m.lib);
+#endif
+    m.lib = nullptr;
+}
+
+// the same shots at the same frames whichever module plays them
+void play(const Module& m, GameState& gs, int from, int frames) {
+    for (int f = from; f < from + frames; ++f) {
+        if (f % RELOAD_SHOT_FRAMES == 0)
+            m.shoot(gs, float(f / RELOAD_SHOT_FRAMES % 7) * 0.2f - 0.6f);
+        m.step(gs, RELOAD_DT);
+    }
+}
+
+std::vector<char> exportBlob(const Module& m, const GameState& gs) {
+    std::vector<char> blob(m.exportState(gs, nullptr, 0));
+    m.exportState(gs, blob.data(), blob.size());
+    return blob;
+}
+
+// dst has to end up where src's own module gets by playing the same frames from the seed, then both play on
+bool checkTrip(const char* what, const Module& from, GameState& src, const Module& to, unsigned int seed) {
+    auto blob = exportBlob(from, src);
+    GameState* dst = to.create(seed + 1);
+    GameState* ref = to.create(seed);
+    play(to, *ref, 0, RELOAD_FRAMES);
+    bool imported = to.importState(*dst, blob.data(), blob.size());
+    uint64_t got = to.hash(*dst), want = to.hash(*ref);
+    play(to, *dst, RELOAD_FRAMES, RELOAD_FRAMES);
+    play(to, *ref, RELOAD_FRAMES, RELOAD_FRAMES);
+    uint64_t gotOn = to.hash(*dst), wantOn = to.hash(*ref);
+    bool ok = imported && got == want && gotOn == wantOn;
+    printf("  {\"trip\":\"%s\",\"imported\":%s,\"hash\":\"%016llx\",\"expected\":\"%016llx\",\"played_on\":\"%016llx\",\"expected_on\":\"%016llx\",\"ok\":%s}",
+        what, imported ? "true" : "false", (unsigned long long)got, (unsigned long long)want, (unsigned long long)gotOn,
+        (unsigned long long)wantOn, ok ? "true" : "false");
+    to.destroy(dst);
+    to.destroy(ref);
+    return ok;
+}
+
+int usage(const char* exe) {
+    fprintf(stderr, "usage: %s [--seed N] [MODULE VARIANT_MODULE]\n", exe);
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    unsigned int seed = 1337;
+    const char* paths[2] = {nullptr, nullptr};
+    int nPaths = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else if (argv[i][0] != '-' && nPaths < 2)
+            paths[nPaths++] = argv[i];
+        else
+            return usage(argv[0]);
+    }
+#if defined(HEX_RELOAD_MODULE_PATH) && defined(HEX_RELOAD_VARIANT_PATH)
+    if (nPaths == 0) {
+        paths[0] = HEX_RELOAD_MODULE_PATH;
+        paths[1] = HEX_RELOAD_VARIANT_PATH;
+        nPaths = 2;
+    }
+#endif
+    if (nPaths != 2)
+        return usage(argv[0]);
+
+    Module a, b;
+    if (!loadModule(a, paths[0]) || !loadModule(b, paths[1])) {
+        unloadModule(a);
+        unloadModule(b);
+        return 1;
+    }
+    bool ok = a.layoutHash() != b.layoutHash();
+    printf("{\n  \"seed\":%u,\"layout\":\"%016llx\",\"variant_layout\":\"%016llx\",\"trips\":[\n", seed,
+        (unsigned long long)a.layoutHash(), (unsigned long long)b.layoutHash());
+    if (!ok)
+        fprintf(stderr, "%s and %s share a layout, nothing would be migrated\n", paths[0], paths[1]);
+
+    GameState* src = a.create(seed);
+    play(a, *src, 0, RELOAD_FRAMES);
+    ok &= checkTrip("forward", a, *src, b, seed);
+    printf(",\n");
+    // and back again: the variant's extra field is left behind, everything else has to come home unchanged
+    GameState* mid = b.create(seed + 1);
+    auto blob = exportBlob(a, *src);
+    ok &= b.importState(*mid, blob.data(), blob.size());
+    ok &= checkTrip("back", b, *mid, a, seed);
+    printf("\n  ],\n  \"result\":\"%s\"\n}\n", ok ? "ok" : "failed");
+    b.destroy(mid);
+    a.destroy(src);
+
+    unloadModule(a);
+    unloadModule(b);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+// hex_replay: re-simulates recorded sessions headlessly at full speed and checks the final state against the recording.
+// The game translation unit is compiled in headless mode, the same way hex_bench does it
+#include "../src/game.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s REPLAY...\n", argv[0]);
+        return 2;
+    }
+    SetTraceLogLevel(LOG_WARNING);
+    auto gs = std::make_unique<GameState>();
+    auto in = std::make_unique<ReplayReader>();
+    int failed = 0;
+    printf("[\n");
+    for (int i = 1; i < argc; ++i) {
+        ReplayReport rep = {REPLAY_BAD_FILE};
+        auto t0 = Clock::now();
+        if (in->open(argv[i]))
+            rep = playReplay(*gs, *in);
+        double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+        uint64_t bytes = in->consumed();
+        in->close();
+        failed += (rep.result != REPLAY_OK);
+        printf("  {\"file\":\"%s\",\"result\":\"%s\",\"frames\":%llu,\"bytes\":%llu,\"sim_seconds\":%.2f,\"wall_ms\":%.3f,\"frames_per_sec\":%.0f,"
+            "\"score\":%d,\"claimed_score\":%d,\"hash\":\"%016llx\",\"claimed_hash\":\"%016llx\"}%s\n",
+            argv[i], replayResultName(rep.result), (unsigned long long)rep.frames, (unsigned long long)bytes, rep.simSeconds, sec * 1000.0,
+            sec > 0 ? rep.frames / sec : 0.0, rep.score, rep.claimedScore, (unsigned long long)rep.hash, (unsigned long long)rep.claimedHash,
+            (i + 1 < argc) ? "," : "");
+    }
+    printf("]\n");
+    shutdownGame();
+    return failed ? 1 : 0;
+}
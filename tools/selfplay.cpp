@@ -0,0 +1,284 @@
+// hex_selfplay: plays many headless games at once over a grid of Tuning values and reports
+// survival time, score distribution and cascade frequency per grid cell
+#include "../src/game.cpp"
+#include "../src/util/thread_pool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#ifndef HEX_VERSION
+#define HEX_VERSION "unknown"
+#endif
+
+#define SELFPLAY_DT (1.0f / 60.0f)
+#define SELFPLAY_AIM_RANGE (PI * 0.45f)
+
+using Clock = std::chrono::steady_clock;
+
+enum Policy {
+    POLICY_RANDOM,
+    POLICY_GREEDY,
+    POLICY_PLANNER
+};
+
+const char* POLICY_NAMES[] = {"random", "greedy", "planner"};
+
+struct SelfPlayConfig {
+    unsigned int seed = 1;
+    int games = 64;
+    size_t threads = 0;
+    Policy policy = POLICY_GREEDY;
+    int candidates = 12;
+    float shotInterval = 0.4f;
+    float maxTime = 600.0f;
+    std::vector<float> boardAcc = {BOARD_ACC};
+    std::vector<float> bombProb = {BOMB_PROB};
+    std::vector<float> nToDrop = {N_TO_DROP};
+    std::vector<float> botRowGap = {BOARD_EMP_BOT_ROW_GAP};
+    std::vector<float> maxCombo = {MAX_COMBO};
+};
+
+struct GameResult {
+    double survival;
+    int score;
+    bool survived;
+    PlayStats stats;
+};
+
+// the scratch state is where the greedy policy tries its candidate shots
+struct SelfPlayWorker {
+    std::unique_ptr<GameState> gs = std::make_unique<GameState>();
+    std::unique_ptr<GameState> scratch = std::make_unique<GameState>();
+};
+
+void fireAt(GameState& gs, float dir) {
+    queueInput(gs, INPUT_AIM, getTime(gs), dir);
+    queueInput(gs, INPUT_FIRE, getTime(gs));
+}
+
+// points scored by the shot first, then how many same-coloured tiles the landing cell touches
+int rateShot(GameState& scratch, const SimState& from, float dir) {
+    restoreSnapshot(scratch, from);
+    clearInputs(scratch);
+    int score = scratch.score;
+    Thing armed = scratch.gun.armed;
+    fireAt(scratch, dir);
+    stepHeadless(scratch, SELFPLAY_DT);
+    for (int f = 0; f < 600 && (scratch.bullet.exists || scratch.bullet.rebouncing) && !scratch.gameOver; ++f)
+        stepHeadless(scratch, SELFPLAY_DT);
+    if (scratch.gameOver)
+        return -1000;
+    int gain = scratch.score - score;
+    int touching = 0;
+    if (gain == 0 && getTile(scratch, scratch.bullet.lstEmp).exists)
+        for (auto& n : getNeighs(scratch, scratch.bullet.lstEmp))
+            touching += getTile(scratch, n).exists && getTile(scratch, n).thing.clr == armed.clr;
+    return gain * 10 + touching;
+}
+
+// games already run one per worker, so the planner traces on the calling thread
+float chooseShot(SelfPlayWorker& w, const SelfPlayConfig& cfg, RandState& rng) {
+    if (cfg.policy == POLICY_RANDOM)
+        return (randFloat(rng) * 2.0f - 1.0f) * SELFPLAY_AIM_RANGE;
+    if (cfg.policy == POLICY_PLANNER) {
+        auto& gs = *w.gs;
+        if (!planShots(gs, 0, false))
+            return 0.0f;
+        auto& plan = gs.tmp.planner.best[0];
+        if (plan.swap)
+            queueInput(gs, INPUT_SWAP, getTime(gs));
+        return plan.dir;
+    }
+    float best = 0.0f;
+    int bestRating = std::numeric_limits<int>::min();
+    float jitter = randFloat(rng);
+    for (int i = 0; i < cfg.candidates; ++i) {
+        float dir = ((i + jitter) / cfg.candidates * 2.0f - 1.0f) * SELFPLAY_AIM_RANGE;
+        int rating = rateShot(*w.scratch, *w.gs, dir);
+        if (rating > bestRating) {
+            bestRating = rating;
+            best = dir;
+        }
+    }
+    return best;
+}
+
+GameResult playGame(SelfPlayWorker& w, const SelfPlayConfig& cfg, const Tuning& tuning, unsigned int seed) {
+    auto& gs = *w.gs;
+    gs.tuning = tuning;
+    w.scratch->ga.p = &HEADLESS_ASSETS;
+    initHeadless(gs, seed);
+    RandState rng = randSeed(seed);
+    double nextShot = 0;
+    double end = gs.gameStartTime + cfg.maxTime;
+    while (!gs.gameOver && getTime(gs) < end) {
+        if (!gs.bullet.exists && getTime(gs) >= nextShot && getTime(gs) > gs.gameStartTime + GAME_START_TIME) {
+            fireAt(gs, chooseShot(w, cfg, rng));
+            nextShot = getTime(gs) + cfg.shotInterval;
+        }
+        stepHeadless(gs, SELFPLAY_DT);
+    }
+    double last = gs.gameOver ? gs.gameOverTime : getTime(gs);
+    return {last - gs.gameStartTime - GAME_START_TIME, gs.score, !gs.gameOver, gs.tmp.stats};
+}
+
+struct CellReport {
+    Tuning tuning;
+    double meanScore, p10, p50, p90, maxScore;
+    double meanSurvival, p50Survival, survivedFrac;
+    double cascadesPerShot, cascadeTilesPerGame, dropsPerShot, bombsPerGame, meanMaxCombo;
+};
+
+double pct(std::vector<double> v, double p) {
+    size_t k = std::min(v.size() - 1, size_t(p * (v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+CellReport summarize(const Tuning& tuning, const GameResult* res, int n) {
+    CellReport c = {tuning};
+    std::vector<double> scores, survival;
+    double shots = 0, drops = 0, cascades = 0, cascadeTiles = 0, bombs = 0, combo = 0, survived = 0;
+    for (int i = 0; i < n; ++i) {
+        scores.push_back(res[i].score);
+        survival.push_back(res[i].survival);
+        shots += res[i].stats.shots;
+        drops += res[i].stats.drops;
+        cascades += res[i].stats.cascades;
+        cascadeTiles += res[i].stats.cascadeTiles;
+        bombs += res[i].stats.bombs;
+        combo += res[i].stats.maxCombo;
+        survived += res[i].survived;
+    }
+    for (int i = 0; i < n; ++i) {
+        c.meanScore += scores[i] / n;
+        c.meanSurvival += survival[i] / n;
+    }
+    c.p10 = pct(scores, 0.1);
+    c.p50 = pct(scores, 0.5);
+    c.p90 = pct(scores, 0.9);
+    c.maxScore = pct(scores, 1.0);
+    c.p50Survival = pct(survival, 0.5);
+    c.survivedFrac = survived / n;
+    c.cascadesPerShot = shots ? cascades / shots : 0;
+    c.dropsPerShot = shots ? drops / shots : 0;
+    c.cascadeTilesPerGame = cascadeTiles / n;
+    c.bombsPerGame = bombs / n;
+    c.meanMaxCombo = combo / n;
+    return c;
+}
+
+std::vector<float> parseList(const char* s) {
+    std::vector<float> v;
+    for (char* end; *s; s = (*end == ',') ? end + 1 : end) {
+        v.push_back(strtof(s, &end));
+        if (end == s)
+            break;
+    }
+    return v;
+}
+
+int usage(const char* prog) {
+    fprintf(stderr, "usage: %s [--games N] [--seed N] [--threads N] [--policy random|greedy|planner] [--candidates N]\n"
+        "          [--shot-interval SEC] [--max-time SEC] [--board-acc LIST] [--bomb-prob LIST] [--n-to-drop LIST]\n"
+        "          [--row-gap LIST] [--max-combo LIST]\n"
+        "  LIST is comma separated, every combination of the lists is one grid cell\n", prog);
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    SelfPlayConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!val)
+            return usage(argv[0]);
+        i++;
+        if (!strcmp(arg, "--games"))
+            cfg.games = std::max(1, atoi(val));
+        else if (!strcmp(arg, "--seed"))
+            cfg.seed = (unsigned int)strtoul(val, nullptr, 10);
+        else if (!strcmp(arg, "--threads"))
+            cfg.threads = (size_t)std::max(0, atoi(val));
+        else if (!strcmp(arg, "--policy") && !strcmp(val, "random"))
+            cfg.policy = POLICY_RANDOM;
+        else if (!strcmp(arg, "--policy") && !strcmp(val, "greedy"))
+            cfg.policy = POLICY_GREEDY;
+        else if (!strcmp(arg, "--policy") && !strcmp(val, "planner"))
+            cfg.policy = POLICY_PLANNER;
+        else if (!strcmp(arg, "--candidates"))
+            cfg.candidates = std::max(1, atoi(val));
+        else if (!strcmp(arg, "--shot-interval"))
+            cfg.shotInterval = strtof(val, nullptr);
+        else if (!strcmp(arg, "--max-time"))
+            cfg.maxTime = strtof(val, nullptr);
+        else if (!strcmp(arg, "--board-acc"))
+            cfg.boardAcc = parseList(val);
+        else if (!strcmp(arg, "--bomb-prob"))
+            cfg.bombProb = parseList(val);
+        else if (!strcmp(arg, "--n-to-drop"))
+            cfg.nToDrop = parseList(val);
+        else if (!strcmp(arg, "--row-gap"))
+            cfg.botRowGap = parseList(val);
+        else if (!strcmp(arg, "--max-combo"))
+            cfg.maxCombo = parseList(val);
+        else
+            return usage(argv[0]);
+    }
+    SetTraceLogLevel(LOG_WARNING);
+
+    std::vector<Tuning> grid;
+    for (float acc : cfg.boardAcc)
+        for (float bomb : cfg.bombProb)
+            for (float drop : cfg.nToDrop)
+                for (float gap : cfg.botRowGap)
+                    for (float combo : cfg.maxCombo)
+                        grid.push_back({acc, bomb, std::max(1, (int)drop), std::clamp((int)gap, 0, BOARD_HEIGHT - 1), std::max(1, (int)combo)});
+    if (grid.empty())
+        return usage(argv[0]);
+
+    // every cell plays the same seeds so the cells differ only by their tuning
+    std::vector<GameResult> results(grid.size() * cfg.games);
+    auto t0 = Clock::now();
+    {
+        ThreadPool pool(cfg.threads);
+        std::vector<SelfPlayWorker> workers(pool.size() + 1);
+        for (size_t c = 0; c < grid.size(); ++c) {
+            for (int g = 0; g < cfg.games; ++g) {
+                pool.submit([&, c, g] {
+                    int w = pool.currentWorker();
+                    results[c * cfg.games + g] = playGame(workers[w >= 0 ? w : pool.size()], cfg, grid[c], cfg.seed + g);
+                });
+            }
+        }
+        pool.wait();
+        cfg.threads = pool.size();
+    }
+    shutdownGame();
+    double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    double simSeconds = 0;
+    for (auto& r : results)
+        simSeconds += r.survival;
+    printf("{\n  \"version\":\"%s\",\"threads\":%zu,\"policy\":\"%s\",\"games\":%zu,\"seconds\":%.3f,\"games_per_sec\":%.1f,\"games_per_sec_per_thread\":%.2f,\"sim_speedup\":%.0f,\n",
+        HEX_VERSION, cfg.threads, POLICY_NAMES[cfg.policy], results.size(), sec,
+        results.size() / sec, results.size() / sec / cfg.threads, simSeconds / sec);
+    printf("  \"cells\":[\n");
+    for (size_t c = 0; c < grid.size(); ++c) {
+        auto r = summarize(grid[c], &results[c * cfg.games], cfg.games);
+        printf("    {\"board_acc\":%g,\"bomb_prob\":%g,\"n_to_drop\":%d,\"row_gap\":%d,\"max_combo\":%d,"
+            "\"score\":{\"mean\":%.1f,\"p10\":%.0f,\"p50\":%.0f,\"p90\":%.0f,\"max\":%.0f},"
+            "\"survival\":{\"mean\":%.1f,\"p50\":%.1f,\"capped\":%.3f},"
+            "\"drops_per_shot\":%.3f,\"cascades_per_shot\":%.3f,\"cascade_tiles_per_game\":%.1f,\"bombs_per_game\":%.2f,\"max_combo_mean\":%.2f}%s\n",
+            r.tuning.boardAcc, r.tuning.bombProb, r.tuning.nToDrop, r.tuning.botRowGap, r.tuning.maxCombo,
+            r.meanScore, r.p10, r.p50, r.p90, r.maxScore, r.meanSurvival, r.p50Survival, r.survivedFrac,
+            r.dropsPerShot, r.cascadesPerShot, r.cascadeTilesPerGame, r.bombsPerGame, r.meanMaxCombo,
+            (c + 1 == grid.size()) ? "" : ",");
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,151 @@
+// hex_verify: re-simulates every replay in a directory on all cores and reports the runs whose
+// re-simulated score or final state hash differ from what the recording claims
+#include "../src/game.cpp"
+#include "../src/util/thread_pool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#ifndef HEX_VERSION
+#define HEX_VERSION "unknown"
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct VerifyConfig {
+    const char* dir = nullptr;
+    size_t threads = 0;
+    bool all = false;
+};
+
+struct VerifyRun {
+    std::string path;
+    ReplayReport rep = {REPLAY_BAD_FILE};
+    uint64_t bytes = 0;
+    double ms = 0;
+};
+
+// a GameState and a read window per worker, reused across the replays it plays
+struct VerifyWorker {
+    std::unique_ptr<GameState> gs = std::make_unique<GameState>();
+    std::unique_ptr<ReplayReader> in = std::make_unique<ReplayReader>();
+};
+
+void verifyOne(VerifyWorker& w, VerifyRun& run) {
+    auto t0 = Clock::now();
+    if (w.in->open(run.path.c_str()))
+        run.rep = playReplay(*w.gs, *w.in);
+    run.bytes = w.in->consumed();
+    w.in->close();
+    run.ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// paths can hold backslashes, quotes and anything else a file name allows
+std::string jsonEscape(const std::string& s) {
+    std::string out;
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if (c < 0x20)
+            out += TextFormat("\\u%04x", c);
+        else
+            out += char(c);
+    }
+    return out;
+}
+
+void writeRun(const VerifyRun& run, bool last) {
+    const auto& r = run.rep;
+    printf("    {\"file\":\"%s\",\"result\":\"%s\",\"frames\":%llu,\"bytes\":%llu,\"ms\":%.3f,\"score\":%d,\"claimed_score\":%d,\"hash\":\"%016llx\",\"claimed_hash\":\"%016llx\"}%s\n",
+        jsonEscape(run.path).c_str(), replayResultName(r.result), (unsigned long long)r.frames, (unsigned long long)run.bytes, run.ms,
+        r.score, r.claimedScore, (unsigned long long)r.hash, (unsigned long long)r.claimedHash, last ? "" : ",");
+}
+
+double percentile(std::vector<double>& v, double p) {
+    if (v.empty())
+        return 0;
+    size_t k = std::min(v.size() - 1, size_t(p * (v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+int usage(const char* prog) {
+    fprintf(stderr, "usage: %s DIR [--threads N] [--all]\n", prog);
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    VerifyConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            cfg.threads = (size_t)std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--all"))
+            cfg.all = true;
+        else if (!cfg.dir && argv[i][0] != '-')
+            cfg.dir = argv[i];
+        else
+            return usage(argv[0]);
+    }
+    std::error_code ec;
+    if (!cfg.dir || !std::filesystem::is_directory(cfg.dir, ec))
+        return usage(argv[0]);
+    SetTraceLogLevel(LOG_WARNING);
+
+    std::vector<VerifyRun> runs;
+    for (auto& entry : std::filesystem::directory_iterator(cfg.dir, ec))
+        if (entry.is_regular_file() && entry.path().extension() == ".hexr")
+            runs.push_back({entry.path().string()});
+    // longest first so a big replay does not start last and hold up the tail
+    std::sort(runs.begin(), runs.end(), [](const VerifyRun& a, const VerifyRun& b) {
+        std::error_code e;
+        return std::filesystem::file_size(a.path, e) > std::filesystem::file_size(b.path, e);
+    });
+
+    auto t0 = Clock::now();
+    {
+        ThreadPool pool(cfg.threads);
+        std::vector<VerifyWorker> workers(pool.size() + 1);
+        for (auto& run : runs) {
+            pool.submit([&] {
+                int w = pool.currentWorker();
+                verifyOne(workers[w >= 0 ? w : pool.size()], run);
+            });
+        }
+        pool.wait();
+        cfg.threads = pool.size();
+    }
+    shutdownGame();
+    double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    uint64_t frames = 0, bytes = 0;
+    size_t failed = 0, counts[REPLAY_BAD_FILE + 1] = {};
+    std::vector<double> ms;
+    for (auto& run : runs) {
+        frames += run.rep.frames;
+        bytes += run.bytes;
+        counts[run.rep.result]++;
+        failed += (run.rep.result == REPLAY_MISMATCH || run.rep.result == REPLAY_BAD_FILE);
+        ms.push_back(run.ms);
+    }
+    printf("{\n  \"version\":\"%s\",\"threads\":%zu,\"replays\":%zu,\"ok\":%zu,\"mismatch\":%zu,\"unfinished\":%zu,\"bad_file\":%zu,\n",
+        HEX_VERSION, cfg.threads, runs.size(), counts[REPLAY_OK], counts[REPLAY_MISMATCH], counts[REPLAY_UNFINISHED], counts[REPLAY_BAD_FILE]);
+    printf("  \"seconds\":%.3f,\"replays_per_min\":%.0f,\"frames_per_sec\":%.0f,\"mb_per_sec\":%.1f,\n",
+        sec, sec > 0 ? runs.size() * 60.0 / sec : 0.0, sec > 0 ? frames / sec : 0.0, sec > 0 ? bytes / sec / 1e6 : 0.0);
+    printf("  \"latency_ms\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f},\n",
+        percentile(ms, 0.5), percentile(ms, 0.95), percentile(ms, 0.99), percentile(ms, 1.0));
+    // only runs that need a look are listed unless --all is given
+    std::vector<const VerifyRun*> listed;
+    for (auto& run : runs)
+        if (cfg.all || run.rep.result != REPLAY_OK)
+            listed.push_back(&run);
+    printf("  \"runs\":[\n");
+    for (size_t i = 0; i < listed.size(); ++i)
+        writeRun(*listed[i], i + 1 == listed.size());
+    printf("  ]\n}\n");
+    return failed ? 1 : 0;
+}